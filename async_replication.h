@@ -0,0 +1,698 @@
+// async_replication.h - Coroutine API for ORSet syncs, merges and snapshots
+#ifndef ASYNC_REPLICATION_H
+#define ASYNC_REPLICATION_H
+
+#if !defined(__cpp_impl_coroutine)
+#error "async_replication.h needs C++20 coroutines: build with -std=c++20"
+#endif
+
+#include "replication.h"
+#include <coroutine>
+#include <sys/eventfd.h>
+
+// Awaitable ORSet replication for coroutine-based services:
+//
+//     ThreadPool pool(2);
+//     Reactor reactor(pool);
+//     AsyncReplica local("A");
+//     AsyncPeer peer(reactor, "127.0.0.1", port);
+//     size_t bytes = co_await sync_with(local, peer);
+//
+// Coroutines run on the ThreadPool. Socket I/O never blocks a pool thread:
+// an operation that would block suspends the coroutine, the Reactor's epoll
+// thread waits for the descriptor, and the coroutine resumes on the pool.
+// Regular files cannot be waited on with epoll, so snapshot reads and writes
+// run on a small separate file pool while the coroutine is suspended. Peers
+// speak ReplicationNode's protocol, so they can be ReplicationNodes.
+//
+// Tasks are lazy, so coroutines take strings by value: a task may first run
+// after the temporaries it was created from are gone.
+
+// Fixed-size thread pool; post() never blocks. The destructor runs the jobs
+// already queued, then joins.
+class ThreadPool {
+  private:
+    mutex lock;
+    condition_variable ready;
+    deque<function<void()>> jobs;
+    vector<thread> workers;
+    bool stopping = false;
+
+  public:
+    explicit ThreadPool(size_t threads) {
+        if (threads == 0) throw invalid_argument("ThreadPool: no threads");
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back([this]() {
+                for (;;) {
+                    function<void()> job;
+                    {
+                        unique_lock<mutex> guard(lock);
+                        ready.wait(guard, [&]() { return stopping || !jobs.empty(); });
+                        if (jobs.empty()) return;
+                        job = move(jobs.front());
+                        jobs.pop_front();
+                    }
+                    job();
+                }
+            });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto &worker : workers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void post(function<void()> job) {
+        {
+            lock_guard<mutex> guard(lock);
+            jobs.push_back(move(job));
+        }
+        ready.notify_one();
+    }
+
+    size_t size() const { return workers.size(); }
+};
+
+// ============= TASKS =============
+//
+// Task<T> is a lazy coroutine: it starts when awaited and resumes its
+// awaiter when done, on whatever thread it finished on. Exceptions travel to
+// the awaiter.
+
+template <typename T>
+class Task;
+
+struct TaskPromiseBase {
+    coroutine_handle<> continuation = noop_coroutine();
+    exception_ptr error;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        coroutine_handle<> await_suspend(coroutine_handle<Promise> done) noexcept {
+            return done.promise().continuation;
+        }
+        void await_resume() noexcept {}
+    };
+
+    suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T result) { value = move(result); }
+    T take() {
+        if (error) rethrow_exception(error);
+        return move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void take() {
+        if (error) rethrow_exception(error);
+    }
+};
+
+template <typename T = void>
+class Task {
+  public:
+    using promise_type = TaskPromise<T>;
+
+  private:
+    coroutine_handle<promise_type> handle;
+
+  public:
+    explicit Task(coroutine_handle<promise_type> h) : handle(h) {}
+    Task(Task&& other) noexcept : handle(exchange(other.handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (handle) handle.destroy();
+        handle = exchange(other.handle, nullptr);
+        return *this;
+    }
+    Task(const Task&) = delete;
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiter) noexcept {
+        handle.promise().continuation = awaiter;
+        return handle;
+    }
+    T await_resume() { return handle.promise().take(); }
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// A coroutine nobody awaits: started by hand, frees itself when done
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() { return {coroutine_handle<promise_type>::from_promise(*this)}; }
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); } // callers catch inside
+    };
+    coroutine_handle<promise_type> handle;
+};
+
+// Runs every task concurrently on `pool`; finishes when all have, with
+// their results in order. The first exception is rethrown once all are done.
+template <typename T>
+Task<vector<T>> when_all(ThreadPool& pool, vector<Task<T>> tasks) {
+    struct State {
+        atomic<size_t> left;
+        coroutine_handle<> parent;
+        vector<optional<T>> results;
+        mutex lock;
+        exception_ptr error;
+    };
+    State state{{tasks.size()}, nullptr, vector<optional<T>>(tasks.size()), {}, nullptr};
+    if (tasks.empty()) co_return vector<T>();
+
+    struct Join {
+        State& state;
+        vector<Task<T>>& tasks;
+        ThreadPool& pool;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> parent) {
+            state.parent = parent;
+            // the last child may resume the parent before the loop ends, so
+            // nothing here is touched after it is posted
+            ThreadPool& executor = pool;
+            for (size_t i = 0, n = tasks.size(); i < n; i++) {
+                auto child = [](State& s, Task<T>& task, size_t index) -> DetachedTask {
+                    try {
+                        s.results[index] = co_await task;
+                    } catch (...) {
+                        lock_guard<mutex> guard(s.lock);
+                        if (!s.error) s.error = current_exception();
+                    }
+                    if (--s.left == 0) s.parent.resume();
+                }(state, tasks[i], i);
+                executor.post([h = child.handle]() { h.resume(); });
+            }
+        }
+        void await_resume() const noexcept {}
+    };
+    co_await Join{state, tasks, pool};
+
+    if (state.error) rethrow_exception(state.error);
+    vector<T> results;
+    for (auto &result : state.results) results.push_back(move(*result));
+    co_return results;
+}
+
+// Blocks the calling thread (not a pool thread) until `task` has run on
+// `pool`; returns its result or rethrows its exception
+template <typename T>
+T sync_wait(ThreadPool& pool, Task<T> task) {
+    struct Outcome {
+        mutex lock;
+        condition_variable changed;
+        bool done = false;
+        exception_ptr error;
+        optional<conditional_t<is_void_v<T>, bool, T>> result;
+    } outcome;
+    // a coroutine lambda must not capture: its closure is gone by the time
+    // the body runs
+    auto runner = [](Task<T>& awaited, Outcome& out) -> DetachedTask {
+        try {
+            if constexpr (is_void_v<T>) {
+                co_await awaited;
+                out.result = true;
+            } else {
+                out.result = co_await awaited;
+            }
+        } catch (...) {
+            out.error = current_exception();
+        }
+        lock_guard<mutex> guard(out.lock);
+        out.done = true;
+        out.changed.notify_one();
+    }(task, outcome);
+    pool.post([h = runner.handle]() { h.resume(); });
+    unique_lock<mutex> guard(outcome.lock);
+    outcome.changed.wait(guard, [&]() { return outcome.done; });
+    if (outcome.error) rethrow_exception(outcome.error);
+    if constexpr (!is_void_v<T>) return move(*outcome.result);
+}
+
+// ============= REACTOR =============
+
+// One epoll thread that resumes coroutines on `executor` once their
+// descriptor is ready, and a file pool for blocking file I/O
+class Reactor {
+  private:
+    ThreadPool& executor;
+    ThreadPool file_pool;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    thread loop;
+    atomic<bool> stopping{false};
+
+    [[noreturn]] static void fail(const string& what) {
+        throw runtime_error("Reactor: " + what + ": " + strerror(errno));
+    }
+
+    void run() {
+        epoll_event events[64];
+        while (!stopping) {
+            int n = epoll_wait(epoll_fd, events, 64, -1);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return;
+            for (int i = 0; i < n; i++) {
+                if (!events[i].data.ptr) continue; // wake_fd
+                auto h = coroutine_handle<>::from_address(events[i].data.ptr);
+                executor.post([h]() { h.resume(); });
+            }
+        }
+    }
+
+  public:
+    explicit Reactor(ThreadPool& pool, size_t file_threads = 2) : executor(pool), file_pool(file_threads) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) fail("epoll_create1");
+        wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (wake_fd < 0) fail("eventfd");
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) < 0) fail("epoll_ctl");
+        loop = thread([this]() { run(); });
+    }
+
+    ~Reactor() {
+        stopping = true;
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) {
+        }
+        loop.join();
+        close(wake_fd);
+        close(epoll_fd);
+    }
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    ThreadPool& get_executor() { return executor; }
+
+    // Resumes `h` on the executor once `fd` has one of `events`. One-shot:
+    // each wait registers again.
+    void watch(int fd, uint32_t events, coroutine_handle<> h) {
+        epoll_event event{};
+        event.events = events | EPOLLONESHOT;
+        event.data.ptr = h.address();
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0) {
+            if (errno != ENOENT || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) fail("epoll_ctl");
+        }
+    }
+
+    // Stops watching a descriptor before it is closed
+    void forget(int fd) { epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr); }
+
+    struct Ready {
+        Reactor& reactor;
+        int fd;
+        uint32_t events;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h) { reactor.watch(fd, events, h); }
+        void await_resume() const noexcept {}
+    };
+
+    Ready readable(int fd) { return {*this, fd, EPOLLIN | EPOLLRDHUP}; }
+    Ready writable(int fd) { return {*this, fd, EPOLLOUT}; }
+
+    // Runs `job` on the file pool and resumes on the executor with its
+    // result (or its exception)
+    template <typename Job>
+    Task<invoke_result_t<Job>> on_file_pool(Job job) {
+        using Result = invoke_result_t<Job>;
+        struct Offload {
+            Reactor& reactor;
+            Job& job;
+            optional<conditional_t<is_void_v<Result>, bool, Result>> result;
+            exception_ptr error;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(coroutine_handle<> h) {
+                reactor.file_pool.post([this, h]() {
+                    try {
+                        if constexpr (is_void_v<Result>) {
+                            job();
+                            result = true;
+                        } else {
+                            result = job();
+                        }
+                    } catch (...) {
+                        error = current_exception();
+                    }
+                    reactor.executor.post([h]() { h.resume(); });
+                });
+            }
+            void await_resume() const noexcept {}
+        };
+        Offload offload{*this, job, nullopt, nullptr};
+        co_await offload;
+        if (offload.error) rethrow_exception(offload.error);
+        if constexpr (!is_void_v<Result>) co_return move(*offload.result);
+    }
+};
+
+// ============= CONNECTIONS =============
+
+// A non-blocking stream socket or pipe carrying ReplicationNode frames
+class AsyncConnection {
+  private:
+    Reactor& reactor;
+    int fd;
+    string in;
+
+    [[noreturn]] static void fail(const string& what) {
+        throw runtime_error("AsyncConnection: " + what + ": " + strerror(errno));
+    }
+
+  public:
+    struct Frame {
+        MessageType type = Hello;
+        uint64_t id = 0;
+        string body;
+    };
+
+    // Takes ownership of `descriptor` and makes it non-blocking
+    AsyncConnection(Reactor& r, int descriptor) : reactor(r), fd(descriptor) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) fail("fcntl");
+    }
+
+    ~AsyncConnection() {
+        reactor.forget(fd);
+        close(fd);
+    }
+
+    AsyncConnection(const AsyncConnection&) = delete;
+    AsyncConnection& operator=(const AsyncConnection&) = delete;
+
+    static Task<unique_ptr<AsyncConnection>> connect(Reactor& reactor, string host, uint16_t port) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) throw invalid_argument("bad address " + host);
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) fail("socket");
+        auto conn = make_unique<AsyncConnection>(reactor, fd);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            if (errno != EINPROGRESS) fail("connect");
+            co_await reactor.writable(fd);
+            int error = 0;
+            socklen_t size = sizeof(error);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size);
+            if (error) {
+                errno = error;
+                fail("connect");
+            }
+        }
+        co_return conn;
+    }
+
+    Task<void> write_all(string bytes) {
+        for (size_t sent = 0; sent < bytes.size();) {
+            ssize_t n = ::send(fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == ENOTSOCK) n = ::write(fd, bytes.data() + sent, bytes.size() - sent);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                co_await reactor.writable(fd);
+                continue;
+            }
+            if (n < 0) fail("send");
+            sent += n;
+        }
+    }
+
+    Task<void> send_frame(MessageType type, uint64_t id, string body) {
+        string frame;
+        ReplicationWire::put_header(frame, type, id, body.size());
+        frame += body;
+        co_await write_all(move(frame));
+    }
+
+    // The next frame, or nothing at a clean end of stream
+    Task<optional<Frame>> read_frame() {
+        const size_t chunk = 64 * 1024;
+        for (;;) {
+            if (in.size() >= 4) {
+                size_t length = ReplicationWire::get_fixed(in.data(), 4);
+                if (length < ReplicationWire::kHeaderSize - 4 || length > ReplicationWire::kMaxFrame) {
+                    throw runtime_error("AsyncConnection: bad frame length");
+                }
+                if (in.size() >= 4 + length) {
+                    Frame frame{MessageType(uint8_t(in[4])), ReplicationWire::get_fixed(in.data() + 5, 8),
+                                in.substr(ReplicationWire::kHeaderSize, length + 4 - ReplicationWire::kHeaderSize)};
+                    in.erase(0, 4 + length);
+                    co_return frame;
+                }
+            }
+            size_t old_size = in.size();
+            in.resize(old_size + chunk);
+            ssize_t n = ::read(fd, &in[old_size], chunk);
+            in.resize(old_size + max<ssize_t>(n, 0));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                co_await reactor.readable(fd);
+                continue;
+            }
+            if (n < 0) fail("read");
+            if (n == 0) {
+                if (!in.empty()) throw runtime_error("AsyncConnection: stream ends inside a frame");
+                co_return nullopt;
+            }
+        }
+    }
+};
+
+// ============= REPLICAS AND PEERS =============
+
+// An ORSet shared by coroutines on several threads. Every access takes the
+// lock, and no lock is held across a suspension point.
+class AsyncReplica {
+  private:
+    mutable mutex lock;
+    string replica_id;
+    ORSet state;
+
+  public:
+    explicit AsyncReplica(const string& id) : replica_id(id), state(id) {}
+
+    // Runs f(ORSet&) under the lock and returns its result
+    template <typename F>
+    auto with_state(F f) {
+        lock_guard<mutex> guard(lock);
+        return f(state);
+    }
+
+    template <typename F>
+    auto with_state(F f) const {
+        lock_guard<mutex> guard(lock);
+        return f(static_cast<const ORSet&>(state));
+    }
+
+    void add(const string& element) {
+        with_state([&](ORSet& s) { s.add(element); });
+    }
+
+    void remove(const string& element) {
+        with_state([&](ORSet& s) { s.remove(element); });
+    }
+
+    bool contains(const string& element) const {
+        return with_state([&](const ORSet& s) { return s.contains(element); });
+    }
+
+    ORSet copy() const {
+        return with_state([](const ORSet& s) { return s; });
+    }
+
+    const string& id() const { return replica_id; }
+};
+
+// A remote ReplicationNode (or anything speaking its protocol) to pull
+// from. The connection is opened on the first sync and reused; one sync at
+// a time per AsyncPeer.
+class AsyncPeer {
+  private:
+    Reactor& reactor;
+    string host;
+    uint16_t port;
+    unique_ptr<AsyncConnection> conn;
+    string peer_id;
+    uint64_t next_request = 1;
+
+    friend Task<size_t> sync_with(AsyncReplica& local, AsyncPeer& peer, SyncStrategy strategy, size_t buckets);
+
+  public:
+    AsyncPeer(Reactor& r, const string& peer_host, uint16_t peer_port) : reactor(r), host(peer_host), port(peer_port) {}
+
+    void disconnect() { conn.reset(); }
+    bool connected() const { return bool(conn); }
+};
+
+// Pulls from `peer` with a full, delta or digest request and merges the
+// reply into `local`; returns the reply's size in bytes. Summaries exchanged
+// on the way count as acknowledgements, as with ReplicationNode. A broken
+// connection throws runtime_error and is dropped; the next sync reconnects.
+inline Task<size_t> sync_with(AsyncReplica& local, AsyncPeer& peer, SyncStrategy strategy = SyncStrategy::Delta,
+                              size_t buckets = 1024) {
+    if (!peer.conn) {
+        peer.conn = co_await AsyncConnection::connect(peer.reactor, peer.host, peer.port);
+        co_await peer.conn->send_frame(Hello, 0, local.id());
+    }
+    AsyncConnection& conn = *peer.conn;
+
+    ByteWriter body;
+    MessageType type = FullRequest, reply = FullReply;
+    if (strategy == SyncStrategy::Delta || strategy == SyncStrategy::Digest) {
+        local.with_state([&](ORSet& s) {
+            ReplicationWire::put_summary(body, s.summary());
+            if (strategy != SyncStrategy::Digest) return;
+            vector<uint64_t> digest = s.bucket_digest(buckets);
+            body.put_varint(digest.size());
+            for (uint64_t sum : digest) ReplicationWire::put_fixed(body.buffer, sum, 8);
+        });
+        type = strategy == SyncStrategy::Delta ? DeltaRequest : DigestRequest;
+        reply = strategy == SyncStrategy::Delta ? DeltaReply : DigestReply;
+    }
+    uint64_t id = peer.next_request++;
+    try {
+        co_await conn.send_frame(type, id, move(body.buffer));
+        for (;;) {
+            optional<AsyncConnection::Frame> frame = co_await conn.read_frame();
+            if (!frame) throw runtime_error("sync_with: peer closed the connection");
+            if (frame->type == Hello) {
+                peer.peer_id = frame->body;
+                continue;
+            }
+            if (frame->id != id || frame->type != reply) {
+                throw runtime_error("sync_with: unexpected reply");
+            }
+
+            // decode outside the lock, merge under it
+            ByteReader in(frame->body);
+            map<string, uint64_t> peer_vv;
+            vector<uint32_t> differing;
+            if (type != FullRequest) peer_vv = ReplicationWire::get_summary(in);
+            if (type == DigestRequest) {
+                // checked before allocating: the count is the peer's
+                uint64_t count = in.get_varint();
+                if (count > buckets || count > in.remaining()) throw runtime_error("sync_with: bad bucket count");
+                differing.resize(count);
+                for (auto &b : differing) {
+                    b = uint32_t(in.get_varint());
+                    if (b >= buckets) throw runtime_error("sync_with: bad bucket");
+                }
+            }
+            ORSet received = ORSetCodec::decode(string_view(frame->body).substr(in.position()));
+            local.with_state([&](ORSet& s) {
+                if (type == DigestRequest) {
+                    s.merge_buckets(received, buckets, differing);
+                } else {
+                    s.merge(received);
+                }
+                if (type != FullRequest && !peer.peer_id.empty()) s.acknowledge(peer.peer_id, peer_vv);
+            });
+            co_return frame->body.size();
+        }
+    } catch (...) {
+        peer.conn.reset();
+        throw;
+    }
+}
+
+// Writes `replica`'s full state to a stream as one FullReply frame
+inline Task<void> send_state(const AsyncReplica& replica, AsyncConnection& stream) {
+    string bytes = replica.with_state([](const ORSet& s) { return ORSetCodec::encode(s); });
+    co_await stream.send_frame(FullReply, 0, move(bytes));
+}
+
+// Merges the next state or delta frame of `stream` into `replica`. Returns
+// false at a clean end of stream.
+inline Task<bool> merge_from(AsyncReplica& replica, AsyncConnection& stream) {
+    optional<AsyncConnection::Frame> frame = co_await stream.read_frame();
+    if (!frame) co_return false;
+    if (frame->type != FullReply) throw runtime_error("merge_from: not a state frame");
+    ORSet received = ORSetCodec::decode(frame->body);
+    replica.with_state([&](ORSet& s) { s.merge(received); });
+    co_return true;
+}
+
+// ============= SNAPSHOTS =============
+//
+// The encoded state in a file, replaced atomically: written to a temporary
+// file, synced, renamed over the old one, then the directory synced so the
+// rename survives a crash, as in ORSetStore. Encoding and decoding run on
+// the executor, the file I/O on the reactor's file pool.
+
+inline Task<void> save_snapshot(Reactor& reactor, const AsyncReplica& replica, string path) {
+    string bytes = replica.with_state([](const ORSet& s) { return ORSetCodec::encode(s); });
+    co_await reactor.on_file_pool([&]() {
+        string temporary = path + ".tmp";
+        int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) throw runtime_error("save_snapshot: open " + temporary + ": " + strerror(errno));
+        for (size_t written = 0; written < bytes.size();) {
+            ssize_t n = write(fd, bytes.data() + written, bytes.size() - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                close(fd);
+                throw runtime_error("save_snapshot: write: " + string(strerror(errno)));
+            }
+            written += n;
+        }
+        bool synced = fdatasync(fd) == 0;
+        close(fd);
+        if (!synced || rename(temporary.c_str(), path.c_str()) < 0) {
+            throw runtime_error("save_snapshot: " + string(strerror(errno)));
+        }
+        // the rename is only durable once the directory entry is
+        filesystem::path parent = filesystem::path(path).parent_path();
+        if (parent.empty()) parent = ".";
+        int dir_fd = open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd < 0) throw runtime_error("save_snapshot: open " + parent.string() + ": " + strerror(errno));
+        bool dir_synced = fsync(dir_fd) == 0;
+        close(dir_fd);
+        if (!dir_synced) throw runtime_error("save_snapshot: fsync " + parent.string() + ": " + strerror(errno));
+    });
+}
+
+inline Task<ORSet> load_snapshot(Reactor& reactor, string path) {
+    string bytes = co_await reactor.on_file_pool([&]() {
+        ifstream in(path, ios::binary);
+        if (!in) throw runtime_error("load_snapshot: cannot open " + path);
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    });
+    co_return ORSetCodec::decode(bytes);
+}
+
+#endif
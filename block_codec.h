@@ -0,0 +1,518 @@
+// block_codec.h - Dependency-free LZ77 + Huffman block compression
+#ifndef BLOCK_CODEC_H
+#define BLOCK_CODEC_H
+
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// General-purpose compressor in the DEFLATE family, tuned for the sizes
+// replication ships: a few hundred bytes of delta up to many megabytes of
+// full state.
+//
+//   stream  varint raw size, then blocks until that many bytes are out
+//   block   u8 mode, varint raw length, varint payload length, payload
+//           mode 0: the raw bytes; mode 1: Huffman-coded LZ77 sequences
+//
+// Each block takes up to kBlockBytes of input and has its own Huffman tables,
+// so they follow the statistics of that part of the input. Matches reach back
+// kWindowBytes into earlier blocks. A block that would not shrink is stored.
+//
+// Levels 1-9 trade speed for ratio: the matcher follows longer hash chains
+// and, from level 4, tries the next position before taking a match (lazy
+// matching). Level 0 only stores.
+//
+// A sequence is a literal or a (length, distance) match. Lengths share one
+// alphabet with the literals and distances have their own; larger values
+// are a symbol for the power of two and the next two bits, followed by the
+// remaining bits as they are. Codes are canonical, at most kMaxCodeBits long,
+// and the tables are sent as run-length coded code lengths.
+struct BlockCodec {
+    static constexpr int kDefaultLevel = 6;
+    static constexpr size_t kBlockBytes = 64 * 1024;
+    static constexpr size_t kWindowBytes = 256 * 1024;
+
+  private:
+    static constexpr int kMaxCodeBits = 12;
+    static constexpr size_t kMinMatch = 4;
+    static constexpr size_t kValueSymbols = 72;                // values below 2^18
+    static constexpr size_t kLiteralSymbols = 256 + kValueSymbols; // literals, then match lengths
+
+    // LSB-first bit packing, as the decoder reads it
+    struct BitWriter {
+        string& out;
+        uint64_t bits = 0;
+        int count = 0;
+
+        explicit BitWriter(string& o) : out(o) {}
+
+        void put(uint64_t value, int n) {
+            if (n == 0) return;
+            bits |= value << count;
+            count += n;
+            while (count >= 8) {
+                out.push_back(char(bits & 0xff));
+                bits >>= 8;
+                count -= 8;
+            }
+        }
+
+        void flush() {
+            if (count > 0) out.push_back(char(bits & 0xff));
+            bits = 0;
+            count = 0;
+        }
+    };
+
+    struct BitReader {
+        string_view data;
+        size_t pos = 0;
+        uint64_t bits = 0;
+        int count = 0;
+        size_t overrun = 0; // zero bytes fed past the end
+
+        explicit BitReader(string_view d) : data(d) {}
+
+        void refill() {
+            while (count <= 56) {
+                uint64_t byte = 0;
+                if (pos < data.size()) {
+                    byte = uint8_t(data[pos++]);
+                } else {
+                    overrun++;
+                }
+                bits |= byte << count;
+                count += 8;
+            }
+        }
+
+        uint64_t peek(int n) {
+            if (count < n) refill();
+            return bits & ((uint64_t(1) << n) - 1);
+        }
+
+        void skip(int n) {
+            bits >>= n;
+            count -= n;
+        }
+
+        uint64_t get(int n) {
+            if (n == 0) return 0;
+            uint64_t value = peek(n);
+            skip(n);
+            return value;
+        }
+
+        // true if more bits were consumed than the input had
+        bool overran() const { return overrun * 8 > size_t(count); }
+    };
+
+    // value -> (symbol, extra bits): below 8 the value itself, else 8 + four
+    // symbols per power of two, picked by the two bits under the top one
+    static void split_value(uint32_t value, uint32_t& symbol, uint32_t& extra, int& extra_bits) {
+        if (value < 8) {
+            symbol = value;
+            extra_bits = 0;
+            extra = 0;
+            return;
+        }
+        int top = 31 - __builtin_clz(value);
+        extra_bits = top - 2;
+        symbol = 8 + (top - 3) * 4 + ((value >> extra_bits) & 3);
+        extra = value & ((1u << extra_bits) - 1);
+    }
+
+    static uint32_t join_value(uint32_t symbol, BitReader& in) {
+        if (symbol < 8) return symbol;
+        int top = (symbol - 8) / 4 + 3, extra_bits = top - 2;
+        return ((4 | ((symbol - 8) & 3)) << extra_bits) | uint32_t(in.get(extra_bits));
+    }
+
+    // Code lengths for the frequencies, none longer than kMaxCodeBits:
+    // Huffman's construction, retried on flattened counts while too deep
+    static vector<uint8_t> code_lengths(vector<uint64_t> freq) {
+        vector<uint8_t> lengths(freq.size(), 0);
+        vector<size_t> used;
+        for (size_t s = 0; s < freq.size(); s++) {
+            if (freq[s]) used.push_back(s);
+        }
+        if (used.empty()) return lengths;
+        if (used.size() == 1) {
+            lengths[used[0]] = 1;
+            return lengths;
+        }
+        while (true) {
+            // nodes 0..n-1 are leaves; parents are appended
+            vector<size_t> parent(2 * used.size() - 1, 0);
+            priority_queue<pair<uint64_t, size_t>, vector<pair<uint64_t, size_t>>, greater<>> queue;
+            for (size_t i = 0; i < used.size(); i++) queue.push({freq[used[i]], i});
+            size_t next = used.size();
+            while (queue.size() > 1) {
+                auto a = queue.top();
+                queue.pop();
+                auto b = queue.top();
+                queue.pop();
+                parent[a.second] = parent[b.second] = next;
+                queue.push({a.first + b.first, next++});
+            }
+            // parents come after their children, so depths fill root first
+            vector<uint8_t> depth(next, 0);
+            for (size_t node = next - 1; node-- > 0;) depth[node] = depth[parent[node]] + 1;
+            uint8_t deepest = 0;
+            for (size_t i = 0; i < used.size(); i++) deepest = max(deepest, depth[i]);
+            if (deepest <= kMaxCodeBits) {
+                for (size_t i = 0; i < used.size(); i++) lengths[used[i]] = depth[i];
+                return lengths;
+            }
+            for (size_t s : used) freq[s] = (freq[s] + 1) / 2;
+        }
+    }
+
+    // Canonical codes, bit-reversed for LSB-first output
+    static vector<uint16_t> canonical_codes(const vector<uint8_t>& lengths) {
+        uint16_t count[kMaxCodeBits + 1] = {}, next[kMaxCodeBits + 2] = {};
+        for (uint8_t length : lengths) count[length]++;
+        count[0] = 0;
+        for (int bits = 1; bits <= kMaxCodeBits; bits++) next[bits + 1] = (next[bits] + count[bits]) << 1;
+        vector<uint16_t> codes(lengths.size(), 0);
+        for (size_t s = 0; s < lengths.size(); s++) {
+            int length = lengths[s];
+            if (!length) continue;
+            uint16_t code = next[length]++, reversed = 0;
+            for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+            codes[s] = reversed;
+        }
+        return codes;
+    }
+
+    // Lengths as 4-bit values; 13 + 4 bits is a run of 3-18 unused symbols,
+    // 14 + 8 bits a run of 19-274
+    static void write_lengths(BitWriter& out, const vector<uint8_t>& lengths) {
+        for (size_t s = 0; s < lengths.size();) {
+            size_t run = 0;
+            while (s + run < lengths.size() && lengths[s + run] == 0 && run < 274) run++;
+            if (run >= 19) {
+                out.put(14, 4);
+                out.put(run - 19, 8);
+                s += run;
+            } else if (run >= 3) {
+                out.put(13, 4);
+                out.put(run - 3, 4);
+                s += run;
+            } else {
+                out.put(lengths[s++], 4);
+            }
+        }
+    }
+
+    static vector<uint8_t> read_lengths(BitReader& in, size_t symbols) {
+        vector<uint8_t> lengths(symbols, 0);
+        for (size_t s = 0; s < symbols;) {
+            uint32_t value = uint32_t(in.get(4));
+            if (value <= kMaxCodeBits) {
+                lengths[s++] = uint8_t(value);
+                continue;
+            }
+            size_t run;
+            if (value == 13) {
+                run = 3 + in.get(4);
+            } else if (value == 14) {
+                run = 19 + in.get(8);
+            } else {
+                throw runtime_error("BlockCodec: bad code length");
+            }
+            if (run > symbols - s) throw runtime_error("BlockCodec: code lengths overrun");
+            s += run;
+        }
+        return lengths;
+    }
+
+    // Indexed by the next `bits` input bits, as many as the longest code so
+    // small blocks build small tables: symbol << 4 | code length, 0 where no
+    // code matches
+    struct DecodeTable {
+        vector<uint16_t> entries;
+        int bits = 1;
+    };
+
+    static DecodeTable decode_table(const vector<uint8_t>& lengths) {
+        DecodeTable table;
+        for (uint8_t length : lengths) table.bits = max<int>(table.bits, length);
+        table.entries.assign(size_t(1) << table.bits, 0);
+        vector<uint16_t> codes = canonical_codes(lengths);
+        for (size_t s = 0; s < lengths.size(); s++) {
+            int length = lengths[s];
+            if (!length) continue;
+            for (size_t fill = codes[s]; fill < table.entries.size(); fill += size_t(1) << length) {
+                if (table.entries[fill]) throw runtime_error("BlockCodec: oversubscribed code");
+                table.entries[fill] = uint16_t(s << 4 | length);
+            }
+        }
+        return table;
+    }
+
+    static uint32_t read_symbol(BitReader& in, const DecodeTable& table) {
+        uint16_t entry = table.entries[in.peek(table.bits)];
+        if (!entry) throw runtime_error("BlockCodec: bad code");
+        in.skip(entry & 15);
+        return entry >> 4;
+    }
+
+    struct Sequence {
+        uint32_t literal_or_length; // byte, or match length when distance > 0
+        uint32_t distance;
+    };
+
+    struct MatchParams {
+        int chain;   // candidates tried per position
+        size_t lazy; // a match shorter than this waits to see the next position's
+        size_t nice; // a match this long ends the search
+    };
+
+    static MatchParams params(int level) {
+        static const MatchParams table[] = {
+            {0, 0, 0},    {1, 0, 16},    {2, 0, 32},     {4, 0, 64},      {8, 8, 64},
+            {16, 16, 128}, {32, 32, 128}, {64, 64, 256}, {128, 256, 1024}, {512, 65536, 65536},
+        };
+        return table[level];
+    }
+
+    // Hash chains over the whole input: head[] holds the newest position+1
+    // for each hash of 4 bytes, prev[] links a position to the previous one
+    // with the same hash, within the window. Both are sized to the input, so
+    // a small delta does not pay for clearing a window it never uses.
+    class Matcher {
+      private:
+        string_view input;
+        MatchParams params;
+        int hash_bits = 8;
+        vector<uint32_t> head;
+        vector<uint32_t> prev;
+        size_t inserted = 0; // positions below this are in the chains
+
+        uint32_t hash(const char* p) const {
+            uint32_t value;
+            memcpy(&value, p, 4);
+            return (value * 2654435761u) >> (32 - hash_bits);
+        }
+
+        static size_t common(const char* a, const char* b, size_t limit) {
+            size_t n = 0;
+            while (n + 8 <= limit) {
+                uint64_t x, y;
+                memcpy(&x, a + n, 8);
+                memcpy(&y, b + n, 8);
+                if (x != y) return n + (__builtin_ctzll(x ^ y) >> 3);
+                n += 8;
+            }
+            while (n < limit && a[n] == b[n]) n++;
+            return n;
+        }
+
+      public:
+        Matcher(string_view in, MatchParams p) : input(in), params(p) {
+            while (hash_bits < 16 && (size_t(1) << hash_bits) < input.size()) hash_bits++;
+            head.assign(size_t(1) << hash_bits, 0);
+            prev.assign(max<size_t>(1, min<size_t>(kWindowBytes, input.size())), 0);
+        }
+
+        // Adds positions up to (not including) end to the chains
+        void insert_upto(size_t end) {
+            end = min(end, input.size() >= kMinMatch ? input.size() - kMinMatch + 1 : 0);
+            for (; inserted < end; inserted++) {
+                uint32_t& slot = head[hash(input.data() + inserted)];
+                prev[inserted % prev.size()] = slot;
+                slot = uint32_t(inserted + 1);
+            }
+        }
+
+        // Longest match at pos, at most limit bytes; length 0 if none
+        pair<size_t, size_t> longest(size_t pos, size_t limit) {
+            if (limit < kMinMatch || pos + kMinMatch > input.size()) return {0, 0};
+            insert_upto(pos);
+            size_t best = 0, distance = 0;
+            uint32_t candidate = head[hash(input.data() + pos)];
+            for (int tries = params.chain; candidate && tries > 0; tries--) {
+                size_t at = candidate - 1;
+                if (pos - at > kWindowBytes - 1) break;
+                // a longer match must also differ nowhere up to best
+                bool longer = best == 0 || (input[at + best] == input[pos + best] && best < limit);
+                size_t length = longer ? common(input.data() + at, input.data() + pos, limit) : 0;
+                if (length > best) {
+                    best = length;
+                    distance = pos - at;
+                    if (best >= params.nice || best == limit) break;
+                }
+                uint32_t previous = prev[at % prev.size()];
+                if (previous >= candidate) break; // the slot was reused by a newer position
+                candidate = previous;
+            }
+            return best >= kMinMatch ? make_pair(best, distance) : make_pair(size_t(0), size_t(0));
+        }
+    };
+
+    // Sequences for input[start, end), matches may reach before start
+    static vector<Sequence> parse(string_view input, size_t start, size_t end, Matcher& matcher, MatchParams p) {
+        vector<Sequence> out;
+        size_t pos = start;
+        while (pos < end) {
+            auto match = matcher.longest(pos, end - pos);
+            if (match.first && match.first < p.lazy && pos + 1 < end) {
+                auto next = matcher.longest(pos + 1, end - pos - 1);
+                if (next.first > match.first) {
+                    out.push_back({uint8_t(input[pos]), 0});
+                    pos++;
+                    match = next;
+                }
+            }
+            if (!match.first) {
+                out.push_back({uint8_t(input[pos]), 0});
+                pos++;
+                continue;
+            }
+            out.push_back({uint32_t(match.first), uint32_t(match.second)});
+            pos += match.first;
+        }
+        return out;
+    }
+
+    // Huffman-coded sequences; empty if not smaller than the raw bytes
+    static string encode_block(const vector<Sequence>& sequences, size_t raw_length) {
+        vector<uint64_t> literal_freq(kLiteralSymbols, 0), distance_freq(kValueSymbols, 0);
+        uint32_t symbol, extra;
+        int extra_bits;
+        for (const auto &seq : sequences) {
+            if (!seq.distance) {
+                literal_freq[seq.literal_or_length]++;
+                continue;
+            }
+            split_value(seq.literal_or_length - kMinMatch, symbol, extra, extra_bits);
+            literal_freq[256 + symbol]++;
+            split_value(seq.distance - 1, symbol, extra, extra_bits);
+            distance_freq[symbol]++;
+        }
+        vector<uint8_t> literal_lengths = code_lengths(literal_freq), distance_lengths = code_lengths(distance_freq);
+        vector<uint16_t> literal_codes = canonical_codes(literal_lengths);
+        vector<uint16_t> distance_codes = canonical_codes(distance_lengths);
+
+        string out;
+        BitWriter bits(out);
+        write_lengths(bits, literal_lengths);
+        write_lengths(bits, distance_lengths);
+        for (const auto &seq : sequences) {
+            if (out.size() >= raw_length) return string();
+            if (!seq.distance) {
+                bits.put(literal_codes[seq.literal_or_length], literal_lengths[seq.literal_or_length]);
+                continue;
+            }
+            split_value(seq.literal_or_length - kMinMatch, symbol, extra, extra_bits);
+            bits.put(literal_codes[256 + symbol], literal_lengths[256 + symbol]);
+            bits.put(extra, extra_bits);
+            split_value(seq.distance - 1, symbol, extra, extra_bits);
+            bits.put(distance_codes[symbol], distance_lengths[symbol]);
+            bits.put(extra, extra_bits);
+        }
+        bits.flush();
+        return out.size() < raw_length ? out : string();
+    }
+
+    static void decode_block(string_view payload, size_t raw_length, string& out) {
+        BitReader in(payload);
+        DecodeTable literal_table = decode_table(read_lengths(in, kLiteralSymbols));
+        DecodeTable distance_table = decode_table(read_lengths(in, kValueSymbols));
+        size_t end = out.size() + raw_length;
+        while (out.size() < end) {
+            uint32_t symbol = read_symbol(in, literal_table);
+            if (symbol < 256) {
+                out.push_back(char(symbol));
+                continue;
+            }
+            size_t length = join_value(symbol - 256, in) + kMinMatch;
+            size_t distance = join_value(read_symbol(in, distance_table), in) + size_t(1);
+            if (distance > out.size() || distance >= kWindowBytes) throw runtime_error("BlockCodec: bad distance");
+            if (length > end - out.size()) throw runtime_error("BlockCodec: match past the block");
+            size_t from = out.size() - distance;
+            // copied bytewise: an overlapping match repeats its own output
+            for (size_t i = 0; i < length; i++) out.push_back(out[from + i]);
+        }
+        if (in.overran()) throw runtime_error("BlockCodec: truncated block");
+    }
+
+    static void put_varint(string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(char(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(char(value));
+    }
+
+    static uint64_t get_varint(string_view in, size_t& pos) {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= in.size()) throw runtime_error("BlockCodec: truncated input");
+            uint8_t byte = uint8_t(in[pos++]);
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        throw runtime_error("BlockCodec: varint too long");
+    }
+
+  public:
+    static string compress(string_view input, int level = kDefaultLevel) {
+        if (level < 0 || level > 9) throw invalid_argument("BlockCodec: level must be 0..9");
+        if (input.size() > numeric_limits<uint32_t>::max() - 1) throw invalid_argument("BlockCodec: input too large");
+        string out;
+        put_varint(out, input.size());
+        MatchParams p = params(level);
+        unique_ptr<Matcher> matcher;
+        if (level > 0) matcher = make_unique<Matcher>(input, p);
+        for (size_t start = 0; start < input.size(); start += kBlockBytes) {
+            size_t end = min(input.size(), start + kBlockBytes);
+            string payload;
+            if (matcher) payload = encode_block(parse(input, start, end, *matcher, p), end - start);
+            bool stored = payload.empty();
+            out.push_back(char(stored ? 0 : 1));
+            put_varint(out, end - start);
+            put_varint(out, stored ? end - start : payload.size());
+            if (stored) {
+                out.append(input.data() + start, end - start);
+            } else {
+                out.append(payload);
+            }
+        }
+        return out;
+    }
+
+    static string decompress(string_view input) {
+        size_t pos = 0;
+        uint64_t total = get_varint(input, pos);
+        string out;
+        // a stored block is never bigger than its bytes, so this bounds what
+        // a malformed header can make us reserve
+        out.reserve(min<uint64_t>(total, input.size() * 64));
+        while (out.size() < total) {
+            if (pos >= input.size()) throw runtime_error("BlockCodec: truncated input");
+            uint8_t mode = uint8_t(input[pos++]);
+            uint64_t raw_length = get_varint(input, pos);
+            uint64_t payload_length = get_varint(input, pos);
+            if (raw_length == 0 || raw_length > kBlockBytes || raw_length > total - out.size()) {
+                throw runtime_error("BlockCodec: bad block length");
+            }
+            if (payload_length > input.size() - pos) throw runtime_error("BlockCodec: truncated input");
+            string_view payload = input.substr(pos, payload_length);
+            pos += payload_length;
+            if (mode == 0) {
+                if (payload_length != raw_length) throw runtime_error("BlockCodec: bad stored block");
+                out.append(payload);
+            } else if (mode == 1) {
+                decode_block(payload, raw_length, out);
+            } else {
+                throw runtime_error("BlockCodec: bad block mode");
+            }
+        }
+        if (pos != input.size()) throw runtime_error("BlockCodec: trailing bytes");
+        return out;
+    }
+};
+
+#endif
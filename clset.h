@@ -0,0 +1,75 @@
+// clset.h - Causal-length set, an alternative OR-Set backend
+#ifndef CLSET_H
+#define CLSET_H
+
+#include "crdt.h"
+
+// Causal-length set: every element carries one counter, the length of its
+// add/remove history. Odd means present, even means absent. add() on an
+// absent element and remove() on a present one both bump the length, and
+// merge takes the element-wise max, so metadata stays O(1) per element no
+// matter how much churn a key sees.
+//
+// Semantics differ from ORSet in one corner: an add that races a remove at
+// the same length is a no-op on a replica that already sees the element, so
+// the remove wins there. Under churn that is the price of constant metadata.
+class CLSet {
+  private:
+    string replica_id;
+    unordered_map<string, uint64_t> lengths;
+    size_t live; // number of elements with odd length
+
+  public:
+    CLSet(const string& id) : replica_id(id), live(0) {}
+
+    void add(const string& element) {
+        uint64_t& length = lengths[element];
+        if (length % 2 == 0) {
+            length++;
+            live++;
+        }
+    }
+
+    void remove(const string& element) {
+        auto it = lengths.find(element);
+        if (it != lengths.end() && it->second % 2 == 1) {
+            it->second++;
+            live--;
+        }
+    }
+
+    bool contains(const string& element) const {
+        auto it = lengths.find(element);
+        return it != lengths.end() && it->second % 2 == 1;
+    }
+
+    set<string> elements() const {
+        set<string> result;
+        for (const auto &entry : lengths) {
+            if (entry.second % 2 == 1) result.insert(entry.first);
+        }
+        return result;
+    }
+
+    void merge(const CLSet& other) {
+        for (const auto &entry : other.lengths) {
+            uint64_t& length = lengths[entry.first];
+            if (entry.second > length) {
+                if (length % 2 == 1) live--;
+                if (entry.second % 2 == 1) live++;
+                length = entry.second;
+            }
+        }
+    }
+
+    uint64_t length(const string& element) const {
+        auto it = lengths.find(element);
+        return it == lengths.end() ? 0 : it->second;
+    }
+
+    // Additional methods for benchmarking
+    size_t size() const { return live; }
+    size_t internal_size() const { return lengths.size(); }
+};
+
+#endif
@@ -3,6 +3,7 @@
 #define CRDT_H
 
 #include <bits/stdc++.h>
+#include "hll.h"
 
 using namespace std;
 
@@ -18,50 +19,448 @@ struct Tag {
     }
 };
 
+// Hashes that go over the wire (digests, sketches), so they must not depend
+// on the standard library's hash<string>.
+inline uint64_t fnv1a(string_view data, uint64_t hash = 14695981039346656037ULL) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// splitmix64 finalizer, spreads nearby inputs (counters) over all bits
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline uint64_t pair_hash(const string& element, const Tag& tag) {
+    return mix64(fnv1a(tag.replica_id, fnv1a(element) ^ 0xff) ^ mix64(tag.counter));
+}
+
+// Causal context: every dot (Tag) a replica has ever observed, whether it is
+// still live or was removed since. A contiguous prefix per replica is kept as
+// a version vector; dots that arrive out of order wait in the dot cloud until
+// the gap closes.
+struct CausalContext {
+    map<string, uint64_t> vv;
+    set<Tag> cloud;
+
+    bool contains(const Tag& tag) const {
+        auto it = vv.find(tag.replica_id);
+        if (it != vv.end() && tag.counter <= it->second) {
+            return true;
+        }
+        return cloud.count(tag) > 0;
+    }
+
+    uint64_t max_counter(const string& id) const {
+        uint64_t result = 0;
+        auto it = vv.find(id);
+        if (it != vv.end()) {
+            result = it->second;
+        }
+        auto cit = cloud.lower_bound(Tag{id, numeric_limits<uint64_t>::max()});
+        if (cit != cloud.begin() && prev(cit)->replica_id == id) {
+            result = max(result, prev(cit)->counter);
+        }
+        return result;
+    }
+
+    void insert(const Tag& tag) {
+        if (contains(tag)) return;
+        uint64_t& known = vv[tag.replica_id];
+        if (tag.counter == known + 1) {
+            known = tag.counter;
+            compact();
+        } else {
+            if (known == 0) vv.erase(tag.replica_id);
+            cloud.insert(tag);
+        }
+    }
+
+    void merge(const CausalContext& other) {
+        for (const auto &entry : other.vv) {
+            uint64_t& known = vv[entry.first];
+            known = max(known, entry.second);
+        }
+        cloud.insert(other.cloud.begin(), other.cloud.end());
+        compact();
+    }
+
+    // fold cloud dots that became contiguous into the version vector
+    void compact() {
+        for (auto it = cloud.begin(); it != cloud.end();) {
+            auto vit = vv.find(it->replica_id);
+            uint64_t known = vit == vv.end() ? 0 : vit->second;
+            if (it->counter <= known) {
+                it = cloud.erase(it);
+            } else if (it->counter == known + 1) {
+                vv[it->replica_id] = it->counter;
+                it = cloud.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+// What every replica has delivered, as reported through acknowledgements,
+// and the causally stable prefix derived from it: ops every replica has
+// delivered, so that any op delivered from now on causally follows them.
+//
+// The replicas of the group are declared with add_member(); a replica that
+// has not spoken yet cannot be seen any other way. Until members are
+// declared nothing is stable.
+class StabilityTracker {
+  private:
+    string self;
+    set<string> members;                           // declared group, self included
+    map<string, map<string, uint64_t>> acks;       // replica -> ops it has delivered
+    map<string, map<string, uint64_t>> early_acks; // acks ahead of the acker's ops here
+
+  public:
+    StabilityTracker(const string& id) : self(id) {}
+
+    void add_member(const string& id) {
+        members.insert(self);
+        members.insert(id);
+    }
+
+    const set<string>& group() const { return members; }
+
+    // An ack is only usable once the acker's own ops up to that ack were
+    // delivered locally; otherwise ops it issued concurrently with the acked
+    // ones could still be in flight. Early acks wait until then.
+    void acknowledge(const string& replica, const map<string, uint64_t>& delivered,
+                     const CausalContext& local) {
+        auto own = delivered.find(replica);
+        bool usable = own == delivered.end() || local.max_counter(replica) >= own->second;
+        auto &known = usable ? acks[replica] : early_acks[replica];
+        for (const auto &entry : delivered) {
+            known[entry.first] = max(known[entry.first], entry.second);
+        }
+    }
+
+    // Acks are facts about other replicas, so they pass on through merges
+    void merge(const StabilityTracker& other, const CausalContext& local) {
+        for (const auto &entry : other.acks) {
+            if (entry.first != self) acknowledge(entry.first, entry.second, local);
+        }
+        for (const auto &entry : other.early_acks) {
+            if (entry.first != self) acknowledge(entry.first, entry.second, local);
+        }
+    }
+
+    // Pointwise minimum of what every replica has delivered: the declared
+    // members, plus any replica that acknowledged or issued an op delivered
+    // here without being declared. One that has not acknowledged yet holds
+    // stability at zero.
+    map<string, uint64_t> stable_vv(const CausalContext& local) const {
+        if (members.empty()) return {};
+        set<string> known = members;
+        for (const auto &entry : acks) known.insert(entry.first);
+        for (const auto &entry : early_acks) known.insert(entry.first);
+        for (const auto &entry : local.vv) known.insert(entry.first);
+
+        map<string, uint64_t> stable = local.vv;
+        for (const auto &member : known) {
+            if (member == self) continue;
+            map<string, uint64_t> acked;
+            auto ait = acks.find(member);
+            if (ait != acks.end()) acked = ait->second;
+            auto eit = early_acks.find(member);
+            if (eit != early_acks.end() && local.max_counter(member) >= eit->second.at(member)) {
+                for (const auto &entry : eit->second) {
+                    acked[entry.first] = max(acked[entry.first], entry.second);
+                }
+            }
+            for (auto &entry : stable) {
+                auto it = acked.find(entry.first);
+                entry.second = min(entry.second, it == acked.end() ? 0 : it->second);
+            }
+        }
+        return stable;
+    }
+};
+
+// Operation shipped between replicas in op-based mode. Every op carries its
+// own dot, so delivery can be deduplicated and acknowledged per origin, plus
+// the origin's version vector when it was issued (its causal dependencies).
+struct ORSetOp {
+    enum Kind { Add, Remove } kind;
+    string element;
+    Tag tag;                    // dot of this op
+    vector<Tag> removed;        // tags of element this op observed and removes
+    map<string, uint64_t> deps; // origin's delivered ops at issue time
+};
+
 class ORSet {
+    friend struct ORSetCodec;
+    friend class DeltaAccumulator;
+    friend class FrozenORSet;
+
   private:
     string replica_id;
     uint64_t local_counter;
     set<pair<string, Tag>> internal_set;
+    uint64_t pair_sum = 0; // sum of pair_hash() over internal_set, see fingerprint()
     unordered_set<string> element_cache; // cache for O(1) contains check
+    CausalContext context; // every dot observed, live or removed
 
-  public:
-    ORSet(const string& id) : replica_id(id), local_counter(0) {}
+    // Remove dots with the element and the tags they removed, kept until
+    // stable so missing_for() can tell peers about them. Entries up to the
+    // floor may have been pruned.
+    struct RemovedTags {
+        string element;
+        vector<Tag> tags;
+    };
+    map<Tag, RemovedTags> remove_log;
+    map<string, uint64_t> remove_log_floor;
+    size_t remove_log_limit = 64; // size that triggers the next prune
 
-    void add(const string& element) {
-        local_counter++;
-        Tag tag{replica_id, local_counter};
-        internal_set.insert({element, tag});
+    // optional sketch of every element ever present, see enable_sketch()
+    optional<HyperLogLog> sketch;
+
+    // op-based mode, see add_op()/deliver()
+    vector<ORSetOp> op_log;         // ops issued here, kept until stable
+    vector<ORSetOp> pending_ops;    // received, waiting for their dependencies
+    StabilityTracker stability;
+
+    bool has_element(const string& element) const {
+        auto it = internal_set.lower_bound({element, Tag{"", 0}});
+        return it != internal_set.end() && it->first == element;
+    }
+
+    // Every change to internal_set goes through these, so pair_sum follows it
+    using PairIterator = set<pair<string, Tag>>::iterator;
+
+    PairIterator insert_pair(PairIterator hint, const pair<string, Tag>& pair) {
+        size_t before = internal_set.size();
+        auto it = internal_set.insert(hint, pair);
+        if (internal_set.size() != before) pair_sum += pair_hash(pair.first, pair.second);
+        return it;
+    }
+
+    PairIterator erase_pair(PairIterator it) {
+        pair_sum -= pair_hash(it->first, it->second);
+        return internal_set.erase(it);
+    }
+
+    void erase_pairs(PairIterator first, PairIterator last) {
+        while (first != last) first = erase_pair(first);
+    }
+
+    void erase_pair(const string& element, const Tag& tag) {
+        auto it = internal_set.find({element, tag});
+        if (it != internal_set.end()) erase_pair(it);
+    }
+
+    void note_added(const string& element) {
+        if (sketch) sketch->add_hash(mix64(fnv1a(element)));
+    }
+
+    // [first, last) of element's pairs, optionally only those from one replica
+    pair<set<pair<string, Tag>>::iterator, set<pair<string, Tag>>::iterator>
+    tag_range(const string& element, const string* only_replica = nullptr) {
+        auto first = internal_set.lower_bound({element, Tag{only_replica ? *only_replica : "", 0}});
+        auto last = first;
+        while (last != internal_set.end() && last->first == element &&
+               (!only_replica || last->second.replica_id == *only_replica)) {
+            ++last;
+        }
+        return {first, last};
+    }
+
+    // local effect of add(); returns the superseded tags
+    vector<Tag> add_local(const string& element, const Tag& tag) {
+        // The new dot supersedes every earlier dot this replica issued for
+        // element: they are all in the causal context, so dropping them is an
+        // observed remove. Hot keys keep at most one tag per replica.
+        auto range = tag_range(element, &tag.replica_id);
+        vector<Tag> superseded;
+        for (auto it = range.first; it != range.second; ++it) superseded.push_back(it->second);
+        erase_pairs(range.first, range.second);
+        insert_pair(range.second, {element, tag});
+        context.insert(tag);
         element_cache.insert(element); // update the cache
-        // Broadcast "add element with tag" to other replicas
+        note_added(element);
+        return superseded;
     }
 
-    void remove(const string& element) {
-        set<Tag> tags_to_remove;
-        for (const auto &pair : internal_set) {
-            if(pair.first == element) {
-                tags_to_remove.insert(pair.second);
+    // local effect of remove(); returns the observed tags
+    vector<Tag> remove_local(const string& element) {
+        // pairs are ordered by element first, so all tags of element are adjacent
+        auto range = tag_range(element);
+        vector<Tag> observed;
+        for (auto it = range.first; it != range.second; ++it) observed.push_back(it->second);
+        // the removed tags stay in the causal context, which is what lets
+        // merge tell "removed here" apart from "not seen here yet"
+        erase_pairs(range.first, range.second);
+        element_cache.erase(element); // update cache
+        return observed;
+    }
+
+    // local effect of remove(): the dot it took and the tags it removed,
+    // or no tags if there was nothing to remove
+    pair<Tag, vector<Tag>> remove_logged(const string& element) {
+        vector<Tag> observed = remove_local(element);
+        if (observed.empty()) return {};
+        // The remove takes a dot of its own, so a peer's summary shows
+        // whether it has seen it; see missing_for()
+        local_counter++;
+        Tag dot{replica_id, local_counter};
+        context.insert(dot);
+        log_removal(dot, element, observed);
+        return {dot, move(observed)};
+    }
+
+    // joins "these tags of element are gone" into a delta
+    void join_removed(const string& element, const vector<Tag>& removed) {
+        for (const auto &tag : removed) {
+            erase_pair(element, tag);
+            context.insert(tag);
+        }
+        if (!removed.empty() && !has_element(element)) element_cache.erase(element); // update cache
+    }
+
+    void log_removal(const Tag& dot, const string& element, vector<Tag> removed) {
+        if (removed.empty()) return;
+        remove_log.emplace(dot, RemovedTags{element, move(removed)});
+        if (remove_log.size() >= remove_log_limit) prune_remove_log();
+    }
+
+    // drops stable entries; every member of the group has seen them
+    void prune_remove_log() {
+        map<string, uint64_t> stable = stable_vv();
+        for (auto it = remove_log.begin(); it != remove_log.end();) {
+            auto sit = stable.find(it->first.replica_id);
+            if (sit == stable.end() || it->first.counter > sit->second) {
+                ++it;
+                continue;
             }
+            uint64_t& floor = remove_log_floor[it->first.replica_id];
+            floor = max(floor, it->first.counter);
+            it = remove_log.erase(it);
         }
+        remove_log_limit = max<size_t>(64, remove_log.size() * 2);
+    }
 
-        for (const auto &tag : tags_to_remove) {
-            internal_set.erase({element, tag});
+    // A partial state for a peer: the pairs `ship` selects, the full causal
+    // context and the logged removes the peer has not seen, so it can
+    // forward them
+    template <typename Ship>
+    ORSet delta_with(const map<string, uint64_t>& peer_vv, Ship ship) const {
+        ORSet delta(replica_id);
+        delta.local_counter = local_counter;
+        delta.context = context;
+        delta.remove_log_floor = remove_log_floor;
+        for (const auto &pair : internal_set) {
+            if (!ship(pair)) continue;
+            delta.insert_pair(delta.internal_set.end(), pair);
+            delta.element_cache.insert(pair.first);
+        }
+        for (const auto &entry : remove_log) {
+            auto it = peer_vv.find(entry.first.replica_id);
+            if (it == peer_vv.end() || it->second < entry.first.counter) delta.remove_log.insert(entry);
         }
+        return delta;
+    }
 
-        // check if element still exists after removal
-        bool still_exists = false;
+    // Merges a delta_with() answer as the sender's full state, our pairs
+    // that `common` selects standing in for the ones it did not ship
+    template <typename Common>
+    void merge_filled(const ORSet& delta, Common common) {
+        ORSet filled = delta;
         for (const auto &pair : internal_set) {
-            if(pair.first == element) {
-                still_exists = true;
-                break;
+            if (!common(pair)) continue;
+            filled.insert_pair(filled.internal_set.end(), pair);
+            filled.element_cache.insert(pair.first);
+        }
+        merge(filled);
+    }
+
+    bool causally_ready(const ORSetOp& op) const {
+        for (const auto &dep : op.deps) {
+            if (dep.first != op.tag.replica_id && context.max_counter(dep.first) < dep.second) {
+                return false;
             }
         }
-        if (!still_exists) {
-            element_cache.erase(element); // update cache
+        return context.max_counter(op.tag.replica_id) + 1 == op.tag.counter;
+    }
+
+    void apply(const ORSetOp& op) {
+        for (const auto &tag : op.removed) {
+            erase_pair(op.element, tag);
+        }
+        if (op.kind == ORSetOp::Add) {
+            insert_pair(internal_set.end(), {op.element, op.tag});
+            element_cache.insert(op.element); // update the cache
+            note_added(op.element);
+        } else {
+            if (!has_element(op.element)) element_cache.erase(op.element); // update cache
+            log_removal(op.tag, op.element, op.removed);
         }
+        context.insert(op.tag);
+    }
+
+  public:
+    ORSet(const string& id) : replica_id(id), local_counter(0), stability(id) {}
+
+    void add(const string& element) {
+        local_counter++;
+        add_local(element, Tag{replica_id, local_counter});
+        // Broadcast "add element with tag" to other replicas
+    }
+
+    void remove(const string& element) {
+        remove_logged(element);
         // Broadcast "remove element with tags_to_remove" to other replicas
     }
 
+    // ============= DELTA MUTATORS =============
+    //
+    // add()/remove() that also join their delta into `delta`: the smallest
+    // state whose merge has the same effect on a peer. Joining many of them
+    // into one ORSet and shipping that replaces shipping the full state.
+    //
+    // Any type with join_add()/join_remove() can collect the deltas; ORSet
+    // itself is one, DeltaAccumulator (delta_accumulator.h) a more compact one.
+
+    template <typename Delta>
+    void add(const string& element, Delta& delta) {
+        local_counter++;
+        Tag tag{replica_id, local_counter};
+        vector<Tag> superseded = add_local(element, tag);
+        delta.join_add(element, tag, superseded);
+    }
+
+    template <typename Delta>
+    void remove(const string& element, Delta& delta) {
+        auto removed = remove_logged(element);
+        if (removed.second.empty()) return;
+        delta.join_remove(element, removed.first, move(removed.second));
+    }
+
+    // delta of add(): tag added for element, superseding older tags
+    void join_add(const string& element, const Tag& tag, const vector<Tag>& superseded) {
+        join_removed(element, superseded);
+        insert_pair(internal_set.end(), {element, tag});
+        element_cache.insert(element); // update the cache
+        note_added(element);
+        context.insert(tag);
+    }
+
+    // delta of remove(): the remove took dot and removed tags of element
+    void join_remove(const string& element, const Tag& dot, vector<Tag> removed) {
+        join_removed(element, removed);
+        context.insert(dot);
+        remove_log.emplace(dot, RemovedTags{element, move(removed)});
+    }
+
     bool contains(const string& element) const {
         return element_cache.count(element) > 0; // O(1) lookup
     }
@@ -70,15 +469,461 @@ class ORSet {
         return set<string>(element_cache.begin(), element_cache.end());
     }
 
+    // Keeps a pair if both sides have it, or if the side lacking it has never
+    // observed its tag. A pair missing from one side whose tag that side has
+    // seen was removed there, so it is dropped. Both internal sets share the
+    // same order, so this is a single linear merge-join.
+    //
+    // Tags of one element from one replica are adjacent and ordered by
+    // counter; if both survive, the newer one was issued by an add() that had
+    // already dropped the older, so only the newest is kept. For the same
+    // reason a remove in other's log of a newer tag from that replica drops
+    // the older one, which matters when other is a delta from missing_for().
     void merge(const ORSet& other) {
-        internal_set.insert(other.internal_set.begin(), other.internal_set.end());
-        element_cache.insert(other.element_cache.begin(), other.element_cache.end()); // update the cache
+        join_delta(other);
+        // other has seen everything in its version vector, and passes on
+        // what it heard from the rest
+        stability.acknowledge(other.replica_id, other.context.vv, context);
+        stability.merge(other.stability, context);
+        if (remove_log.size() >= remove_log_limit) prune_remove_log();
+    }
+
+    // merge() of several replicas' deltas joined into one: a single pass
+    // over this state, then each sender's summary acknowledged
+    void merge_joined(const ORSet& joined, const vector<pair<string, map<string, uint64_t>>>& senders) {
+        join_delta(joined);
+        for (const auto &sender : senders) stability.acknowledge(sender.first, sender.second, context);
+        if (remove_log.size() >= remove_log_limit) prune_remove_log();
+    }
+
+    // merge() as a plain join: no acknowledgement and no pruning, for
+    // accumulating deltas that are not a replica's state
+    void join_delta(const ORSet& other) {
+        // newest removed counter per element and replica among removes new here
+        map<string, map<string, uint64_t>> removed_upto;
+        for (const auto &entry : other.remove_log) {
+            if (context.contains(entry.first)) continue;
+            for (const auto &tag : entry.second.tags) {
+                uint64_t& upto = removed_upto[entry.second.element][tag.replica_id];
+                upto = max(upto, tag.counter);
+            }
+        }
+        // asked in pair order, so a cursor replaces the lookups
+        auto removed_cursor = removed_upto.begin();
+        auto removed_by_other = [&](const pair<string, Tag>& pair) {
+            while (removed_cursor != removed_upto.end() && removed_cursor->first < pair.first) ++removed_cursor;
+            if (removed_cursor == removed_upto.end() || removed_cursor->first != pair.first) return false;
+            auto rit = removed_cursor->second.find(pair.second.replica_id);
+            return rit != removed_cursor->second.end() && pair.second.counter < rit->second;
+        };
+
+        vector<string> touched; // elements that lost a pair
+        auto last_kept = internal_set.end();
+        auto keep = [&](set<pair<string, Tag>>::iterator kept) {
+            if (last_kept != internal_set.end() && last_kept->first == kept->first &&
+                last_kept->second.replica_id == kept->second.replica_id) {
+                erase_pair(last_kept);
+            }
+            last_kept = kept;
+        };
+
+        auto it = internal_set.begin();
+        auto oit = other.internal_set.begin();
+        while (it != internal_set.end() || oit != other.internal_set.end()) {
+            if (oit == other.internal_set.end() || (it != internal_set.end() && *it < *oit)) {
+                if (other.context.contains(it->second) || removed_by_other(*it)) {
+                    touched.push_back(it->first);
+                    it = erase_pair(it);
+                } else {
+                    keep(it++);
+                }
+            } else if (it == internal_set.end() || *oit < *it) {
+                if (!context.contains(oit->second)) {
+                    keep(insert_pair(it, *oit));
+                    element_cache.insert(oit->first); // update the cache
+                    note_added(oit->first);
+                }
+                ++oit;
+            } else {
+                keep(it++);
+                ++oit;
+            }
+        }
+        for (const auto &element : touched) {
+            if (!has_element(element)) {
+                element_cache.erase(element); // update cache
+            }
+        }
+        // keep forwarding the removes other knows about; the ones already
+        // seen here are logged or below the floor already
+        if (!removed_upto.empty()) {
+            for (const auto &entry : other.remove_log) {
+                if (!context.contains(entry.first)) remove_log.insert(entry);
+            }
+        }
+        if (sketch && other.sketch) sketch->merge_folding(*other.sketch);
+        context.merge(other.context);
+        // never reuse a dot this replica already issued elsewhere
+        local_counter = max(local_counter, context.max_counter(replica_id));
+        for (const auto &entry : other.remove_log_floor) {
+            uint64_t& floor = remove_log_floor[entry.first];
+            floor = max(floor, entry.second);
+        }
+    }
+
+    // ============= SUMMARIES =============
+    //
+    // A replica's summary is its version vector. Every add and every remove
+    // that removed something takes a dot, so a peer's summary tells exactly
+    // which of them it has not seen, and missing_for() ships only those.
+    // Re-adds need no entry: a newer tag of the same element and replica
+    // supersedes the older ones wherever it, or its remove, arrives.
+    // Removes stay in the remove log until every member of the group has seen
+    // them; a peer that is behind the pruned part gets the full state.
+
+    const map<string, uint64_t>& summary() const { return context.vv; }
+
+    // Delta for a peer whose summary is peer_vv: the pairs whose tags the peer
+    // has not seen, the dots of the context it has not seen, and for every
+    // remove it has not seen, the removed tags. Merging the delta into the
+    // peer gives the same result as merging the full state.
+    ORSet missing_for(const map<string, uint64_t>& peer_vv) const {
+        auto seen = [&](const Tag& tag) {
+            auto it = peer_vv.find(tag.replica_id);
+            return it != peer_vv.end() && tag.counter <= it->second;
+        };
+
+        ORSet delta(replica_id);
+        delta.local_counter = local_counter;
+        for (const auto &entry : remove_log_floor) {
+            auto it = peer_vv.find(entry.first);
+            if (it == peer_vv.end() || it->second < entry.second) {
+                delta.internal_set = internal_set;
+                delta.pair_sum = pair_sum;
+                delta.element_cache = element_cache;
+                delta.context = context;
+                delta.remove_log = remove_log;
+                delta.remove_log_floor = remove_log_floor;
+                return delta;
+            }
+        }
+        for (const auto &pair : internal_set) {
+            if (seen(pair.second)) continue;
+            delta.insert_pair(delta.internal_set.end(), pair);
+            delta.element_cache.insert(pair.first);
+        }
+        for (const auto &entry : context.vv) {
+            auto it = peer_vv.find(entry.first);
+            uint64_t from = it == peer_vv.end() ? 0 : it->second;
+            if (from == 0) {
+                delta.context.vv[entry.first] = entry.second;
+                continue;
+            }
+            for (uint64_t counter = from + 1; counter <= entry.second; counter++) {
+                delta.context.cloud.insert(Tag{entry.first, counter});
+            }
+        }
+        for (const auto &tag : context.cloud) {
+            if (!seen(tag)) delta.context.cloud.insert(tag);
+        }
+        for (const auto &entry : remove_log) {
+            if (seen(entry.first)) continue;
+            delta.remove_log.insert(entry);
+            for (const auto &tag : entry.second.tags) delta.context.insert(tag);
+        }
+        return delta;
+    }
+
+    // What a peer whose summary is peer_vv lacks, counted without building
+    // the delta. Behind the floor the pruned removes are unknown, so their
+    // dots count as touched elements (an upper bound).
+    struct Divergence {
+        uint64_t dots = 0;       // dots the peer has not seen
+        size_t pairs = 0;        // live pairs with those dots
+        size_t removes = 0;      // logged removes among them
+        size_t elements = 0;     // distinct elements those touch
+        bool behind_floor = false;
+    };
+
+    Divergence divergence_from(const map<string, uint64_t>& peer_vv) const {
+        auto peer_max = [&](const string& id) {
+            auto it = peer_vv.find(id);
+            return it == peer_vv.end() ? 0 : it->second;
+        };
+        auto seen = [&](const Tag& tag) { return tag.counter <= peer_max(tag.replica_id); };
+
+        Divergence result;
+        for (const auto &entry : context.vv) {
+            result.dots += entry.second - min(entry.second, peer_max(entry.first));
+        }
+        for (const auto &tag : context.cloud) result.dots += !seen(tag);
+
+        unordered_set<uint64_t> touched;
+        for (const auto &pair : internal_set) {
+            if (seen(pair.second)) continue;
+            result.pairs++;
+            touched.insert(fnv1a(pair.first));
+        }
+        for (const auto &entry : remove_log) {
+            if (seen(entry.first)) continue;
+            result.removes++;
+            touched.insert(fnv1a(entry.second.element));
+        }
+        result.elements = touched.size();
+        for (const auto &entry : remove_log_floor) {
+            uint64_t known = peer_max(entry.first);
+            if (known >= entry.second) continue;
+            result.behind_floor = true;
+            result.elements += entry.second - known;
+        }
+        result.elements = min<uint64_t>(result.elements, result.dots);
+        return result;
+    }
+
+    // ============= DIGESTS =============
+    //
+    // A digest splits the pairs into buckets by element hash and sums a hash
+    // of each pair per bucket; equal sums mean the bucket holds the same
+    // pairs on both sides. A peer sends its digest, digest_delta() answers
+    // with the pairs of the buckets that differ, and merge_buckets() joins
+    // that as if the full state had been shipped. Unlike missing_for() this
+    // works for a peer behind the remove log floor.
+
+    static size_t bucket_of(const string& element, size_t buckets) { return fnv1a(element) % buckets; }
+
+    vector<uint64_t> bucket_digest(size_t buckets) const {
+        vector<uint64_t> digest(buckets, 0);
+        for (const auto &pair : internal_set) {
+            digest[bucket_of(pair.first, buckets)] += pair_hash(pair.first, pair.second);
+        }
+        return digest;
+    }
+
+    // The pairs of the buckets where peer_digest differs (listed in
+    // `differing`), the full causal context, and the logged removes the peer
+    // has not seen, so it can forward them.
+    ORSet digest_delta(const map<string, uint64_t>& peer_vv, const vector<uint64_t>& peer_digest,
+                       vector<uint32_t>& differing) const {
+        vector<uint64_t> digest = bucket_digest(peer_digest.size());
+        vector<bool> shipped(digest.size(), false);
+        differing.clear();
+        for (size_t b = 0; b < digest.size(); b++) {
+            if (digest[b] == peer_digest[b]) continue;
+            differing.push_back(b);
+            shipped[b] = true;
+        }
+        return delta_with(peer_vv, [&](const pair<string, Tag>& pair) {
+            return shipped[bucket_of(pair.first, digest.size())];
+        });
+    }
+
+    // Merges a digest_delta() answer: pairs of the buckets that matched are
+    // the same on both sides, so ours stand in for the ones not shipped.
+    void merge_buckets(const ORSet& delta, size_t buckets, const vector<uint32_t>& differing) {
+        vector<bool> shipped(buckets, false);
+        for (uint32_t b : differing) shipped.at(b) = true;
+        merge_filled(delta, [&](const pair<string, Tag>& pair) { return !shipped[bucket_of(pair.first, buckets)]; });
+    }
+
+    // ============= PAIR DIFFERENCES =============
+    //
+    // Set reconciliation on pair hashes (see iblt.h): once the hashes of the
+    // pairs only one side holds are known, pairs_delta() ships ours and
+    // merge_pairs() joins them, the rest of the pairs being common.
+
+    vector<uint64_t> pair_hashes() const {
+        vector<uint64_t> hashes;
+        hashes.reserve(internal_set.size());
+        for (const auto &pair : internal_set) hashes.push_back(pair_hash(pair.first, pair.second));
+        return hashes;
+    }
+
+    // The pairs whose hashes are in `only_here`, the full causal context and
+    // the logged removes the peer has not seen
+    ORSet pairs_delta(const map<string, uint64_t>& peer_vv, const unordered_set<uint64_t>& only_here) const {
+        return delta_with(peer_vv, [&](const pair<string, Tag>& pair) {
+            return only_here.count(pair_hash(pair.first, pair.second)) > 0;
+        });
+    }
+
+    // Merges a pairs_delta() answer; `only_here` are the hashes of our pairs
+    // the sender lacks, every other pair of ours it holds too
+    void merge_pairs(const ORSet& delta, const unordered_set<uint64_t>& only_here) {
+        merge_filled(delta, [&](const pair<string, Tag>& pair) {
+            return !only_here.count(pair_hash(pair.first, pair.second));
+        });
+    }
+
+    // ============= FINGERPRINT =============
+    //
+    // Sum of pair_hash() over the pairs, kept up to date by every mutation.
+    // A sum does not depend on the order pairs arrived in, so replicas with
+    // the same pairs have the same fingerprint however they got there; it
+    // equals the sum of any bucket_digest(). It says nothing about the dot
+    // cloud or the remove log, which can differ between replicas with the
+    // same pairs and the same summary.
+
+    uint64_t fingerprint() const { return pair_sum; }
+
+    // fingerprint() with the dot cloud, the remove log (a remove is known by
+    // its dot) and the remove log floor folded in. Equal state fingerprints
+    // and equal summaries mean a sync would change nothing but
+    // acknowledgements and sketches, up to a 64-bit collision. The pairs
+    // part is O(1), the rest O(cloud + remove log).
+    uint64_t state_fingerprint() const {
+        uint64_t cloud_sum = 0, removes_sum = 0, floor_sum = 0;
+        for (const auto &tag : context.cloud) cloud_sum += mix64(fnv1a(tag.replica_id) ^ mix64(tag.counter));
+        for (const auto &entry : remove_log) {
+            removes_sum += mix64(fnv1a(entry.first.replica_id) ^ mix64(entry.first.counter));
+        }
+        for (const auto &entry : remove_log_floor) floor_sum += mix64(fnv1a(entry.first) ^ mix64(entry.second));
+        return mix64(mix64(mix64(pair_sum ^ cloud_sum) ^ removes_sum) ^ floor_sum);
+    }
+
+    // ============= CARDINALITY SKETCH =============
+    //
+    // Optional HyperLogLog of every element that was ever present here,
+    // added locally or merged in. Removes do not shrink it, so it estimates
+    // how many distinct elements a set of replicas has seen; merging the
+    // sketches of many sets estimates their union without their elements.
+    // Sketches of merged states are merged too; if their precisions differ,
+    // the merged sketch takes the coarser one.
+
+    // Starts the sketch, seeded with the current elements
+    void enable_sketch(uint8_t precision = 12) {
+        if (sketch) return;
+        sketch.emplace(precision);
+        for (const auto &element : element_cache) note_added(element);
+    }
+
+    const optional<HyperLogLog>& cardinality_sketch() const { return sketch; }
+
+    // ============= OP-BASED MODE =============
+    //
+    // add_op()/remove_op() apply locally and return the op to broadcast;
+    // deliver() applies a remote op once everything it depends on has been
+    // delivered. Replicas report what they have delivered (delivered_vv())
+    // to each other through acknowledge(). An op every replica has delivered
+    // is causally stable: it is dropped from the retransmission log, and the
+    // stable tags of an element collapse into one.
+
+    ORSetOp add_op(const string& element) {
+        ORSetOp op{ORSetOp::Add, element, Tag{replica_id, local_counter + 1}, {}, context.vv};
+        local_counter++;
+        op.removed = add_local(element, op.tag);
+        op_log.push_back(op);
+        return op;
+    }
+
+    ORSetOp remove_op(const string& element) {
+        // a remove takes a dot too, so every op is ordered and acknowledged
+        ORSetOp op{ORSetOp::Remove, element, Tag{replica_id, local_counter + 1}, {}, context.vv};
+        local_counter++;
+        op.removed = remove_local(element);
+        context.insert(op.tag);
+        log_removal(op.tag, op.element, op.removed);
+        op_log.push_back(op);
+        return op;
+    }
+
+    // Applies op, or buffers it until its dependencies arrive. Duplicates are
+    // ignored. Returns the number of ops applied, including buffered ones it
+    // unblocked.
+    size_t deliver(const ORSetOp& op) {
+        if (context.contains(op.tag)) return 0;
+        if (!causally_ready(op)) {
+            pending_ops.push_back(op);
+            return 0;
+        }
+        apply(op);
+        size_t applied = 1;
+        for (bool progress = true; progress;) {
+            progress = false;
+            for (size_t i = 0; i < pending_ops.size(); i++) {
+                if (context.contains(pending_ops[i].tag)) {
+                    pending_ops.erase(pending_ops.begin() + i--);
+                } else if (causally_ready(pending_ops[i])) {
+                    ORSetOp ready = move(pending_ops[i]);
+                    pending_ops.erase(pending_ops.begin() + i--);
+                    apply(ready);
+                    applied++;
+                    progress = true;
+                }
+            }
+        }
+        local_counter = max(local_counter, context.max_counter(replica_id));
+        return applied;
+    }
+
+    // Ops this replica issued that a peer which has delivered `peer_vv` lacks
+    vector<ORSetOp> ops_since(const map<string, uint64_t>& peer_vv) const {
+        auto it = peer_vv.find(replica_id);
+        uint64_t seen = it == peer_vv.end() ? 0 : it->second;
+        vector<ORSetOp> missing;
+        for (const auto &op : op_log) {
+            if (op.tag.counter > seen) missing.push_back(op);
+        }
+        return missing;
+    }
+
+    const map<string, uint64_t>& delivered_vv() const { return context.vv; }
+
+    void acknowledge(const string& replica, const map<string, uint64_t>& delivered) {
+        stability.acknowledge(replica, delivered, context);
     }
 
+    // Declares a replica of the group; see StabilityTracker
+    void add_member(const string& replica) { stability.add_member(replica); }
+    const set<string>& members() const { return stability.group(); }
+
+    map<string, uint64_t> stable_vv() const { return stability.stable_vv(context); }
+
+    // Drops stable ops from the retransmission log, stable removes from the
+    // remove log, and collapses each
+    // element's stable tags into one. Every later remove of the element
+    // observes either all of them or none, so one representative behaves the
+    // same; the largest tag is kept so all replicas pick the same one.
+    // Returns the number of log entries and pairs freed.
+    size_t compact_stable() {
+        map<string, uint64_t> stable = stable_vv();
+        auto is_stable = [&](const Tag& tag) {
+            auto it = stable.find(tag.replica_id);
+            return it != stable.end() && tag.counter <= it->second;
+        };
+
+        size_t freed = op_log.size() + remove_log.size();
+        op_log.erase(std::remove_if(op_log.begin(), op_log.end(),
+                                    [&](const ORSetOp& op) { return is_stable(op.tag); }),
+                     op_log.end());
+        prune_remove_log();
+        freed -= op_log.size() + remove_log.size();
+
+        for (auto it = internal_set.begin(); it != internal_set.end();) {
+            string element = it->first;
+            auto previous_stable = internal_set.end();
+            for (; it != internal_set.end() && it->first == element; ++it) {
+                if (!is_stable(it->second)) continue;
+                // tags are ascending, so the stable tag found last is the largest
+                if (previous_stable != internal_set.end()) {
+                    erase_pair(previous_stable);
+                    freed++;
+                }
+                previous_stable = it;
+            }
+        }
+        return freed;
+    }
+
+    size_t pending_op_count() const { return pending_ops.size(); }
+    size_t logged_op_count() const { return op_log.size(); }
+    size_t logged_remove_count() const { return remove_log.size(); }
+
     // Additional methods for benchmarking
     size_t size() const { return element_cache.size(); }
     size_t internal_size() const { return internal_set.size(); }
     uint64_t get_counter() const { return local_counter; }
+    const string& get_replica_id() const { return replica_id; }
+    const CausalContext& causal_context() const { return context; }
 };
 
 #endif
\ No newline at end of file
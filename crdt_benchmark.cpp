@@ -1,11 +1,50 @@
 // crdt_benchmark.cpp - Comprehensive testing and benchmarking for OR-Set CRDT
 
 #include "crdt.h"
+#include "ormap.h"
+#include "ormap_codec.h"
+#include "clset.h"
+#include "orset_backends.h"
+#include "orset_codec.h"
+#include "pure_orset.h"
+#include "delta_buffer.h"
+#include "sync_planner.h"
+#include "iblt.h"
+#include "replication.h"
+#include "orset_store.h"
+#include "ingest_pipeline.h"
+#include "stream_vbyte.h"
+#include "frozen_orset.h"
+#if defined(__cpp_impl_coroutine)
+#include "async_replication.h"
+#endif
 #include <chrono>
+#include <malloc.h>
 
 using namespace std;
 using namespace std::chrono;
 
+// ============= ALLOCATION TRACKING =============
+
+// Live heap bytes, counted by replacing the global allocation functions, so
+// memory comparisons measure what each backend really allocates.
+static atomic<size_t> live_heap_bytes{0};
+
+void* operator new(size_t n) {
+    void* p = malloc(n ? n : 1);
+    if (!p) throw bad_alloc();
+    live_heap_bytes.fetch_add(malloc_usable_size(p), memory_order_relaxed);
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    live_heap_bytes.fetch_sub(malloc_usable_size(p), memory_order_relaxed);
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
 // ============= TEST SUITE =============
 
 class TestRunner {
@@ -24,6 +63,8 @@ public:
         }
     }
 
+    int failures() const { return failed; }
+
     void print_summary() {
         cout << "\n========== TEST SUMMARY ==========\n";
         cout << "Passed: " << passed << endl;
@@ -33,10 +74,11 @@ public:
     }
 };
 
-void test_basic_operations(TestRunner& runner) {
-    cout << "\n=== Basic Operations Tests ===\n";
+template <typename Set>
+void test_basic_operations(TestRunner& runner, const string& backend) {
+    cout << "\n=== Basic Operations Tests [" << backend << "] ===\n";
 
-    ORSet set("test");
+    Set set("test");
 
     // Test add
     set.add("apple");
@@ -58,10 +100,11 @@ void test_basic_operations(TestRunner& runner) {
     runner.assert_true(!set.contains("xyz"), "Contains non-existing");
 }
 
-void test_concurrent_operations(TestRunner& runner) {
-    cout << "\n=== Concurrent Operations Tests ===\n";
+template <typename Set>
+void test_concurrent_operations(TestRunner& runner, const string& backend) {
+    cout << "\n=== Concurrent Operations Tests [" << backend << "] ===\n";
 
-    ORSet A("A"), B("B");
+    Set A("A"), B("B");
 
     // Concurrent adds of same element
     A.add("apple");
@@ -83,15 +126,15 @@ void test_concurrent_operations(TestRunner& runner) {
     runner.assert_true(B.contains("apple"), "Add-wins semantics - B");
 }
 
-void test_merge_idempotency(TestRunner& runner) {
-    cout << "\n=== Merge Properties Tests ===\n";
+template <typename Set>
+void test_merge_idempotency(TestRunner& runner, const string& backend) {
+    cout << "\n=== Merge Properties Tests [" << backend << "] ===\n";
 
-    ORSet A("A"), B("B");
+    Set A("A"), B("B");
     A.add("x");
     B.add("y");
 
     // Test idempotency
-    size_t size_before = A.size();
     A.merge(B);
     size_t size_after_first = A.size();
     A.merge(B);  // Merge again
@@ -100,21 +143,22 @@ void test_merge_idempotency(TestRunner& runner) {
     runner.assert_true(size_after_first == size_after_second, "Merge is idempotent");
 
     // Test commutativity
-    ORSet C("C"), D("D");
+    Set C("C"), D("D");
     C.add("a");
     D.add("b");
 
-    ORSet C_copy = C;
+    Set C_copy = C;
     C.merge(D);
     D.merge(C_copy);
 
     runner.assert_true(C.size() == D.size(), "Merge is commutative");
 }
 
-void test_complex_scenario(TestRunner& runner) {
-    cout << "\n=== Complex Multi-Replica Scenario ===\n";
+template <typename Set>
+void test_complex_scenario(TestRunner& runner, const string& backend) {
+    cout << "\n=== Complex Multi-Replica Scenario [" << backend << "] ===\n";
 
-    ORSet A("A"), B("B"), C("C");
+    Set A("A"), B("B"), C("C");
 
     // Replica A operations
     A.add("item1");
@@ -147,26 +191,1300 @@ void test_complex_scenario(TestRunner& runner) {
     B.merge(A);
 
     runner.assert_true(A.size() == B.size() && B.size() == C.size(), "All replicas converged");
+    runner.assert_true(A.elements() == B.elements() && B.elements() == C.elements(), "All replicas hold the same elements");
     runner.assert_true(!A.contains("item2"), "Removed item absent");
     runner.assert_true(A.contains("item4"), "New item present");
 }
 
+void test_tag_collapse(TestRunner& runner) {
+    cout << "\n=== Tag Collapse Tests ===\n";
+
+    ORSet A("A"), B("B");
+
+    for (int i = 0; i < 1000; i++) A.add("hot");
+    runner.assert_true(A.internal_size() == 1, "Re-adds keep one tag per replica");
+
+    for (int i = 0; i < 1000; i++) B.add("hot");
+    A.merge(B);
+    B.merge(A);
+    runner.assert_true(A.internal_size() == 2 && B.internal_size() == 2, "One tag per replica after merge");
+
+    // B's old tag is still on A when B re-adds; merge keeps only the newest
+    B.add("hot");
+    A.merge(B);
+    runner.assert_true(A.internal_size() == 2, "Merge collapses superseded tag");
+
+    // A remove that observed the collapsed tags still loses to a concurrent re-add
+    A.remove("hot");
+    B.add("hot");
+    A.merge(B);
+    B.merge(A);
+    runner.assert_true(A.contains("hot") && B.contains("hot"), "Add-wins with collapsed tags");
+    runner.assert_true(A.internal_size() == 1, "Only the concurrent tag survives");
+}
+
+void test_causal_stability(TestRunner& runner) {
+    cout << "\n=== Op-Based Mode and Causal Stability Tests ===\n";
+
+    ORSet A("A"), B("B"), C("C");
+    vector<ORSet*> replicas = {&A, &B, &C};
+    auto broadcast = [&](ORSet& from, const ORSetOp& op) {
+        for (auto *replica : replicas) {
+            if (replica != &from) replica->deliver(op);
+        }
+    };
+    auto exchange_acks = [&]() {
+        for (auto *to : replicas) {
+            for (auto *from : replicas) {
+                if (to != from) to->acknowledge(from == &A ? "A" : from == &B ? "B" : "C",
+                                                from->delivered_vv());
+            }
+        }
+    };
+
+    for (auto *replica : replicas) {
+        for (const string id : {"A", "B", "C"}) replica->add_member(id);
+    }
+
+    broadcast(A, A.add_op("x"));
+    broadcast(B, B.add_op("x"));
+    runner.assert_true(C.contains("x") && C.internal_size() == 2, "Ops delivered to all replicas");
+
+    // out-of-order delivery waits for the missing dependency
+    ORSetOp add_y = A.add_op("y");
+    ORSetOp remove_y = A.remove_op("y");
+    C.deliver(remove_y);
+    runner.assert_true(C.pending_op_count() == 1 && !C.contains("y"), "Early op is buffered");
+    C.deliver(add_y);
+    runner.assert_true(C.pending_op_count() == 0 && !C.contains("y"), "Buffered op applied in causal order");
+    B.deliver(add_y);
+    B.deliver(remove_y);
+    B.deliver(add_y); // duplicate
+    runner.assert_true(!B.contains("y") && B.pending_op_count() == 0, "Duplicate delivery ignored");
+
+    exchange_acks();
+    runner.assert_true(A.stable_vv() == A.delivered_vv(), "Everything delivered everywhere is stable");
+    A.compact_stable();
+    B.compact_stable();
+    runner.assert_true(A.logged_op_count() == 0, "Stable ops leave the log");
+    runner.assert_true(A.internal_size() == 1 && B.internal_size() == 1, "Stable tags collapse per element");
+
+    // C's ack overtakes C's own op: its stable point must not move yet
+    auto stable_before = A.stable_vv();
+    ORSetOp add_z = C.add_op("z");
+    A.acknowledge("C", C.delivered_vv());
+    runner.assert_true(A.stable_vv() == stable_before, "Ack ahead of its ops does not stabilize");
+    broadcast(C, add_z);
+    exchange_acks();
+    runner.assert_true(A.stable_vv()["C"] == add_z.tag.counter, "Early ack counts once its ops arrive");
+
+    // removes issued after compaction still see the representative tag
+    broadcast(C, C.remove_op("x"));
+    runner.assert_true(!A.contains("x") && !B.contains("x") && !C.contains("x"), "Remove after compaction");
+    runner.assert_true(A.elements() == B.elements() && B.elements() == C.elements(), "Op-based replicas converged");
+
+    // a member that has not spoken yet holds stability back, so the log
+    // keeps what it will ask for; undeclared membership stabilizes nothing
+    ORSet X("X"), Y("Y");
+    X.add_member("Y");
+    X.add_member("Z");
+    ORSetOp add_w = X.add_op("w");
+    Y.deliver(add_w);
+    X.acknowledge("Y", Y.delivered_vv());
+    X.compact_stable();
+    ORSet Z("Z");
+    runner.assert_true(X.stable_vv()["X"] == 0 && X.ops_since(Z.delivered_vv()).size() == 1,
+                       "Silent member holds back stability");
+    Y.acknowledge("X", X.delivered_vv());
+    runner.assert_true(Y.stable_vv().empty(), "Nothing is stable before members are declared");
+}
+
+void test_pure_orset(TestRunner& runner) {
+    cout << "\n=== Pure Op-Based OR-Set Tests ===\n";
+
+    PureORSet A("A"), B("B"), C("C");
+    vector<PureORSet*> replicas = {&A, &B, &C};
+    for (auto *replica : replicas) {
+        for (const string id : {"A", "B", "C"}) replica->add_member(id);
+    }
+    auto broadcast = [&](PureORSet& from, const PureOp& op) {
+        for (auto *replica : replicas) {
+            if (replica != &from) replica->deliver(op);
+        }
+    };
+
+    PureOp add_a = A.add("x"), add_b = B.add("x");
+    broadcast(A, add_a);
+    broadcast(B, add_b);
+    runner.assert_true(C.contains("x") && C.log_entries() == 2, "Concurrent adds both logged");
+    broadcast(A, A.add("x"));
+    runner.assert_true(C.log_entries() == 1, "Add discards the adds it observed");
+
+    // a remove concurrent with an add only cancels what it saw
+    PureOp remove_x = A.remove("x");
+    PureOp add_x = B.add("x");
+    A.deliver(add_x);
+    B.deliver(remove_x);
+    C.deliver(add_x);
+    C.deliver(remove_x);
+    runner.assert_true(A.contains("x") && B.contains("x") && C.contains("x"), "Add wins over concurrent remove");
+    runner.assert_true(C.log_entries() == 1, "Removes are never logged");
+
+    PureOp add_y = A.add("y");
+    PureOp remove_y = A.remove("y");
+    B.deliver(remove_y);
+    runner.assert_true(B.pending_op_count() == 1 && !B.contains("y"), "Early op is buffered");
+    B.deliver(add_y);
+    C.deliver(add_y);
+    C.deliver(remove_y);
+    runner.assert_true(B.pending_op_count() == 0 && !B.contains("y"), "Buffered op applied in causal order");
+
+    broadcast(C, C.add("z"));
+    for (auto *to : replicas) {
+        for (auto *from : replicas) {
+            if (to != from) to->acknowledge(from == &A ? "A" : from == &B ? "B" : "C", from->delivered_vv());
+        }
+    }
+    A.compact_stable();
+    runner.assert_true(A.log_entries() == 0 && A.internal_size() == 2, "Stable adds leave the log");
+    broadcast(B, B.remove("z"));
+    runner.assert_true(!A.contains("z") && !C.contains("z"), "Remove drops stable elements");
+    runner.assert_true(A.elements() == B.elements() && B.elements() == C.elements(), "Pure replicas converged");
+
+    ByteWriter out;
+    add_x.encode(out);
+    ByteReader in(out.buffer);
+    PureOp decoded = PureOp::decode(in);
+    runner.assert_true(in.done() && decoded.element == "x" && decoded.tag == add_x.tag && decoded.vc == add_x.vc,
+                       "Pure op round-trips through its encoding");
+}
+
+void test_orset_codec(TestRunner& runner) {
+    cout << "\n=== ORSet Codec Tests ===\n";
+
+    ORSet A("A"), B("B");
+    for (int i = 0; i < 50; i++) A.add("item_" + to_string(i));
+    B.add("item_7");
+    B.add("other");
+    A.merge(B);
+    A.remove("item_3");
+
+    ORSet decoded = ORSetCodec::decode(ORSetCodec::encode(A));
+    runner.assert_true(decoded.elements() == A.elements(), "Decoded state has the same elements");
+    runner.assert_true(decoded.internal_size() == A.internal_size(), "Decoded state has the same tags");
+    runner.assert_true(ORSetCodec::encode(decoded) == ORSetCodec::encode(A), "Encoding is deterministic");
+
+    // the causal context survives: a stale replica cannot resurrect item_3
+    ORSet stale("S");
+    stale.merge(B);
+    decoded.merge(stale);
+    decoded.add("item_9");
+    runner.assert_true(!decoded.contains("item_3") && decoded.get_counter() == A.get_counter() + 1,
+                       "Decoded state keeps its causal context and counter");
+
+    string bytes = ORSetCodec::encode(A);
+    bool truncated_rejected = false;
+    try {
+        ORSetCodec::decode(string_view(bytes).substr(0, bytes.size() - 1));
+    } catch (const runtime_error&) {
+        truncated_rejected = true;
+    }
+    runner.assert_true(truncated_rejected, "Truncated state is rejected");
+
+    // a frame of a few bytes declaring a run of 2^40 dots
+    ByteWriter huge;
+    huge.put_bytes("ORS", 3);
+    huge.put_u8(ORSetCodec::kVersion);
+    huge.put_string("A");
+    huge.put_varint(0);
+    huge.put_varint(1);
+    huge.put_string("A");
+    huge.put_varint(0);
+    huge.put_varint(1);
+    for (uint64_t field : {uint64_t(0), uint64_t(2), uint64_t(1) << 40}) huge.put_varint(field);
+    bool huge_rejected = false;
+    try {
+        ORSetCodec::decode(huge.buffer);
+    } catch (const runtime_error&) {
+        huge_rejected = true;
+    }
+    runner.assert_true(huge_rejected, "Oversized dot run is rejected");
+
+    ByteWriter wide;
+    wide.put_bytes("ORS", 3);
+    wide.put_u8(ORSetCodec::kVersion);
+    wide.put_string("A");
+    wide.put_varint(0);
+    wide.put_varint(uint64_t(1) << 40); // replica ids, none of them present
+    bool wide_rejected = false;
+    try {
+        ORSetCodec::decode(wide.buffer);
+    } catch (const runtime_error&) {
+        wide_rejected = true;
+    }
+    runner.assert_true(wide_rejected, "Oversized dictionary is rejected");
+
+    bool same_delta = true;
+    for (const auto &peer : {map<string, uint64_t>(), B.summary(), stale.summary(), A.summary()}) {
+        same_delta = same_delta &&
+                     ORSetCodec::encode(ORSetCodec::decode_missing(bytes, peer)) == ORSetCodec::encode(A.missing_for(peer));
+    }
+    runner.assert_true(same_delta, "decode_missing() decodes the delta missing_for() builds");
+
+    // elements are front-coded: neighbours share their key prefixes
+    ORSet keys("K");
+    for (int i = 0; i < 100; i++) keys.add("tenant/" + to_string(i % 3) + "/object/" + to_string(1000 + i));
+    keys.add("");
+    string coded = ORSetCodec::encode(keys);
+    size_t flat = 0;
+    for (const auto &element : keys.elements()) flat += element.size();
+    runner.assert_true(ORSetCodec::decode(coded).elements() == keys.elements() && coded.size() < flat,
+                       "Front-coded elements round trip in less than their bytes");
+    bool found = true;
+    size_t index = 0;
+    for (const auto &element : keys.elements()) {
+        ByteReader in(coded);
+        ORSetCodec::skip_to_elements(in);
+        found = found && ElementBlockView(in).find(element) == optional<size_t>(index++);
+    }
+    for (string missing : {"a", "tenant/0/object/1000x", "tenant/1/", "tenant/3", "zzz"}) {
+        found = found && !ORSetCodec::contains_encoded(coded, missing);
+    }
+    runner.assert_true(found && ORSetCodec::contains_encoded(coded, "tenant/2/object/1098"),
+                       "Encoded lookup finds every element and nothing else");
+    ByteWriter bad;
+    ORSetCodec::write_element_block({"abc", "abd"}, bad);
+    bad.buffer[8] = 4; // the second entry shares more than the first has
+    bool bad_rejected = false;
+    try {
+        ByteReader in(bad.buffer);
+        ElementBlockView block(in);
+        ElementBlockView::Cursor cursor(block);
+        while (!cursor.done()) cursor.next();
+    } catch (const runtime_error&) {
+        bad_rejected = true;
+    }
+    runner.assert_true(bad_rejected, "Malformed element block is rejected");
+    vector<string> numbered;
+    for (int i = 0; i < 17; i++) numbered.push_back(string(i < 10 ? "k0" : "k") + to_string(i));
+    ByteWriter restarts;
+    ORSetCodec::write_element_block(vector<string_view>(numbered.begin(), numbered.end()), restarts);
+    // "k00" whole (5 bytes), "k10" sharing "k" (4), 14 sharing two bytes (3 each)
+    runner.assert_true(restarts.buffer.substr(restarts.buffer.size() - 8) == string("\0\0\0\0\x33\0\0\0", 8),
+                       "Restart offsets are little-endian");
+
+    // segments: long elements are referenced, the rest is copied
+    for (int i = 0; i < 3; i++) A.add(string(300, char('a' + i)));
+    A.add(string(300, 'z'));
+    A.remove(string(300, 'z'));
+    SegmentWriter segments = ORSetCodec::encode_segments(A);
+    size_t referenced = 0;
+    for (string_view segment : segments.finish()) referenced += segment.size() == 300;
+    runner.assert_true(referenced == 4, "Long elements and removed elements are referenced");
+    runner.assert_true(segments.join() == ORSetCodec::encode(A), "Segments join to the encoded state");
+}
+
+void test_block_codec(TestRunner& runner) {
+    cout << "\n=== Block Codec Tests ===\n";
+
+    mt19937 rng(7);
+    string random_bytes(100000, '\0');
+    for (auto &c : random_bytes) c = char(rng());
+    string text;
+    for (int i = 0; i < 20000; i++) text += "user:" + to_string(i * 7) + ":profile;";
+    string runs(200000, 'x');
+    vector<string> inputs = {"", "a", "abcabcabcabcabcabcabc", random_bytes, text, runs};
+
+    bool round_trip = true;
+    for (const auto &input : inputs) {
+        for (int level : {0, 1, 6, 9}) round_trip = round_trip && BlockCodec::decompress(BlockCodec::compress(input, level)) == input;
+    }
+    runner.assert_true(round_trip, "Block codec round trip at every level");
+    runner.assert_true(BlockCodec::compress(random_bytes).size() < random_bytes.size() + 32 &&
+                           BlockCodec::compress(runs).size() < 100 &&
+                           BlockCodec::compress(text, 9).size() < BlockCodec::compress(text, 0).size() / 4,
+                       "Incompressible blocks are stored, redundant ones shrink");
+
+    string packed = BlockCodec::compress(text);
+    bool rejected = true;
+    for (int i = 0; i < 300; i++) {
+        string damaged = packed;
+        if (i % 3 == 0) {
+            damaged.resize(rng() % damaged.size());
+        } else {
+            damaged[rng() % damaged.size()] ^= char(1 << (rng() % 8));
+        }
+        try {
+            string out = BlockCodec::decompress(damaged);
+            rejected = rejected && out.size() <= text.size(); // a flip may still decode
+        } catch (const runtime_error&) {
+        }
+    }
+    bool truncated = false;
+    try {
+        BlockCodec::decompress(string_view(packed).substr(0, packed.size() - 1));
+    } catch (const runtime_error&) {
+        truncated = true;
+    }
+    runner.assert_true(rejected && truncated, "Damaged compressed input is rejected");
+
+    ORSet A("A"), B("B");
+    for (int i = 0; i < 3000; i++) (i % 3 ? A : B).add("key:" + to_string(i * 7919 % 10007));
+    A.merge(B);
+    for (int i = 0; i < 3000; i += 10) A.remove("key:" + to_string(i * 7919 % 10007));
+    string encoded = ORSetCodec::encode(A);
+    string columns = ORSetCodec::encode_compressed(A);
+    runner.assert_true(ORSetCodec::encode(ORSetCodec::decode_compressed(columns)) == encoded,
+                       "Compressed state decodes to the same state");
+    runner.assert_true(columns.size() < BlockCodec::compress(encoded).size(),
+                       "Tag columns compress better than the plain encoding");
+}
+
+void test_stream_vbyte(TestRunner& runner) {
+    cout << "\n=== Stream VByte Tests ===\n";
+
+    vector<uint32_t> edges = {0, 1, 255, 256, 65535, 65536, (1u << 24) - 1, 1u << 24, numeric_limits<uint32_t>::max()};
+    mt19937 rng(11);
+    bool round_trip = true;
+    for (size_t n : {size_t(0), size_t(1), size_t(3), size_t(4), size_t(9), size_t(31), size_t(1000)}) {
+        vector<uint32_t> values(n);
+        for (size_t i = 0; i < n; i++) values[i] = i < edges.size() ? edges[i] : uint32_t(rng()) >> (8 * (rng() % 4));
+        string bytes = StreamVByte::encode(values);
+        for (auto kernel : {StreamVByte::Kernel::Scalar, StreamVByte::Kernel::SSSE3, StreamVByte::Kernel::AVX2}) {
+            if (kernel != StreamVByte::Kernel::Scalar && int(kernel) > int(StreamVByte::best_kernel())) continue;
+            vector<uint32_t> out(n);
+            size_t read = StreamVByte::decode(bytes, n, out.data(), kernel);
+            round_trip = round_trip && out == values && read == bytes.size();
+        }
+    }
+    runner.assert_true(round_trip, string("Stream VByte round trip, scalar up to ") +
+                                       StreamVByte::kernel_name(StreamVByte::best_kernel()));
+
+    vector<uint32_t> values(100, 70000);
+    string bytes = StreamVByte::encode(values);
+    bool truncated = false;
+    try {
+        StreamVByte::decode_values(string_view(bytes).substr(0, bytes.size() - 1), values.size());
+    } catch (const runtime_error&) {
+        truncated = true;
+    }
+    runner.assert_true(truncated && bytes.size() == 25 + 300, "Stream VByte sizes values and rejects short input");
+
+    // counters past 32 bits keep the LEB128 columns
+    uint64_t base = uint64_t(1) << 40;
+    ByteWriter state;
+    state.put_bytes("ORS", 3);
+    state.put_u8(ORSetCodec::kVersion);
+    state.put_string("A");
+    state.put_varint(base + 1000);
+    state.put_varint(1);
+    state.put_string("A");
+    state.put_varint(1);
+    state.put_varint(0);
+    state.put_varint(base + 1000);
+    state.put_varint(0);
+    vector<string> keys;
+    for (int i = 0; i < 1000; i++) keys.push_back("k" + to_string(1000 + i));
+    ORSetCodec::write_element_block(vector<string_view>(keys.begin(), keys.end()), state);
+    for (int i = 0; i < 1000; i++) {
+        state.put_varint(1);
+        state.put_varint(0);
+        state.put_varint(i % 2 ? base + 1 + i : 1 + i);
+    }
+    state.put_varint(0);
+    state.put_varint(0);
+    ORSet wide = ORSetCodec::decode(state.buffer);
+    string packed = ORSetCodec::encode_compressed(wide);
+    runner.assert_true(packed[4] == 1 && ORSetCodec::decompress_state(packed) == state.buffer,
+                       "Wide counters fall back to LEB128 columns");
+}
+
+void test_version_vector_summaries(TestRunner& runner) {
+    cout << "\n=== Version Vector Summary Tests ===\n";
+
+    ORSet A("A"), B("B"), C("C");
+    for (auto *replica : {&A, &B, &C}) {
+        for (const string id : {"A", "B", "C"}) replica->add_member(id);
+    }
+    for (int i = 0; i < 100; i++) A.add("item_" + to_string(i));
+    B.merge(A);
+    C.merge(A);
+
+    A.add("fresh");
+    A.remove("item_5");
+    A.remove("absent"); // removes nothing, takes no dot
+    ORSet delta = A.missing_for(B.summary());
+    runner.assert_true(delta.internal_size() == 1 && delta.contains("fresh"), "Delta holds only unseen pairs");
+    runner.assert_true(A.missing_for(A.summary()).internal_size() == 0, "Nothing missing for an equal summary");
+
+    B.merge(delta);
+    runner.assert_true(B.elements() == A.elements(), "Delta merge removes what the peer had");
+    runner.assert_true(B.summary() == A.summary(), "Peer summary catches up");
+
+    // a remove reaches a third replica through the one that forwarded it
+    C.add("item_7");
+    C.merge(B.missing_for(C.summary()));
+    B.merge(C.missing_for(B.summary()));
+    runner.assert_true(!C.contains("item_5") && C.elements() == B.elements(), "Removes are forwarded");
+
+    // a concurrent add survives a remove that did not observe it
+    A.remove("item_7");
+    A.merge(C.missing_for(A.summary()));
+    C.merge(A.missing_for(C.summary()));
+    runner.assert_true(A.contains("item_7") && C.contains("item_7"), "Add-wins over delta sync");
+
+    // a re-add superseded the tag the peer holds, then the new tag was removed
+    ORSet P("P"), Q("Q");
+    P.add("k");
+    Q.merge(P);
+    P.add("k");
+    P.remove("k");
+    Q.merge(P.missing_for(Q.summary()));
+    runner.assert_true(!Q.contains("k") && Q.internal_size() == 0, "Remove of a re-add drops the superseded tag");
+
+    for (auto *to : {&A, &B, &C}) {
+        for (auto *from : {&A, &B, &C}) {
+            if (to != from) to->acknowledge(from == &A ? "A" : from == &B ? "B" : "C", from->summary());
+        }
+    }
+    A.compact_stable();
+    runner.assert_true(A.logged_remove_count() == 1, "Stable removes leave the remove log");
+    B.merge(A.missing_for(B.summary()));
+    A.acknowledge("B", B.summary());
+    A.compact_stable();
+    runner.assert_true(A.logged_remove_count() == 0, "Remove log empties once every peer has it");
+}
+
+void test_delta_buffer(TestRunner& runner) {
+    cout << "\n=== Delta Buffer Tests ===\n";
+
+    DeltaBuffer A("A", {"B", "C"}, 1 << 20), B("B", {"A", "C"}, 1 << 20), C("C", {"A", "B"}, 1 << 20);
+    auto ship = [](DeltaBuffer& from, DeltaBuffer& to, const string& to_id) {
+        DeltaMessage message = from.prepare(to_id);
+        to.receive(message);
+        from.acknowledge(to_id, message.upto);
+        return message.full;
+    };
+
+    A.add("x");
+    A.add("y");
+    B.add("x");
+    ship(A, B, "B");
+    ship(A, C, "C");
+    ship(B, A, "A");
+    ship(B, C, "C");
+    runner.assert_true(A.get_state().elements() == C.get_state().elements() &&
+                       B.get_state().elements() == C.get_state().elements(), "Deltas converge replicas");
+    runner.assert_true(A.buffered_intervals() == 0 && B.buffered_intervals() == 0,
+                       "Intervals acked by every peer are collected");
+
+    // C falls behind: A keeps what C has not acked, and only that
+    A.remove("x");
+    ship(A, B, "B");
+    A.add("z");
+    runner.assert_true(A.prepare("B").payload.internal_size() == 1, "Peer gets only unacked intervals");
+    ship(A, B, "B");
+    runner.assert_true(A.buffered_intervals() == 2, "Unacked intervals stay buffered");
+    runner.assert_true(!ship(A, C, "C") && C.get_state().elements() == A.get_state().elements(),
+                       "Lagging peer catches up from the delta log");
+    runner.assert_true(A.buffered_intervals() == 0, "Log drains once the slow peer acks");
+
+    // concurrent add survives a delta remove that did not observe it
+    A.remove("y");
+    B.add("y");
+    ship(A, B, "B");
+    ship(B, A, "A");
+    runner.assert_true(A.get_state().contains("y") && B.get_state().contains("y"), "Add-wins through deltas");
+
+    // a tiny cap drops unacked intervals and falls back to the full state
+    DeltaBuffer small("S", {"T"}, 64), T("T", {"S"}, 64);
+    for (int i = 0; i < 20; i++) {
+        small.add("item_" + to_string(i));
+        small.seal();
+    }
+    runner.assert_true(small.buffered_byte_count() <= 64, "Buffer stays under its byte cap");
+    runner.assert_true(ship(small, T, "T") && small.fallback_count() == 1, "Dropped intervals fall back to full state");
+    runner.assert_true(T.get_state().elements() == small.get_state().elements(), "Full-state fallback converges");
+    small.add("late");
+    runner.assert_true(!ship(small, T, "T") && T.get_state().contains("late"), "Deltas resume after the fallback");
+}
+
+void test_delta_accumulator(TestRunner& runner) {
+    cout << "\n=== Delta Accumulator Tests ===\n";
+
+    ORSet A("A"), B("B"), C("C");
+    A.add("old");
+    B.merge(A);
+    C.merge(A);
+
+    DeltaAccumulator delta("A");
+    for (int i = 0; i < 100; i++) {
+        A.add("tmp_" + to_string(i), delta);
+        A.remove("tmp_" + to_string(i), delta);
+    }
+    A.add("kept", delta);
+    A.add("kept", delta);
+    runner.assert_true(delta.live_pairs() == 1 && delta.remove_entries() == 0,
+                       "Add-then-remove of new tags cancels");
+
+    // re-add then remove of a tag peers hold: only the old tag is reported
+    A.add("old", delta);
+    A.remove("old", delta);
+    runner.assert_true(delta.remove_entries() == 1, "Remove of a superseded old tag is kept");
+
+    ORSet shipped = delta.take();
+    runner.assert_true(delta.empty() && shipped.internal_size() == 1, "One compact delta per interval");
+    B.merge(shipped);
+    runner.assert_true(B.elements() == A.elements() && B.summary() == A.summary(),
+                       "Coalesced delta converges the peer");
+    C.merge(B.missing_for(C.summary()));
+    runner.assert_true(C.elements() == A.elements(), "Coalesced removes are forwarded");
+
+    string bytes = ORSetCodec::encode(shipped);
+    ORSet decoded = ORSetCodec::decode(bytes);
+    runner.assert_true(decoded.causal_context().cloud == shipped.causal_context().cloud && bytes.size() < 64,
+                       "Dot range encodes as one run");
+}
+
+void test_sync_planner(TestRunner& runner) {
+    cout << "\n=== Sync Planner Tests ===\n";
+
+    // A's group is only C, so removes C has seen are pruned from A's log
+    // and B, which never synced since, ends up behind the floor
+    ORSet A("A"), B("B"), C("C");
+    A.add_member("C");
+    for (int i = 0; i < 1000; i++) A.add("item_" + to_string(i));
+    B.merge(A);
+    C.merge(A);
+    SyncPlanner planner;
+
+    A.add("fresh");
+    runner.assert_true(planner.plan(A, B).strategy == SyncStrategy::Delta, "Small gap syncs by delta");
+    for (int i = 0; i < 100; i++) A.remove("item_" + to_string(i));
+    C.merge(A);
+    A.merge(C);
+    A.compact_stable();
+    ORSet::Divergence gap = A.divergence_from(B.summary());
+    runner.assert_true(gap.behind_floor && gap.elements >= 100, "Pruned removes put a stale peer behind the floor");
+
+    SyncDecision decision = planner.plan(A, B);
+    runner.assert_true(decision.strategy == SyncStrategy::Digest, "Few touched elements behind the floor pick a digest");
+    ORSet fresh("D");
+    runner.assert_true(planner.plan(A, fresh).strategy == SyncStrategy::Full, "Empty peer gets the full state");
+
+    // every strategy ends in the same state
+    for (SyncStrategy strategy : {SyncStrategy::Delta, SyncStrategy::Digest, SyncStrategy::Full}) {
+        ORSet target = B;
+        target.add("local_" + to_string(int(strategy)));
+        set<string> expected = A.elements();
+        expected.insert("local_" + to_string(int(strategy)));
+        SyncDecision done = planner.sync("A", A, "B", target, strategy);
+        runner.assert_true(target.elements() == expected && target.summary().at("A") == A.summary().at("A"),
+                           string("Sync by ") + strategy_name(strategy) + " converges");
+        if (strategy == SyncStrategy::Digest) {
+            runner.assert_true(done.differing < done.buckets && done.bytes < ORSetCodec::encode(A).size(),
+                               "Digest ships only differing buckets");
+        }
+    }
+    // removes shipped by a digest reach a third replica by delta
+    ORSet relay = B;
+    planner.sync("A", A, "B", relay, SyncStrategy::Digest);
+    ORSet third("E");
+    third.merge(B);
+    third.merge(relay.missing_for(third.summary()));
+    runner.assert_true(third.elements() == A.elements(), "Digest sync forwards removes");
+
+    runner.assert_true(planner.log().size() == 4 && planner.log()[0].to == "B", "Decisions are logged");
+}
+
+void test_iblt(TestRunner& runner) {
+    cout << "\n=== IBLT Reconciliation Tests ===\n";
+
+    IBLT a(IBLT::cells_for(15)), b(IBLT::cells_for(15));
+    for (uint64_t key = 1; key <= 1000; key++) a.insert(mix64(key));
+    for (uint64_t key = 6; key <= 1005; key++) b.insert(mix64(key));
+    a.subtract(b);
+    vector<uint64_t> only_a, only_b;
+    runner.assert_true(a.decode(only_a, only_b) && only_a.size() == 5 && only_b.size() == 5,
+                       "Subtracted tables decode the symmetric difference");
+    ByteWriter out;
+    a.encode(out);
+    ByteReader in(out.buffer);
+    vector<uint64_t> again_a, again_b;
+    runner.assert_true(IBLT::decode(in).decode(again_a, again_b) && again_a == only_a, "IBLT round trips");
+
+    IBLT small(6), other(6);
+    for (uint64_t key = 1; key <= 100; key++) small.insert(mix64(key));
+    small.subtract(other);
+    vector<uint64_t> lost, unused;
+    runner.assert_true(!small.decode(lost, unused), "Undersized table fails to decode");
+
+    ORSet A("A"), B("B");
+    for (int i = 0; i < 1000; i++) A.add("item_" + to_string(i));
+    B.merge(A);
+    for (int i = 0; i < 20; i++) A.add("new_" + to_string(i));
+    for (int i = 0; i < 10; i++) A.remove("item_" + to_string(i));
+    A.add("item_500"); // supersedes a tag B holds
+    B.add("local");
+    B.remove("item_999");
+    set<string> expected = A.elements();
+    expected.insert("local");
+    expected.erase("item_999");
+
+    ORSet pulled = B;
+    auto result = IBLTSync::pull(A, pulled, IBLTSync::estimate_difference(A.summary(), B.summary()));
+    runner.assert_true(pulled.elements() == expected && result.rounds == 1 && !result.full_state,
+                       "One-round pull converges with add-wins kept");
+    runner.assert_true(result.bytes < ORSetCodec::encode(A).size() / 3, "Pull ships far less than the state");
+
+    ORSet retried = B;
+    result = IBLTSync::pull(A, retried, 0);
+    runner.assert_true(retried.elements() == expected && result.rounds > 1, "Underestimate retries with a larger table");
+    ORSet capped = B;
+    result = IBLTSync::pull(A, capped, 0, 16);
+    runner.assert_true(capped.elements() == expected && result.full_state, "Past the cell cap the full state is sent");
+}
+
+void test_cardinality_sketch(TestRunner& runner) {
+    cout << "\n=== Cardinality Sketch Tests ===\n";
+
+    auto close = [](double estimate, double exact, double tolerance) {
+        return fabs(estimate - exact) <= tolerance * exact;
+    };
+    HyperLogLog small;
+    for (int i = 0; i < 100; i++) small.add_hash(mix64(fnv1a("x" + to_string(i % 10))));
+    runner.assert_true(close(small.estimate(), 10, 0.1), "Small counts use linear counting");
+
+    // three replicas over overlapping ranges, sketches enabled before and after filling
+    ORSet A("A"), B("B"), C("C");
+    A.enable_sketch();
+    for (int i = 0; i < 60000; i++) A.add("item_" + to_string(i));
+    for (int i = 40000; i < 100000; i++) B.add("item_" + to_string(i));
+    for (int i = 90000; i < 120000; i++) C.add("item_" + to_string(i));
+    B.enable_sketch();
+    C.enable_sketch();
+    const HyperLogLog &a = *A.cardinality_sketch(), &b = *B.cardinality_sketch(), &c = *C.cardinality_sketch();
+    runner.assert_true(close(a.estimate(), 60000, 3 * a.relative_error()), "Sketch estimates distinct elements");
+    runner.assert_true(close(HyperLogLog::union_estimate({&a, &b, &c}), 120000, 3 * a.relative_error()),
+                       "Merged sketches estimate the union");
+    runner.assert_true(close(HyperLogLog::difference_estimate(a, b), 40000, 0.1) &&
+                       close(HyperLogLog::intersection_estimate(a, b), 20000, 0.15),
+                       "Difference and intersection by inclusion-exclusion");
+
+    double before = A.cardinality_sketch()->estimate();
+    for (int i = 0; i < 30000; i++) A.remove("item_" + to_string(i));
+    runner.assert_true(A.cardinality_sketch()->estimate() == before, "Removes leave the sketch as is");
+    A.merge(B);
+    runner.assert_true(close(A.cardinality_sketch()->estimate(), 100000, 3 * a.relative_error()),
+                       "Merge carries the sketch over");
+
+    HyperLogLog decoded = HyperLogLog::deserialize(c.serialize());
+    runner.assert_true(decoded.estimate() == c.estimate(), "Sketch round trips");
+    bool threw = false;
+    try {
+        HyperLogLog(10).merge(c);
+    } catch (const invalid_argument&) {
+        threw = true;
+    }
+    runner.assert_true(threw && !ORSet("D").cardinality_sketch(), "Precision mismatch throws; sketch is opt-in");
+
+    // states whose sketches differ in precision still merge, at the coarser one
+    HyperLogLog fine(12), coarse(10);
+    for (int i = 0; i < 20000; i++) {
+        uint64_t hash = mix64(fnv1a("f" + to_string(i)));
+        fine.add_hash(hash);
+        coarse.add_hash(hash);
+    }
+    runner.assert_true(fine.folded(10).serialize() == coarse.serialize(), "Folded sketch equals one built coarse");
+    ORSet D("D"), E("E");
+    D.enable_sketch(12);
+    E.enable_sketch(10);
+    for (int i = 0; i < 5000; i++) D.add("d_" + to_string(i));
+    for (int i = 0; i < 5000; i++) E.add("e_" + to_string(i));
+    D.merge(E);
+    E.merge(D);
+    runner.assert_true(D.size() == 10000 && D.elements() == E.elements() &&
+                       D.cardinality_sketch()->get_precision() == 10 &&
+                       close(D.cardinality_sketch()->estimate(), 10000, 3 * coarse.relative_error()),
+                       "Mixed-precision merge completes and folds the sketch");
+}
+
+void test_state_fingerprint(TestRunner& runner) {
+    cout << "\n=== State Fingerprint Tests ===\n";
+
+    ORSet A("A"), B("B"), C("C");
+    runner.assert_true(A.fingerprint() == B.fingerprint(), "Empty replicas share a fingerprint");
+    A.add("x");
+    A.add("y");
+    B.add("y");
+    C.add("z");
+    uint64_t before = A.fingerprint();
+    A.add("w");
+    A.remove("w");
+    runner.assert_true(A.fingerprint() == before, "Add then remove restores the fingerprint");
+
+    // same pairs reached in different orders
+    A.merge(B);
+    A.merge(C);
+    C.merge(B);
+    C.merge(A);
+    B.merge(C);
+    runner.assert_true(A.fingerprint() == B.fingerprint() && B.fingerprint() == C.fingerprint(),
+                       "Converged replicas agree whatever the merge order");
+    A.add("x"); // re-add supersedes A's own tag
+    runner.assert_true(A.fingerprint() != B.fingerprint(), "Any pair change moves the fingerprint");
+    B.merge(A);
+    vector<uint64_t> digest = B.bucket_digest(16);
+    runner.assert_true(A.fingerprint() == B.fingerprint() &&
+                       accumulate(digest.begin(), digest.end(), uint64_t(0)) == B.fingerprint(),
+                       "Fingerprint equals the sum of a bucket digest");
+
+    ORSet decoded = ORSetCodec::decode(ORSetCodec::encode(A));
+    runner.assert_true(decoded.fingerprint() == A.fingerprint(), "Decoded state keeps its fingerprint");
+    ORSet delta = B.missing_for(C.summary());
+    runner.assert_true(delta.fingerprint() != 0 && ORSet("E").fingerprint() == 0, "Deltas carry their own sums");
+
+    SyncPlanner planner;
+    runner.assert_true(planner.plan(A, B).strategy == SyncStrategy::Skip &&
+                       planner.plan(A, C).strategy != SyncStrategy::Skip, "Converged peers skip the sync");
+
+    // same pairs and summary, but only P has seen q's dots and its remove
+    ORSet X("X"), P("P"), Q("Q"), added("X"), removed("X");
+    X.add("p");
+    X.add("q", added);
+    X.remove("q", removed);
+    P.merge(added);
+    P.merge(removed);
+    runner.assert_true(P.fingerprint() == Q.fingerprint() && P.summary() == Q.summary() &&
+                       P.state_fingerprint() != Q.state_fingerprint() &&
+                       planner.plan(P, Q).strategy != SyncStrategy::Skip,
+                       "Differing clouds and remove logs are not skipped");
+}
+
+// Polls every node until no request is pending or the time runs out
+static bool drive(const vector<ReplicationNode*>& nodes, int timeout_ms = 5000) {
+    auto deadline = steady_clock::now() + milliseconds(timeout_ms);
+    for (;;) {
+        size_t pending = 0;
+        for (auto *node : nodes) {
+            node->poll(0);
+            pending += node->pending_requests();
+        }
+        if (pending == 0) return true;
+        if (steady_clock::now() > deadline) return false;
+    }
+}
+
+void test_replication_node(TestRunner& runner) {
+    cout << "\n=== TCP Replication Tests ===\n";
+
+    ReplicationNode A("A"), B("B"), C("C");
+    for (int i = 0; i < 1000; i++) A.add("item_" + to_string(i));
+    B.request(A.listen_port(), SyncStrategy::Full);
+    runner.assert_true(drive({&A, &B}) && B.get_state().elements() == A.get_state().elements(),
+                       "Full-state pull over loopback");
+
+    A.add("fresh");
+    A.remove("item_3");
+    B.add("mine");
+    B.request(A.listen_port(), SyncStrategy::Delta);
+    drive({&A, &B});
+    runner.assert_true(B.get_state().contains("fresh") && !B.get_state().contains("item_3") &&
+                       B.get_state().contains("mine"), "Delta pull merges removes and keeps local adds");
+
+    A.remove("item_4");
+    C.request(A.listen_port(), SyncStrategy::Full);
+    drive({&A, &C});
+    C.request(B.listen_port(), SyncStrategy::Digest);
+    drive({&B, &C});
+    runner.assert_true(C.get_state().contains("mine") && !C.get_state().contains("item_4"),
+                       "Digest pull keeps removes the peer has not seen");
+
+    // many requests in flight on one reused connection
+    for (int i = 0; i < 50; i++) {
+        A.add("burst_" + to_string(i));
+        B.request(A.listen_port(), i % 2 ? SyncStrategy::Delta : SyncStrategy::Digest);
+    }
+    bool done = drive({&A, &B});
+    runner.assert_true(done && B.get_stats().replies_applied == 52 && B.get_stats().connections_opened == 1,
+                       "Pipelined requests share one connection");
+    runner.assert_true(B.get_state().contains("burst_49"), "Pipelined replies all merged");
+
+    // a peer that goes away fails its pending requests, and reconnecting works
+    {
+        ReplicationNode D("D");
+        uint16_t port = D.listen_port();
+        B.request(port, SyncStrategy::Full);
+        B.poll(0);
+    }
+    drive({&B});
+    runner.assert_true(B.get_stats().failed_requests == 1 && B.pending_requests() == 0,
+                       "Closed peer fails pending requests");
+    B.disconnect("127.0.0.1", A.listen_port());
+    B.request(A.listen_port(), SyncStrategy::Delta);
+    runner.assert_true(drive({&A, &B}) && B.get_stats().connections_opened == 3, "Reconnects after disconnect");
+
+    // a reply far larger than the socket buffer, sent from segments
+    ReplicationNode E("E"), F("F");
+    for (int i = 0; i < 4000; i++) E.add(to_string(i) + string(1000, 'x'));
+    F.request(E.listen_port(), SyncStrategy::Full);
+    runner.assert_true(drive({&E, &F}) && F.get_state().fingerprint() == E.get_state().fingerprint(),
+                       "Large state pulled in segments");
+}
+
+// The same scenarios for each I/O engine, in a fresh directory
+template <typename Engine>
+void test_orset_store(TestRunner& runner, const string& engine) {
+    cout << "\n=== ORSet Store Tests [" << engine << "] ===\n";
+
+    char path[] = "/tmp/orset_store_XXXXXX";
+    if (!mkdtemp(path)) throw runtime_error("mkdtemp failed");
+    string dir = path;
+    uint64_t fingerprint, counter;
+    {
+        ORSetStore<Engine> store(dir, "A");
+        for (int i = 0; i < 1000; i++) store.add("item_" + to_string(i));
+        store.remove("item_3");
+        ORSet remote("B");
+        remote.add("remote");
+        store.wait_durable(store.merge(remote));
+        const auto &stats = store.get_stats();
+        runner.assert_true(store.engine().async() ? stats.batches < stats.records / 10
+                                                  : stats.batches == stats.records,
+                           "Batches follow the sync latency");
+        fingerprint = store.get_state().fingerprint();
+        counter = store.get_state().get_counter();
+    }
+    {
+        ORSetStore<Engine> store(dir, "A");
+        runner.assert_true(store.get_state().fingerprint() == fingerprint && store.get_state().contains("remote") &&
+                           !store.get_state().contains("item_3"), "Log replays to the same state");
+        store.add("after");
+        runner.assert_true(store.get_state().get_counter() == counter + 1, "No dot reused after recovery");
+
+        store.snapshot();
+        while (store.snapshot_pending()) this_thread::yield();
+        store.wait_durable(store.add("post_snapshot"));
+        size_t files = distance(filesystem::directory_iterator(dir), filesystem::directory_iterator());
+        runner.assert_true(files == 2 && store.get_stats().snapshots == 1, "Snapshot replaces the older files");
+        fingerprint = store.get_state().fingerprint();
+    }
+    // a record torn by a crash ends the log
+    string last_log;
+    for (const auto &entry : filesystem::directory_iterator(dir)) {
+        if (entry.path().filename().string().rfind("wal.", 0) == 0) last_log = entry.path().string();
+    }
+    ofstream(last_log, ios::binary | ios::app) << string("\x40\0\0\0torn", 8);
+    {
+        ORSetStore<Engine> store(dir, "A");
+        runner.assert_true(store.get_state().fingerprint() == fingerprint && store.get_state().contains("post_snapshot"),
+                           "Snapshot and log recover past a torn record");
+    }
+    filesystem::remove_all(dir);
+
+    // an engine whose buffers cannot be allocated leaves no descriptors behind
+    auto open_fds = []() {
+        return distance(filesystem::directory_iterator("/proc/self/fd"), filesystem::directory_iterator());
+    };
+    auto fds_before = open_fds();
+    bool threw = false;
+    try {
+        Engine unallocatable(2, size_t(1) << 62);
+    } catch (const bad_alloc&) {
+        threw = true;
+    }
+    runner.assert_true(threw && open_fds() == fds_before, "Failed engine setup releases its resources");
+}
+
+#if defined(__cpp_impl_coroutine)
+// ReplicationNode servers, each polled by its own thread until destroyed
+struct PolledServers {
+    vector<unique_ptr<ReplicationNode>> nodes;
+    vector<thread> threads;
+    atomic<bool> stop{false};
+
+    PolledServers(int count, int elements) {
+        for (int n = 0; n < count; n++) {
+            nodes.push_back(make_unique<ReplicationNode>("S" + to_string(n)));
+            for (int i = 0; i < elements; i++) nodes.back()->add("s" + to_string(n) + "_" + to_string(i));
+        }
+        for (auto &node : nodes) {
+            threads.emplace_back([this, server = node.get()]() {
+                while (!stop) server->poll(10);
+            });
+        }
+    }
+
+    ~PolledServers() {
+        stop = true;
+        for (auto &t : threads) t.join();
+    }
+};
+
+void test_async_replication(TestRunner& runner) {
+    cout << "\n=== Coroutine Replication Tests ===\n";
+
+    ThreadPool pool(2);
+    Reactor reactor(pool);
+    set<string> everything;
+    for (int n = 0; n < 4; n++) {
+        for (int i = 0; i < 200; i++) everything.insert("s" + to_string(n) + "_" + to_string(i));
+    }
+    PolledServers servers(4, 200);
+    uint16_t port = servers.nodes[0]->listen_port();
+
+    AsyncReplica local("L");
+    AsyncPeer peer(reactor, "127.0.0.1", port);
+    size_t full_bytes = sync_wait(pool, sync_with(local, peer, SyncStrategy::Full));
+    runner.assert_true(local.contains("s0_199") && local.copy().size() == 200, "Awaited full-state pull");
+
+    local.add("mine");
+    size_t delta_bytes = sync_wait(pool, sync_with(local, peer, SyncStrategy::Delta));
+    sync_wait(pool, sync_with(local, peer, SyncStrategy::Digest));
+    runner.assert_true(delta_bytes < full_bytes / 10 && local.contains("mine") && local.copy().size() == 201,
+                       "Delta and digest pulls on the reused connection");
+
+    // many syncs in flight on two threads
+    AsyncReplica merged("M");
+    vector<unique_ptr<AsyncPeer>> peers;
+    vector<Task<size_t>> syncs;
+    for (int i = 0; i < 32; i++) {
+        peers.push_back(make_unique<AsyncPeer>(reactor, "127.0.0.1", servers.nodes[i % 4]->listen_port()));
+        syncs.push_back(sync_with(merged, *peers.back(), SyncStrategy::Full));
+    }
+    vector<size_t> sizes = sync_wait(pool, when_all(pool, move(syncs)));
+    runner.assert_true(sizes.size() == 32 && merged.copy().elements() == everything,
+                       "Concurrent syncs on a two-thread pool");
+
+    uint16_t closed_port;
+    {
+        ReplicationNode gone("G");
+        closed_port = gone.listen_port();
+    }
+    AsyncPeer missing(reactor, "127.0.0.1", closed_port);
+    bool thrown = false;
+    try {
+        sync_wait(pool, sync_with(local, missing));
+    } catch (const runtime_error&) {
+        thrown = true;
+    }
+    runner.assert_true(thrown && !missing.connected(), "Connection errors reach the awaiter");
+
+    int fds[2];
+    if (pipe(fds) < 0) throw runtime_error("pipe failed");
+    AsyncConnection reader(reactor, fds[0]);
+    auto writer = make_unique<AsyncConnection>(reactor, fds[1]);
+    AsyncReplica streamed("T");
+    sync_wait(pool, send_state(local, *writer));
+    writer.reset();
+    bool first = sync_wait(pool, merge_from(streamed, reader));
+    bool second = sync_wait(pool, merge_from(streamed, reader));
+    runner.assert_true(first && !second && streamed.contains("mine"), "merge_from reads states off a stream");
+
+    char dir[] = "/tmp/orset_async_XXXXXX";
+    if (!mkdtemp(dir)) throw runtime_error("mkdtemp failed");
+    string path = string(dir) + "/snapshot";
+    sync_wait(pool, save_snapshot(reactor, merged, path));
+    ORSet loaded = sync_wait(pool, load_snapshot(reactor, path));
+    runner.assert_true(loaded.elements() == everything, "Async snapshot save and load");
+
+    // tasks made from temporary paths and awaited later own their arguments
+    vector<Task<ORSet>> loads;
+    for (int i = 0; i < 4; i++) loads.push_back(load_snapshot(reactor, string(dir) + "/snapshot"));
+    vector<ORSet> all_loaded = sync_wait(pool, when_all(pool, move(loads)));
+    runner.assert_true(all_loaded.size() == 4 && all_loaded[3].elements() == everything,
+                       "Deferred tasks keep their temporary arguments");
+    filesystem::remove_all(dir);
+}
+#endif
+
+void test_ingest_pipeline(TestRunner& runner) {
+    cout << "\n=== Ingest Pipeline Tests ===\n";
+
+    ORSet base("T");
+    for (int i = 0; i < 50; i++) base.add("t" + to_string(i));
+    vector<ORSet> senders;
+    for (int n = 0; n < 6; n++) {
+        senders.emplace_back("P" + to_string(n));
+        for (int i = 0; i < 40; i++) senders.back().add("p" + to_string((n * 25 + i) % 120));
+        if (n % 2) senders.back().remove("p" + to_string(n * 25));
+    }
+    senders[3].merge(senders[2]);
+    ORSet serial = base;
+    size_t sent_pairs = 0;
+    for (const auto &s : senders) {
+        serial.merge(s);
+        sent_pairs += 2 * s.internal_size();
+    }
+
+    for (size_t threads : {size_t(1), size_t(3)}) {
+        IngestPipeline::Options options;
+        options.decoders = threads;
+        options.filters = threads;
+        options.queue_capacity = 2;
+        options.max_batch = 3;
+        IngestPipeline pipeline(base, options);
+        for (int round = 0; round < 2; round++) {
+            for (const auto &s : senders) pipeline.submit(ORSetCodec::encode(s));
+        }
+        pipeline.submit("not an encoded state");
+        pipeline.drain();
+        auto stats = pipeline.get_stats();
+        bool same = pipeline.with_target([&](const ORSet& t) {
+            return t.elements() == serial.elements() && t.summary() == serial.summary();
+        });
+        runner.assert_true(same && stats.applied + stats.dropped == 12 && stats.rejected == 1,
+                           "Pipeline with " + to_string(threads) + " thread(s) per stage matches serial merges");
+        runner.assert_true(stats.pairs_decoded < sent_pairs && stats.batches <= stats.applied,
+                           "Pipeline filters known pairs before applying (" + to_string(threads) + ")");
+    }
+
+    // a resent state is dropped once its first copy is applied
+    IngestPipeline pipeline(base);
+    pipeline.submit(ORSetCodec::encode(senders[0]));
+    pipeline.drain();
+    pipeline.submit(ORSetCodec::encode(senders[0]));
+    pipeline.drain();
+    runner.assert_true(pipeline.get_stats().dropped == 1 && pipeline.get_stats().applied == 1,
+                       "Pipeline drops states with nothing new");
+
+    // the sender is acknowledged with its whole summary, not the delta's
+    ORSet member("T");
+    member.add_member("T");
+    member.add_member("P");
+    ORSet peer("P");
+    member.add("shared");
+    peer.merge(member);
+    peer.add("new");
+    IngestPipeline acking(member);
+    acking.submit(ORSetCodec::encode(peer));
+    acking.drain();
+    bool acked = acking.with_target([&](const ORSet& t) { return t.stable_vv() == peer.summary(); });
+    runner.assert_true(acked, "Pipeline acknowledges senders with their full summary");
+
+    SpscQueue<int> queue(3);
+    int pushed = 0, value = 0;
+    while (queue.try_push(value)) value = ++pushed;
+    bool fifo = true;
+    for (int i = 0; i < pushed; i++) fifo = fifo && queue.try_pop(value) && value == i;
+    runner.assert_true(pushed == 4 && fifo && !queue.try_pop(value), "SpscQueue is bounded and FIFO");
+}
+
+void test_frozen_orset(TestRunner& runner) {
+    cout << "\n=== Frozen ORSet Tests ===\n";
+
+    ORSet A("A"), B("B");
+    for (int i = 0; i < 5000; i++) A.add("item_" + to_string(i));
+    B.merge(A);
+    for (int i = 0; i < 100; i++) B.remove("item_" + to_string(i));
+    B.add(string(300, 'x'));
+    B.add("");
+    A.merge(B);
+
+    FrozenORSet frozen = FrozenORSet::freeze(A);
+    bool all = frozen.size() == A.size();
+    set<size_t> slots;
+    for (const auto &element : A.elements()) {
+        all = all && frozen.contains(element);
+        slots.insert(frozen.slot(element));
+    }
+    runner.assert_true(all && slots.size() == A.size() && *slots.rbegin() == A.size() - 1,
+                       "Every element gets its own slot in [0, n)");
+    bool none = true;
+    for (int i = 0; i < 100; i++) none = none && !frozen.contains("item_" + to_string(i));
+    for (int i = 5000; i < 10000; i++) none = none && !frozen.contains("item_" + to_string(i));
+    runner.assert_true(none && frozen.slot("missing") == frozen.size(), "Removed and unknown elements are absent");
+    runner.assert_true(frozen.elements() == A.elements(), "Frozen elements match the set");
+
+    FrozenORSet::Options options;
+    options.fingerprints = true;
+    FrozenORSet checked = FrozenORSet::freeze(A, options);
+    options.keys = false;
+    FrozenORSet bare = FrozenORSet::freeze(A, options);
+    size_t false_positives = 0;
+    all = true;
+    for (const auto &element : A.elements()) all = all && checked.contains(element) && bare.contains(element);
+    for (int i = 5000; i < 55000; i++) {
+        all = all && !checked.contains("item_" + to_string(i));
+        false_positives += bare.contains("item_" + to_string(i));
+    }
+    runner.assert_true(all && false_positives < 10 && bare.memory_bytes() < checked.memory_bytes() / 4,
+                       "Fingerprints alone answer contains() with rare false positives");
+    bool rejected = false;
+    try {
+        bare.elements();
+    } catch (const logic_error&) {
+        rejected = true;
+    }
+    runner.assert_true(rejected, "Elements need the keys kept");
+
+    ORSet empty("E");
+    runner.assert_true(FrozenORSet::freeze(empty).size() == 0 && !FrozenORSet::freeze(empty).contains(""),
+                       "Empty set freezes");
+}
+
+void test_ormap_operations(TestRunner& runner) {
+    cout << "\n=== OR-Map Tests ===\n";
+
+    ORMap<PNCounter> A("A"), B("B");
+
+    // Nested values merge per key
+    A.update("hits", [](PNCounter& c) { c.increment(3); });
+    B.update("hits", [](PNCounter& c) { c.increment(2); });
+    A.merge(B);
+    B.merge(A);
+    runner.assert_true(A.get("hits") && A.get("hits")->value() == 5, "Nested counters merge");
+    runner.assert_true(A.internal_size() == 2, "One dot per replica per key");
+
+    A.update("hits", [](PNCounter& c) { c.increment(); });
+    runner.assert_true(A.internal_size() == 2, "Update supersedes own dot");
+
+    // Remove propagates through merge
+    B.update("misses", [](PNCounter& c) { c.decrement(); });
+    A.merge(B);
+    A.remove("misses");
+    B.merge(A);
+    runner.assert_true(!B.contains("misses"), "Key removal propagates");
+
+    // Concurrent update beats remove
+    A.remove("hits");
+    B.update("hits", [](PNCounter& c) { c.increment(); });
+    A.merge(B);
+    B.merge(A);
+    runner.assert_true(A.contains("hits") && B.contains("hits"), "Add-wins for keys");
+    runner.assert_true(A.keys() == B.keys(), "Maps converged");
+
+    // A key first learned through merge is updated under the local replica
+    ORMap<PNCounter> C("C"), D("D");
+    D.update("k", [](PNCounter& c) { c.increment(); });
+    C.merge(D);
+    C.update("k", [](PNCounter& c) { c.increment(); });
+    D.update("k", [](PNCounter& c) { c.increment(); });
+    C.merge(D);
+    D.merge(C);
+    runner.assert_true(C.get("k")->value() == 3 && D.get("k")->value() == 3, "Merged-in counter keeps local slot");
+
+    // Registers and nested sets
+    ORMap<LWWRegister> R1("A"), R2("B");
+    R1.update("owner", [](LWWRegister& r) { r.set("alice"); });
+    R2.merge(R1);
+    R2.update("owner", [](LWWRegister& r) { r.set("bob"); });
+    R1.merge(R2);
+    runner.assert_true(R1.get("owner")->get() == "bob", "Register last write wins");
+
+    ORMap<ORSet> S1("A"), S2("B");
+    S1.update("tags", [](ORSet& s) { s.add("red"); });
+    S2.update("tags", [](ORSet& s) { s.add("blue"); });
+    S1.merge(S2);
+    runner.assert_true(S1.get("tags")->size() == 2, "Nested OR-Sets merge");
+
+    ORMap<ORSet> S3("C"), S4("D");
+    S4.update("tags", [](ORSet& s) { s.add("a"); });
+    S3.merge(S4);
+    S3.update("tags", [](ORSet& s) { s.add("b"); });
+    S4.update("tags", [](ORSet& s) { s.add("c"); });
+    S3.merge(S4);
+    S4.merge(S3);
+    runner.assert_true(S3.get("tags")->elements() == set<string>{"a", "b", "c"} &&
+                       S4.get("tags")->elements() == S3.get("tags")->elements(),
+                       "Merged-in nested OR-Set issues its own dots");
+
+    // Deltas: an interval's updates and removes joined into one small map
+    ORMap<PNCounter> E("E"), F("F"), delta("E");
+    E.update("x", [](PNCounter& c) { c.increment(); });
+    F.merge(E);
+    E.update("x", [](PNCounter& c) { c.increment(4); }, delta);
+    E.update("y", [](PNCounter& c) { c.decrement(); }, delta);
+    E.remove("y", delta);
+    E.update("z", [](PNCounter& c) { c.increment(); }, delta);
+    F.merge(delta);
+    runner.assert_true(F.keys() == E.keys() && F.get("x")->value() == 5 && delta.internal_size() == 2,
+                       "Joined map deltas apply like the full state");
+
+    // Codec round trip of every nested value type
+    ORMap<PNCounter> decoded = ORMapCodec::decode<PNCounter>(ORMapCodec::encode(F));
+    decoded.update("x", [](PNCounter& c) { c.increment(); });
+    E.merge(decoded);
+    runner.assert_true(E.keys() == F.keys() && E.get("x")->value() == 6 && decoded.get_counter() == F.get_counter() + 1,
+                       "Decoded map keeps its dots, context and counters");
+    ORMap<LWWRegister> R3 = ORMapCodec::decode<LWWRegister>(ORMapCodec::encode(R1));
+    ORMap<ORSet> S5 = ORMapCodec::decode<ORSet>(ORMapCodec::encode(S3));
+    runner.assert_true(R3.get("owner")->get() == "bob" && S5.get("tags")->elements() == S3.get("tags")->elements() &&
+                       ORMapCodec::encode(S5) == ORMapCodec::encode(S3),
+                       "Registers and nested sets round trip");
+    string bytes = ORMapCodec::encode(F);
+    bool truncated_rejected = false;
+    try {
+        ORMapCodec::decode<PNCounter>(string_view(bytes).substr(0, bytes.size() - 1));
+    } catch (const runtime_error&) {
+        truncated_rejected = true;
+    }
+    runner.assert_true(truncated_rejected, "Truncated map is rejected");
+    ByteWriter wide;
+    wide.put_bytes("ORM", 3);
+    wide.put_u8(ORMapCodec::kVersion);
+    wide.put_string("A");
+    wide.put_varint(0);
+    wide.put_varint(uint64_t(1) << 40);
+    bool wide_rejected = false;
+    try {
+        ORMapCodec::decode<PNCounter>(wide.buffer);
+    } catch (const runtime_error&) {
+        wide_rejected = true;
+    }
+    runner.assert_true(wide_rejected, "Oversized map dictionary is rejected");
+}
+
+void test_clset_operations(TestRunner& runner) {
+    cout << "\n=== Causal-Length Set Tests ===\n";
+
+    CLSet A("A"), B("B");
+
+    A.add("apple");
+    A.add("apple"); // no-op while present
+    runner.assert_true(A.contains("apple") && A.length("apple") == 1, "Add sets odd length");
+
+    A.remove("apple");
+    A.add("apple");
+    runner.assert_true(A.length("apple") == 3, "Churn only bumps the length");
+    runner.assert_true(A.internal_size() == 1, "One counter per element");
+
+    B.add("banana");
+    A.merge(B);
+    B.merge(A);
+    runner.assert_true(A.elements() == B.elements() && A.size() == 2, "Merge converges");
+
+    B.remove("apple");
+    A.merge(B);
+    runner.assert_true(!A.contains("apple") && A.size() == 1, "Remove propagates via max");
+
+    // Concurrent re-add at a higher length wins
+    A.add("apple");
+    B.remove("banana");
+    A.merge(B);
+    B.merge(A);
+    runner.assert_true(A.contains("apple") && !A.contains("banana"), "Longest history wins");
+    runner.assert_true(A.elements() == B.elements(), "Replicas converged");
+}
+
 // ============= BENCHMARKS =============
 
 struct BenchmarkResult {
+    string backend;
     string name;
     double avg_time_ms;
     size_t operations;
     double ops_per_sec;
 };
 
-void benchmark_add_operations(vector<BenchmarkResult>& results) {
-    cout << "\n=== Benchmarking Add Operations ===\n";
+template <typename Set>
+void benchmark_add_operations(const string& backend, vector<BenchmarkResult>& results) {
+    cout << "\n=== Benchmarking Add Operations [" << backend << "] ===\n";
 
     vector<int> sizes = {100, 1000, 10000, 100000};
 
     for (int n : sizes) {
-        ORSet set("bench");
+        Set set("bench");
 
         auto start = high_resolution_clock::now();
 
@@ -181,6 +1499,7 @@ void benchmark_add_operations(vector<BenchmarkResult>& results) {
         double ops_per_sec = (n / time_ms) * 1000.0;
 
         BenchmarkResult result{
+            backend,
             "Add " + to_string(n) + " elements",
             time_ms,
             (size_t)n,
@@ -193,13 +1512,14 @@ void benchmark_add_operations(vector<BenchmarkResult>& results) {
     }
 }
 
-void benchmark_contains_operations(vector<BenchmarkResult>& results) {
-    cout << "\n=== Benchmarking Contains Operations ===\n";
+template <typename Set>
+void benchmark_contains_operations(const string& backend, vector<BenchmarkResult>& results) {
+    cout << "\n=== Benchmarking Contains Operations [" << backend << "] ===\n";
 
     vector<int> sizes = {100, 1000, 10000, 100000};
 
     for (int n : sizes) {
-        ORSet set("bench");
+        Set set("bench");
 
         // Populate set
         for (int i = 0; i < n; i++) {
@@ -208,18 +1528,21 @@ void benchmark_contains_operations(vector<BenchmarkResult>& results) {
 
         auto start = high_resolution_clock::now();
 
-        // Test contains
+        // Test contains; count hits so the lookups cannot be optimized away
+        size_t hits = 0;
         for (int i = 0; i < n; i++) {
-            set.contains("element_" + to_string(i));
+            hits += set.contains("element_" + to_string(i));
         }
 
         auto end = high_resolution_clock::now();
+        if (hits != (size_t)n) cout << "[WARN] " << backend << " missed lookups\n";
         auto duration = duration_cast<microseconds>(end - start);
 
         double time_ms = duration.count() / 1000.0;
         double ops_per_sec = (n / time_ms) * 1000.0;
 
         BenchmarkResult result{
+            backend,
             "Contains " + to_string(n) + " lookups",
             time_ms,
             (size_t)n,
@@ -232,13 +1555,14 @@ void benchmark_contains_operations(vector<BenchmarkResult>& results) {
     }
 }
 
-void benchmark_merge_operations(vector<BenchmarkResult>& results) {
-    cout << "\n=== Benchmarking Merge Operations ===\n";
+template <typename Set>
+void benchmark_merge_operations(const string& backend, vector<BenchmarkResult>& results) {
+    cout << "\n=== Benchmarking Merge Operations [" << backend << "] ===\n";
 
     vector<int> sizes = {100, 1000, 10000, 50000};
 
     for (int n : sizes) {
-        ORSet A("A"), B("B");
+        Set A("A"), B("B");
 
         // Populate both sets
         for (int i = 0; i < n; i++) {
@@ -254,6 +1578,7 @@ void benchmark_merge_operations(vector<BenchmarkResult>& results) {
         double time_ms = duration.count() / 1000.0;
 
         BenchmarkResult result{
+            backend,
             "Merge sets of " + to_string(n) + " elements",
             time_ms,
             (size_t)n,
@@ -265,13 +1590,110 @@ void benchmark_merge_operations(vector<BenchmarkResult>& results) {
     }
 }
 
-void benchmark_remove_operations(vector<BenchmarkResult>& results) {
-    cout << "\n=== Benchmarking Remove Operations ===\n";
+struct MergeCase {
+    string backend;
+    int overlap_percent;
+    int tags_per_element;
+    int size_ratio;
+    size_t large_pairs;
+    size_t small_pairs;
+    double time_ms;
+};
+
+// State holding `names` with `tags` tags each: one replica per tag adds every
+// name, then they are merged pairwise as a tree so building stays cheap.
+template <typename Set>
+Set build_tagged_state(const string& prefix, const vector<string>& names, int tags) {
+    vector<Set> level;
+    for (int t = 0; t < tags; t++) {
+        level.emplace_back(prefix + to_string(t));
+        for (const auto &name : names) level.back().add(name);
+    }
+    while (level.size() > 1) {
+        vector<Set> next_level;
+        for (size_t i = 0; i + 1 < level.size(); i += 2) {
+            level[i].merge(level[i + 1]);
+            next_level.push_back(move(level[i]));
+        }
+        if (level.size() % 2) next_level.push_back(move(level.back()));
+        level = move(next_level);
+    }
+    return level.front();
+}
+
+// Merge of a small state into a large one across three axes:
+//   overlap   - share of the small side's elements also present on the large side
+//   tags      - concurrent tags per element on both sides
+//   ratio     - large:small element count, from peers of equal size down to a
+//               small delta folded into a big state
+// Each case is timed on fresh copies, best of three.
+template <typename Set>
+void benchmark_merge_matrix(const string& backend, vector<MergeCase>& cases) {
+    cout << "\n=== Merge Matrix [" << backend << "] ===\n";
+
+    const int large_elements = 1000;
+    vector<int> overlaps = {0, 25, 50, 75, 100};
+    vector<int> tag_counts = {1, 4, 16, 64};
+    vector<int> ratios = {1, 10, 100, 1000};
+
+    vector<string> large_names;
+    for (int i = 0; i < large_elements; i++) large_names.push_back("element_" + to_string(i));
+
+    cout << "ms at 50% overlap; rows tags/element, columns large:small\n";
+    cout << "tags";
+    for (int ratio : ratios) cout << "\t1:" << ratio;
+    cout << "\n";
+
+    for (int tags : tag_counts) {
+        Set large = build_tagged_state<Set>("L", large_names, tags);
+        cout << tags;
+        for (int ratio : ratios) {
+            int small_elements = max(1, large_elements / ratio);
+            for (int overlap : overlaps) {
+                int shared = small_elements * overlap / 100;
+                vector<string> small_names(large_names.begin(), large_names.begin() + shared);
+                for (int i = shared; i < small_elements; i++) small_names.push_back("fresh_" + to_string(i));
+                Set small = build_tagged_state<Set>("S", small_names, tags);
+
+                double best_ms = numeric_limits<double>::max();
+                for (int rep = 0; rep < 3; rep++) {
+                    Set target = large;
+                    auto start = high_resolution_clock::now();
+                    target.merge(small);
+                    auto end = high_resolution_clock::now();
+                    best_ms = min(best_ms, duration_cast<nanoseconds>(end - start).count() / 1e6);
+                }
+                cases.push_back({backend, overlap, tags, ratio, large.internal_size(),
+                                 small.internal_size(), best_ms});
+                if (overlap == 50) cout << "\t" << best_ms;
+            }
+        }
+        cout << "\n";
+    }
+}
+
+void save_merge_matrix_to_file(const vector<MergeCase>& cases) {
+    ofstream out("crdt_merge_matrix.csv");
+    out << "Backend,Overlap(%),TagsPerElement,SizeRatio,LargePairs,SmallPairs,Time(ms),Pairs/Sec\n";
+
+    for (const auto& c : cases) {
+        out << c.backend << "," << c.overlap_percent << "," << c.tags_per_element << ",1:"
+            << c.size_ratio << "," << c.large_pairs << "," << c.small_pairs << "," << c.time_ms
+            << "," << ((c.large_pairs + c.small_pairs) / max(c.time_ms, 1e-6)) * 1000.0 << "\n";
+    }
+
+    out.close();
+    cout << "[INFO] Merge matrix saved to crdt_merge_matrix.csv\n";
+}
+
+template <typename Set>
+void benchmark_remove_operations(const string& backend, vector<BenchmarkResult>& results) {
+    cout << "\n=== Benchmarking Remove Operations [" << backend << "] ===\n";
 
     vector<int> sizes = {100, 1000, 10000, 50000};
 
     for (int n : sizes) {
-        ORSet set("bench");
+        Set set("bench");
 
         // Populate set
         for (int i = 0; i < n; i++) {
@@ -292,6 +1714,7 @@ void benchmark_remove_operations(vector<BenchmarkResult>& results) {
         double ops_per_sec = (n / time_ms) * 1000.0;
 
         BenchmarkResult result{
+            backend,
             "Remove " + to_string(n) + " elements",
             time_ms,
             (size_t)n,
@@ -304,39 +1727,1364 @@ void benchmark_remove_operations(vector<BenchmarkResult>& results) {
     }
 }
 
-void benchmark_memory_usage() {
-    cout << "\n=== Memory Usage Analysis ===\n";
+struct MemoryResult {
+    string backend;
+    size_t elements;
+    size_t internal_pairs;
+    size_t heap_bytes;
+};
+
+template <typename Set>
+void benchmark_memory_usage(const string& backend, vector<MemoryResult>& memory) {
+    cout << "\n=== Memory Usage Analysis [" << backend << "] ===\n";
 
     vector<int> sizes = {1000, 10000, 100000};
 
     for (int n : sizes) {
-        ORSet set("bench");
+        size_t heap_before = live_heap_bytes.load();
+        Set set("bench");
 
         for (int i = 0; i < n; i++) {
             set.add("element_" + to_string(i));
         }
 
-        // Approximate memory usage
         size_t internal_pairs = set.internal_size();
         size_t cached_elements = set.size();
-
-        // Rough estimate: each pair ~(string + Tag) = ~50 bytes avg
-        // each cached string ~30 bytes avg
-        size_t estimated_memory = (internal_pairs * 50) + (cached_elements * 30);
+        size_t heap_bytes = live_heap_bytes.load() - heap_before;
+        memory.push_back({backend, (size_t)n, internal_pairs, heap_bytes});
 
         cout << "Set with " << n << " elements:\n";
         cout << "  Internal pairs: " << internal_pairs << "\n";
         cout << "  Unique elements: " << cached_elements << "\n";
-        cout << "  Est. memory: " << (estimated_memory / 1024.0) << " KB\n";
+        cout << "  Heap memory: " << (heap_bytes / 1024.0) << " KB\n";
+    }
+}
+
+// Makes every replica a member of the group on backends that track
+// stability, so they prune as a deployment with a known group would
+template <typename Set>
+auto declare_group(vector<Set>& replicas, int) -> decltype(replicas[0].add_member(""), void()) {
+    for (auto &replica : replicas) {
+        for (size_t r = 0; r < replicas.size(); r++) replica.add_member("R" + to_string(r));
+    }
+}
+
+template <typename Set>
+void declare_group(vector<Set>&, long) {}
+
+// Replicas churn add/remove over a fixed key space and sync pairwise; reports
+// the heap held by one replica and the time of a full pairwise merge round.
+template <typename Set>
+void run_churn_workload(const string& backend, int keys, int cycles,
+                        vector<BenchmarkResult>& results) {
+    const int replica_count = 4;
+    mt19937 rng(42);
+
+    size_t heap_before = live_heap_bytes.load();
+    vector<Set> replicas;
+    for (int r = 0; r < replica_count; r++) {
+        replicas.emplace_back("R" + to_string(r));
+    }
+    declare_group(replicas, 0);
+
+    for (int c = 0; c < cycles; c++) {
+        for (auto &replica : replicas) {
+            for (int i = 0; i < keys / 10; i++) {
+                string key = "key_" + to_string(rng() % keys);
+                if (rng() % 2) replica.add(key); else replica.remove(key);
+            }
+        }
+        for (int r = 0; r < replica_count; r++) {
+            replicas[r].merge(replicas[(r + 1) % replica_count]);
+        }
+    }
+    size_t heap_bytes = (live_heap_bytes.load() - heap_before) / replica_count;
+
+    auto start = high_resolution_clock::now();
+    for (int r = 0; r < replica_count; r++) {
+        replicas[r].merge(replicas[(r + 2) % replica_count]);
+    }
+    auto end = high_resolution_clock::now();
+    double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+
+    BenchmarkResult result{
+        backend,
+        "Churn merge " + to_string(keys) + " keys",
+        time_ms,
+        (size_t)keys * replica_count,
+        (keys * replica_count / max(time_ms, 0.001)) * 1000.0
+    };
+    results.push_back(result);
+
+    cout << backend << " (" << keys << " keys, " << cycles << " cycles): "
+         << replicas[0].internal_size() << " metadata entries, "
+         << (heap_bytes / 1024.0) << " KB per replica, merge round "
+         << time_ms << " ms" << endl;
+}
+
+// A few hot keys re-added over and over on every replica with periodic
+// merges; metadata should track keys x replicas, not the number of adds.
+template <typename Set>
+void benchmark_hot_key_readds(const string& backend, vector<BenchmarkResult>& results) {
+    cout << "\n=== Benchmarking Hot-Key Re-adds [" << backend << "] ===\n";
+
+    const int replica_count = 4, keys = 100, rounds = 200;
+    vector<Set> replicas;
+    for (int r = 0; r < replica_count; r++) {
+        replicas.emplace_back("R" + to_string(r));
+    }
+    declare_group(replicas, 0);
+
+    auto start = high_resolution_clock::now();
+    for (int round = 1; round <= rounds; round++) {
+        for (auto &replica : replicas) {
+            for (int k = 0; k < keys; k++) replica.add("hot_" + to_string(k));
+        }
+        for (int r = 0; r < replica_count; r++) {
+            replicas[r].merge(replicas[(r + 1) % replica_count]);
+        }
+        if (round % 50 == 0) {
+            cout << "  round " << round << ": internal_size " << replicas[0].internal_size()
+                 << " (" << keys << " keys, " << round * keys << " adds per replica)\n";
+        }
+    }
+    auto end = high_resolution_clock::now();
+    double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+    size_t ops = (size_t)replica_count * keys * rounds;
+
+    results.push_back({backend, "Hot-key re-adds " + to_string(ops) + " ops", time_ms, ops,
+                       (ops / time_ms) * 1000.0});
+    cout << "Hot-key re-adds: " << time_ms << " ms, final internal_size "
+         << replicas[0].internal_size() << endl;
+}
+
+template <typename Set>
+void benchmark_churn_operations(const string& backend, vector<BenchmarkResult>& results) {
+    cout << "\n=== Benchmarking Churn [" << backend << "] ===\n";
+
+    for (int keys : {1000, 10000}) {
+        run_churn_workload<Set>(backend, keys, 50, results);
+    }
+}
+
+// Op-based replication with every op broadcast to all replicas. With
+// compaction, acks are exchanged every few rounds and stable metadata is
+// dropped; without it the retransmission log keeps every op ever issued.
+void benchmark_op_based_stability(vector<BenchmarkResult>& results) {
+    cout << "\n=== Op-Based Mode: Causal Stability Compaction [ORSet] ===\n";
+
+    for (bool compact : {false, true}) {
+        const int replica_count = 4, keys = 1000, rounds = 200, ops_per_round = 100;
+        mt19937 rng(11);
+        size_t heap_before = live_heap_bytes.load();
+        vector<ORSet> replicas;
+        for (int r = 0; r < replica_count; r++) replicas.emplace_back("R" + to_string(r));
+        for (auto &replica : replicas) {
+            for (int o = 0; o < replica_count; o++) replica.add_member("R" + to_string(o));
+        }
+
+        auto start = high_resolution_clock::now();
+        for (int round = 1; round <= rounds; round++) {
+            for (int r = 0; r < replica_count; r++) {
+                for (int i = 0; i < ops_per_round; i++) {
+                    string key = "key_" + to_string(rng() % keys);
+                    ORSetOp op = rng() % 3 ? replicas[r].add_op(key) : replicas[r].remove_op(key);
+                    for (int o = 0; o < replica_count; o++) {
+                        if (o != r) replicas[o].deliver(op);
+                    }
+                }
+            }
+            if (compact && round % 10 == 0) {
+                for (int r = 0; r < replica_count; r++) {
+                    for (int o = 0; o < replica_count; o++) {
+                        if (o != r) replicas[r].acknowledge("R" + to_string(o), replicas[o].delivered_vv());
+                    }
+                }
+                for (auto &replica : replicas) replica.compact_stable();
+            }
+        }
+        auto end = high_resolution_clock::now();
+        double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+        size_t ops = (size_t)replica_count * rounds * ops_per_round;
+        size_t heap_bytes = (live_heap_bytes.load() - heap_before) / replica_count;
+
+        string name = compact ? "Op-based with stability compaction" : "Op-based without compaction";
+        results.push_back({"ORSet", name + " " + to_string(ops) + " ops", time_ms, ops,
+                           (ops / time_ms) * 1000.0});
+        cout << name << ": " << replicas[0].size() << " live elements, "
+             << replicas[0].internal_size() << " pairs, " << replicas[0].logged_op_count()
+             << " logged ops, " << (heap_bytes / 1024.0) << " KB per replica, "
+             << time_ms << " ms" << endl;
+    }
+}
+
+// A peer that already has most of the state, synced by shipping the full
+// encoded state or only what its summary says it is missing.
+void benchmark_summary_sync(vector<BenchmarkResult>& results) {
+    cout << "\n=== Summary-Based Sync vs Full State [ORSet] ===\n";
+
+    const int elements = 100000;
+    ORSet base("A");
+    for (int i = 0; i < elements; i++) base.add("item_" + to_string(i));
+    ORSet peer("B");
+    peer.merge(base);
+    base.add_member("B");
+    base.acknowledge("B", peer.summary()); // so base keeps removes until B has them
+
+    for (int changes : {10, 100, 1000, 10000}) {
+        ORSet source = base;
+        mt19937 rng(changes);
+        for (int i = 0; i < changes; i++) {
+            string key = "item_" + to_string(rng() % elements);
+            i % 2 ? source.remove(key) : source.add(key + "_new");
+        }
+
+        for (bool delta : {false, true}) {
+            ORSet target = peer;
+            auto start = high_resolution_clock::now();
+            string bytes = ORSetCodec::encode(delta ? source.missing_for(target.summary()) : source);
+            target.merge(ORSetCodec::decode(bytes));
+            auto end = high_resolution_clock::now();
+            double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+
+            string name = string(delta ? "Summary delta sync" : "Full state sync") + " (" +
+                          to_string(changes) + " changes)";
+            results.push_back({"ORSet", name, time_ms, (size_t)changes, (changes / time_ms) * 1000.0});
+            cout << name << ": " << bytes.size() << " bytes, " << time_ms << " ms"
+                 << (target.elements() == source.elements() ? "" : " [DIVERGED]") << endl;
+        }
+    }
+}
+
+// Delta-state replication on a full mesh of 4 replicas, one of which only
+// syncs every 10 ticks. Compares wire bytes with shipping the full state on
+// the same schedule, and shows the buffer staying under its cap.
+void benchmark_delta_buffer(vector<BenchmarkResult>& results) {
+    cout << "\n=== Delta Buffer Replication [ORSet] ===\n";
+
+    const int replica_count = 4, keys = 10000, ticks = 50, ops_per_tick = 500, slow_every = 10;
+    for (size_t cap : {numeric_limits<size_t>::max(), (size_t)64 * 1024}) {
+        vector<string> ids;
+        for (int r = 0; r < replica_count; r++) ids.push_back("R" + to_string(r));
+        vector<DeltaBuffer> replicas;
+        for (int r = 0; r < replica_count; r++) {
+            vector<string> peers;
+            for (int o = 0; o < replica_count; o++) {
+                if (o != r) peers.push_back(ids[o]);
+            }
+            replicas.emplace_back(ids[r], peers, cap);
+        }
+
+        mt19937 rng(5);
+        size_t delta_bytes = 0, full_bytes = 0, peak_buffer = 0;
+        auto start = high_resolution_clock::now();
+        for (int tick = 1; tick <= ticks; tick++) {
+            for (auto &replica : replicas) {
+                for (int i = 0; i < ops_per_tick; i++) {
+                    string key = "key_" + to_string(rng() % keys);
+                    rng() % 3 ? replica.add(key) : replica.remove(key);
+                }
+            }
+            for (int r = 0; r < replica_count; r++) {
+                size_t state_bytes = 0;
+                for (int o = 0; o < replica_count; o++) {
+                    bool slow = o == replica_count - 1 || r == replica_count - 1;
+                    if (o == r || (slow && tick % slow_every != 0)) continue;
+                    DeltaMessage message = replicas[r].prepare(ids[o]);
+                    delta_bytes += ORSetCodec::encode(message.payload).size();
+                    if (state_bytes == 0) {
+                        auto pause = high_resolution_clock::now();
+                        state_bytes = ORSetCodec::encode(replicas[r].get_state()).size();
+                        start += high_resolution_clock::now() - pause; // not part of the run
+                    }
+                    full_bytes += state_bytes;
+                    replicas[o].receive(message);
+                    replicas[r].acknowledge(ids[o], message.upto);
+                }
+                peak_buffer = max(peak_buffer, replicas[r].buffered_byte_count());
+            }
+        }
+        auto end = high_resolution_clock::now();
+        double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+        size_t ops = (size_t)replica_count * ticks * ops_per_tick;
+
+        size_t fallbacks = 0;
+        for (const auto &replica : replicas) fallbacks += replica.fallback_count();
+        string name = cap == numeric_limits<size_t>::max() ? "Delta buffer uncapped"
+                                                           : "Delta buffer 64KB cap";
+        results.push_back({"ORSet", name + " " + to_string(ops) + " ops", time_ms, ops,
+                           (ops / time_ms) * 1000.0});
+        cout << name << ": " << (double(delta_bytes) / ops) << " bytes/op (full state "
+             << (double(full_bytes) / ops) << "), peak buffer " << (peak_buffer / 1024.0) << " KB, "
+             << fallbacks << " full-state fallbacks, " << time_ms << " ms"
+             << (replicas[0].get_state().elements() == replicas[replica_count - 1].get_state().elements()
+                     ? "" : " [DIVERGED]")
+             << endl;
+    }
+}
+
+// A writer doing thousands of adds and removes between syncs, its deltas
+// joined into a plain ORSet or coalesced by a DeltaAccumulator. Measures
+// mutation time, encoded delta size and the receiver's merge time.
+void benchmark_delta_coalescing(vector<BenchmarkResult>& results) {
+    cout << "\n=== Delta Coalescing per Sync Interval [ORSet] ===\n";
+
+    const int keys = 2000, intervals = 20, ops_per_interval = 5000;
+    for (bool coalesce : {false, true}) {
+        ORSet writer("W"), reader("R");
+        mt19937 rng(9);
+        size_t bytes = 0;
+        double mutate_ms = 0, merge_ms = 0;
+        for (int interval = 0; interval < intervals; interval++) {
+            ORSet joined("W");
+            DeltaAccumulator accumulator("W");
+            auto start = high_resolution_clock::now();
+            for (int i = 0; i < ops_per_interval; i++) {
+                string key = "key_" + to_string(rng() % keys);
+                if (coalesce) {
+                    rng() % 2 ? writer.add(key, accumulator) : writer.remove(key, accumulator);
+                } else {
+                    rng() % 2 ? writer.add(key, joined) : writer.remove(key, joined);
+                }
+            }
+            ORSet delta = coalesce ? accumulator.take() : move(joined);
+            auto mid = high_resolution_clock::now();
+            string encoded = ORSetCodec::encode(delta);
+            auto decoded_start = high_resolution_clock::now();
+            reader.merge(ORSetCodec::decode(encoded));
+            auto end = high_resolution_clock::now();
+            bytes += encoded.size();
+            mutate_ms += duration_cast<microseconds>(mid - start).count() / 1000.0;
+            merge_ms += duration_cast<microseconds>(end - decoded_start).count() / 1000.0;
+        }
+        size_t ops = (size_t)intervals * ops_per_interval;
+
+        string name = coalesce ? "Coalesced deltas" : "Joined ORSet deltas";
+        results.push_back({"ORSet", name + " " + to_string(ops) + " ops", mutate_ms + merge_ms, ops,
+                           (ops / (mutate_ms + merge_ms)) * 1000.0});
+        cout << name << ": " << (double(bytes) / intervals) << " bytes/interval, mutate "
+             << mutate_ms << " ms, decode+merge " << merge_ms << " ms"
+             << (reader.elements() == writer.elements() ? "" : " [DIVERGED]") << endl;
+    }
+}
+
+// A writer under churn syncs two regular peers every round, and replicas
+// restored from an old backup join now and then; their summaries are
+// behind the writer's pruned removes. Compares the planner against always
+// shipping deltas (which falls back to the full state) or the full state.
+void benchmark_sync_planner(vector<BenchmarkResult>& results) {
+    cout << "\n=== Adaptive Sync Planning [ORSet] ===\n";
+
+    const int keys = 20000, rounds = 20, ops_per_round = 500;
+    const vector<pair<const char*, int>> policies = {{"Always delta", 0}, {"Always full", 1}, {"Planner", 2}};
+    for (const auto &policy : policies) {
+        ORSet writer("W"), B("B"), C("C");
+        writer.add_member("B");
+        writer.add_member("C");
+        for (int i = 0; i < keys; i++) writer.add("key_" + to_string(i));
+        B.merge(writer);
+        C.merge(writer);
+        writer.merge(B);
+        writer.merge(C);
+        ORSet backup = B;
+
+        SyncPlanner planner;
+        auto sync = [&](const string& to_id, ORSet& to) {
+            if (policy.second == 2) return planner.sync("W", writer, to_id, to);
+            return planner.sync("W", writer, to_id, to, policy.second ? SyncStrategy::Full : SyncStrategy::Delta);
+        };
+
+        mt19937 rng(13);
+        size_t bytes = 0;
+        bool diverged = false;
+        auto start = high_resolution_clock::now();
+        for (int round = 1; round <= rounds; round++) {
+            for (int i = 0; i < ops_per_round; i++) {
+                string key = "key_" + to_string(rng() % keys);
+                rng() % 3 ? writer.add(key) : writer.remove(key);
+            }
+            for (auto *peer : {&B, &C}) {
+                string id = peer == &B ? "B" : "C";
+                bytes += sync(id, *peer).bytes;
+                writer.acknowledge(id, peer->summary());
+            }
+            if (round % 5 == 0) {
+                ORSet joiner = backup;
+                bytes += sync("J" + to_string(round), joiner).bytes;
+                diverged |= joiner.elements() != writer.elements();
+            }
+        }
+        auto end = high_resolution_clock::now();
+        double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+        diverged |= B.elements() != writer.elements();
+
+        map<string, int> chosen;
+        for (const auto &decision : planner.log()) chosen[strategy_name(decision.strategy)]++;
+        size_t syncs = planner.log().size();
+        results.push_back({"ORSet", string(policy.first) + " sync " + to_string(syncs) + " syncs", time_ms, syncs,
+                           (syncs / time_ms) * 1000.0});
+        cout << policy.first << ": " << bytes / 1024.0 << " KB in " << syncs << " syncs (";
+        for (const auto &entry : chosen) cout << entry.first << " " << entry.second << " ";
+        cout << "), " << time_ms << " ms" << (diverged ? " [DIVERGED]" : "") << endl;
+
+        if (policy.second == 2) {
+            ofstream out("crdt_sync_plan_results.csv");
+            planner.write_csv(out);
+            cout << "[INFO] Sync decisions saved to crdt_sync_plan_results.csv\n";
+        }
+    }
+}
+
+// A replica restored from a backup pulls from a writer that has pruned the
+// removes since, so summary deltas are out. Full state, a bucket digest and
+// an IBLT pull compared on bytes, round trips, compute time, and the
+// transfer time they would take on a 150 ms RTT, 10 Mbit/s link.
+void benchmark_iblt_sync(vector<BenchmarkResult>& results) {
+    cout << "\n=== IBLT vs Digest vs Full State, Restored Peer [ORSet] ===\n";
+
+    const int elements = 100000;
+    const double rtt_ms = 150, bytes_per_ms = 10e6 / 8 / 1000;
+    for (int changes : {10, 100, 1000, 10000}) {
+        ORSet writer("W"), peer("P");
+        writer.add_member("P");
+        for (int i = 0; i < elements; i++) writer.add("item_" + to_string(i));
+        peer.merge(writer);
+        writer.merge(peer);
+        ORSet backup = peer;
+        mt19937 rng(changes);
+        for (int i = 0; i < changes; i++) {
+            string key = "item_" + to_string(rng() % elements);
+            i % 2 ? writer.remove(key) : writer.add(key + "_new");
+        }
+        peer.merge(writer.missing_for(peer.summary()));
+        writer.acknowledge("P", peer.summary());
+        writer.compact_stable();
+
+        for (const char* mode : {"Full state", "Digest", "IBLT"}) {
+            ORSet joiner = backup;
+            size_t bytes = 0, rounds = 1;
+            auto start = high_resolution_clock::now();
+            if (mode[0] == 'F') {
+                string payload = ORSetCodec::encode(writer);
+                joiner.merge(ORSetCodec::decode(payload));
+                bytes = payload.size();
+            } else if (mode[0] == 'D') {
+                SyncPlanner planner;
+                bytes = planner.sync("W", writer, "J", joiner, SyncStrategy::Digest).bytes;
+            } else {
+                auto pulled = IBLTSync::pull(writer, joiner,
+                                             IBLTSync::estimate_difference(writer.summary(), joiner.summary()));
+                bytes = pulled.bytes;
+                rounds = pulled.rounds;
+            }
+            auto end = high_resolution_clock::now();
+            double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+
+            string name = string(mode) + " pull (" + to_string(changes) + " changes)";
+            results.push_back({"ORSet", name, time_ms, (size_t)changes, (changes / time_ms) * 1000.0});
+            cout << name << ": " << bytes / 1024.0 << " KB, " << rounds << " round trip(s), " << time_ms
+                 << " ms compute, " << (rounds * rtt_ms + bytes / bytes_per_ms) << " ms on the link"
+                 << (joiner.elements() == writer.elements() ? "" : " [DIVERGED]") << endl;
+        }
+    }
+}
+
+// Distinct count over the union of 50 overlapping ORSets: exactly from their
+// elements() and approximately from their merged sketches, plus what
+// keeping a sketch adds to add().
+void benchmark_cardinality_sketch(vector<BenchmarkResult>& results) {
+    cout << "\n=== Union Cardinality: Exact vs HyperLogLog [ORSet] ===\n";
+
+    const int set_count = 50, per_set = 20000, key_space = 500000;
+    for (bool sketched : {false, true}) {
+        vector<ORSet> sets;
+        mt19937 rng(21);
+        auto start = high_resolution_clock::now();
+        for (int s = 0; s < set_count; s++) {
+            sets.emplace_back("S" + to_string(s));
+            if (sketched) sets.back().enable_sketch();
+            for (int i = 0; i < per_set; i++) sets.back().add("key_" + to_string(rng() % key_space));
+        }
+        auto end = high_resolution_clock::now();
+        double add_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+        size_t ops = (size_t)set_count * per_set;
+        string name = sketched ? "Add with sketch" : "Add without sketch";
+        results.push_back({"ORSet", name, add_ms, ops, (ops / add_ms) * 1000.0});
+        cout << name << ": " << add_ms << " ms for " << ops << " adds" << endl;
+        if (!sketched) continue;
+
+        start = high_resolution_clock::now();
+        unordered_set<string> distinct;
+        for (const auto &set : sets) {
+            for (const auto &element : set.elements()) distinct.insert(element);
+        }
+        end = high_resolution_clock::now();
+        double exact_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+
+        start = high_resolution_clock::now();
+        vector<const HyperLogLog*> sketches;
+        for (const auto &set : sets) sketches.push_back(&*set.cardinality_sketch());
+        double estimate = HyperLogLog::union_estimate(sketches);
+        end = high_resolution_clock::now();
+        double sketch_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+
+        results.push_back({"ORSet", "Exact union count", exact_ms, (size_t)set_count, (set_count / exact_ms) * 1000.0});
+        results.push_back({"ORSet", "HLL union estimate", sketch_ms, (size_t)set_count,
+                           (set_count / sketch_ms) * 1000.0});
+        cout << "Exact union of " << set_count << " sets: " << distinct.size() << " in " << exact_ms << " ms\n";
+        cout << "HLL union estimate: " << llround(estimate) << " ("
+             << 100.0 * (estimate - distinct.size()) / distinct.size() << "% off) in " << sketch_ms << " ms, "
+             << sketches[0]->serialize().size() << " bytes per sketch\n";
+    }
+}
+
+// "Already converged?" on two 100K-element replicas: comparing elements()
+// against comparing state fingerprints and summaries.
+void benchmark_convergence_check(vector<BenchmarkResult>& results) {
+    cout << "\n=== Convergence Check: elements() vs Fingerprint [ORSet] ===\n";
+
+    ORSet A("A"), B("B");
+    for (int i = 0; i < 100000; i++) (i % 2 ? A : B).add("item_" + to_string(i));
+    A.merge(B);
+    B.merge(A);
+
+    for (bool fingerprint : {false, true}) {
+        const int checks = fingerprint ? 1000000 : 20;
+        size_t equal = 0;
+        auto start = high_resolution_clock::now();
+        for (int i = 0; i < checks; i++) {
+            equal += fingerprint ? A.state_fingerprint() == B.state_fingerprint() && A.summary() == B.summary()
+                                 : A.elements() == B.elements();
+        }
+        auto end = high_resolution_clock::now();
+        double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+
+        string name = fingerprint ? "Fingerprint convergence check" : "elements() convergence check";
+        results.push_back({"ORSet", name, time_ms, (size_t)checks, (checks / time_ms) * 1000.0});
+        cout << name << ": " << (time_ms * 1e6 / checks) << " ns per check"
+             << (equal == (size_t)checks ? "" : " [MISMATCH]") << endl;
+    }
+}
+
+// Shipping a whole state into a Unix socket drained by another thread: one
+// contiguous encode() copied into a frame, vs encode_segments() handed to
+// sendmsg(). Elements of 1 KB are referenced in place; with short elements
+// everything is copied either way, so both should cost about the same.
+void benchmark_segmented_send(vector<BenchmarkResult>& results) {
+    cout << "\n=== Segmented State Sends [ORSet] ===\n";
+
+    for (size_t element_bytes : {size_t(1000), size_t(12)}) {
+        const int count = element_bytes > 100 ? 20000 : 200000, reps = 10;
+        ORSet state("A");
+        for (int i = 0; i < count; i++) {
+            string element = to_string(i);
+            state.add(element + string(element_bytes - min(element_bytes, element.size()), 'x'));
+        }
+
+        for (bool segmented : {false, true}) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) throw runtime_error("socketpair failed");
+            atomic<size_t> drained{0};
+            thread reader([&]() {
+                vector<char> buffer(256 * 1024);
+                ssize_t n;
+                while ((n = read(fds[1], buffer.data(), buffer.size())) > 0) drained += n;
+            });
+
+            size_t sent = 0;
+            auto start = high_resolution_clock::now();
+            for (int r = 0; r < reps; r++) {
+                string frame, header(13, '\0');
+                SegmentWriter body;
+                vector<iovec> iov;
+                if (segmented) {
+                    body = ORSetCodec::encode_segments(state);
+                    iov.push_back({header.data(), header.size()});
+                    for (string_view segment : body.finish()) {
+                        iov.push_back({const_cast<char*>(segment.data()), segment.size()});
+                    }
+                } else {
+                    frame = header + ORSetCodec::encode(state);
+                    iov.push_back({frame.data(), frame.size()});
+                }
+                ssize_t n = send_segments(fds[0], iov);
+                if (n < 0) throw runtime_error("send failed");
+                sent += n;
+            }
+            shutdown(fds[0], SHUT_WR);
+            reader.join();
+            auto end = high_resolution_clock::now();
+            close(fds[0]);
+            close(fds[1]);
+
+            double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+            string name = string(segmented ? "Segmented send, " : "Contiguous send, ") + to_string(element_bytes) +
+                          "-byte elements";
+            results.push_back({"ORSet", name, time_ms, (size_t)reps, (reps / time_ms) * 1000.0});
+            cout << name << ": " << time_ms / reps << " ms per " << sent / reps / 1024 << " KB state, "
+                 << sent / 1048576.0 / (time_ms / 1000) << " MB/s" << (drained == sent ? "" : " [SHORT]") << endl;
+        }
+    }
+}
+
+// Durable adds on the local disk. Per add: time spent inside add() (the
+// mutating thread's stall) and the latency until the add is durable. The
+// blocking engine writes and syncs inside every add; io_uring hands the
+// batch to the kernel and returns, committing whatever gathered during the
+// previous sync in one batch. "wait each" waits for every add to be durable
+// before the next, the same guarantee as blocking. Then a snapshot of a
+// 100K-element state: how long snapshot() holds the caller, and until it is
+// durable.
+template <typename Engine>
+void benchmark_durable_store(vector<BenchmarkResult>& results, const string& engine, bool wait_each, int adds) {
+    char path[] = "/tmp/orset_store_XXXXXX";
+    if (!mkdtemp(path)) throw runtime_error("mkdtemp failed");
+    {
+        ORSetStore<Engine> store(path, "A");
+        store.wait_durable(0);
+        vector<pair<uint64_t, high_resolution_clock::time_point>> issued; // (position, time)
+        vector<double> latency_us;
+        size_t next = 0;
+        double stall_us = 0;
+        auto settle = [&](uint64_t durable) {
+            auto now = high_resolution_clock::now();
+            for (; next < issued.size() && issued[next].first <= durable; next++) {
+                latency_us.push_back(duration_cast<nanoseconds>(now - issued[next].second).count() / 1000.0);
+            }
+        };
+
+        auto start = high_resolution_clock::now();
+        for (int i = 0; i < adds; i++) {
+            auto before = high_resolution_clock::now();
+            uint64_t position = store.add("item_" + to_string(i));
+            stall_us += duration_cast<nanoseconds>(high_resolution_clock::now() - before).count() / 1000.0;
+            issued.push_back({position, before});
+            if (wait_each) store.wait_durable(position);
+            settle(store.durable_lsn());
+        }
+        while (next < issued.size()) {
+            store.wait_durable(store.durable_lsn() + 1);
+            settle(store.durable_lsn());
+        }
+        auto end = high_resolution_clock::now();
+        double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+
+        sort(latency_us.begin(), latency_us.end());
+        double mean = accumulate(latency_us.begin(), latency_us.end(), 0.0) / latency_us.size();
+        string name = "Durable add, " + engine + (wait_each ? ", wait each" : "");
+        results.push_back({"ORSet", name, time_ms, (size_t)adds, (adds / time_ms) * 1000.0});
+        cout << name << ": " << (adds / time_ms) * 1000.0 << " adds/sec, add() " << stall_us / adds
+             << " us, durable after " << mean << " us (p99 " << latency_us[latency_us.size() * 99 / 100]
+             << "), " << store.get_stats().batches << " batches" << endl;
+    }
+    filesystem::remove_all(path);
+}
+
+template <typename Engine>
+void benchmark_snapshot_write(vector<BenchmarkResult>& results, const string& engine) {
+    char path[] = "/tmp/orset_store_XXXXXX";
+    if (!mkdtemp(path)) throw runtime_error("mkdtemp failed");
+    {
+        ORSetStore<Engine> store(path, "A");
+        ORSet bulk("B");
+        for (int i = 0; i < 100000; i++) bulk.add("item_" + to_string(i));
+        store.wait_durable(store.merge(bulk));
+
+        auto start = high_resolution_clock::now();
+        store.snapshot();
+        auto returned = high_resolution_clock::now();
+        while (store.snapshot_pending()) this_thread::yield();
+        auto end = high_resolution_clock::now();
+        double call_ms = duration_cast<microseconds>(returned - start).count() / 1000.0;
+        double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+
+        string name = "Snapshot 100K elements, " + engine;
+        results.push_back({"ORSet", name, time_ms, 1, 1000.0 / time_ms});
+        cout << name << ": snapshot() returns after " << call_ms << " ms, durable after " << time_ms << " ms"
+             << endl;
+    }
+    filesystem::remove_all(path);
+}
+
+void benchmark_durable_store(vector<BenchmarkResult>& results) {
+    cout << "\n=== Durable Store: Blocking vs io_uring [ORSet] ===\n";
+    if (!UringEngine().async()) cout << "(io_uring unavailable: UringEngine runs blocking)\n";
+    benchmark_durable_store<BlockingEngine>(results, "blocking", false, 2000);
+    benchmark_durable_store<UringEngine>(results, "io_uring", true, 2000);
+    benchmark_durable_store<UringEngine>(results, "io_uring", false, 50000);
+    benchmark_snapshot_write<BlockingEngine>(results, "blocking");
+    benchmark_snapshot_write<UringEngine>(results, "io_uring");
+}
+
+#if defined(__cpp_impl_coroutine)
+// Delta pulls from 16 ReplicationNode servers, 100 elements each, polled by
+// their own threads. One client thread per peer, each waiting for its
+// replies, vs one coroutine per peer on a 2-thread pool.
+void benchmark_async_replication(vector<BenchmarkResult>& results) {
+    cout << "\n=== Coroutine Syncs vs Thread per Peer [ORSet] ===\n";
+
+    const int peers = 16, rounds = 500;
+    PolledServers servers(peers, 100);
+    for (bool coroutines : {false, true}) {
+        auto start = high_resolution_clock::now();
+        if (coroutines) {
+            ThreadPool pool(2);
+            Reactor reactor(pool);
+            vector<unique_ptr<AsyncReplica>> replicas;
+            vector<unique_ptr<AsyncPeer>> remotes;
+            vector<Task<size_t>> loops;
+            for (int p = 0; p < peers; p++) {
+                replicas.push_back(make_unique<AsyncReplica>("C" + to_string(p)));
+                remotes.push_back(make_unique<AsyncPeer>(reactor, "127.0.0.1", servers.nodes[p]->listen_port()));
+                loops.push_back([](AsyncReplica& local, AsyncPeer& peer, int count) -> Task<size_t> {
+                    size_t bytes = 0;
+                    for (int r = 0; r < count; r++) bytes += co_await sync_with(local, peer);
+                    co_return bytes;
+                }(*replicas.back(), *remotes.back(), rounds));
+            }
+            sync_wait(pool, when_all(pool, move(loops)));
+        } else {
+            vector<thread> clients;
+            for (int p = 0; p < peers; p++) {
+                clients.emplace_back([&servers, p]() {
+                    ReplicationNode client("C" + to_string(p));
+                    for (int r = 0; r < rounds; r++) {
+                        client.request(servers.nodes[p]->listen_port(), SyncStrategy::Delta);
+                        while (client.pending_requests() > 0) client.poll(10);
+                    }
+                });
+            }
+            for (auto &t : clients) t.join();
+        }
+        auto end = high_resolution_clock::now();
+        double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+        size_t syncs = (size_t)peers * rounds;
+        string name = coroutines ? "Delta syncs, coroutines on 2 threads" : "Delta syncs, thread per peer";
+        results.push_back({"ORSet", name, time_ms, syncs, (syncs / time_ms) * 1000.0});
+        cout << name << ": " << (syncs / time_ms) * 1000.0 << " syncs/sec"
+             << (coroutines ? " (2 pool threads and the reactor)" : " (16 client threads)") << endl;
+    }
+}
+#endif
+
+// Replication nodes on loopback. First a client pulling deltas from a
+// 100-element server polled by its own thread (small, so transport costs
+// show), when each request opens a new connection, reuses one and waits for
+// each reply, or reuses one with 64 requests in flight. Then a ring of 16
+// nodes under writes, all polled by this thread, each pulling deltas from
+// its successor every round until all agree.
+// Ingesting states that mostly overlap what the target already has, as
+// replicas gossiping full states do: serial decode + merge() of each, the
+// same with decode_missing(), and the pipeline, which also applies the
+// deltas in batches.
+void benchmark_ingest_pipeline(vector<BenchmarkResult>& results) {
+    cout << "\n=== Ingest Pipeline [ORSet] ===\n";
+
+    const int shared = 20000, payloads = 200, fresh = 20;
+    ORSet common("C");
+    for (int i = 0; i < shared; i++) common.add("e" + to_string(i));
+    vector<string> encoded;
+    for (int p = 0; p < payloads; p++) {
+        ORSet sender("P" + to_string(p));
+        sender.merge(common);
+        for (int i = 0; i < fresh; i++) sender.add("p" + to_string(p) + "_" + to_string(i));
+        encoded.push_back(ORSetCodec::encode(sender));
+    }
+    ORSet base("T");
+    base.merge(common);
+
+    auto report = [&](const string& name, double time_ms, size_t size) {
+        results.push_back({"ORSet", name, time_ms, (size_t)payloads, (payloads / time_ms) * 1000.0});
+        cout << name << ": " << (payloads / time_ms) * 1000.0 << " states/sec, " << size << " elements" << endl;
+    };
+
+    {
+        ORSet target = base;
+        auto start = high_resolution_clock::now();
+        for (const auto &payload : encoded) target.merge(ORSetCodec::decode(payload));
+        auto end = high_resolution_clock::now();
+        report("Serial decode + merge", duration_cast<microseconds>(end - start).count() / 1000.0, target.size());
+    }
+    {
+        ORSet target = base;
+        auto start = high_resolution_clock::now();
+        for (const auto &payload : encoded) target.merge(ORSetCodec::decode_missing(payload, target.summary()));
+        auto end = high_resolution_clock::now();
+        report("Serial decode_missing + merge", duration_cast<microseconds>(end - start).count() / 1000.0,
+               target.size());
+    }
+
+    for (size_t threads : {size_t(1), size_t(2)}) {
+        IngestPipeline::Options options;
+        options.decoders = threads;
+        options.filters = threads;
+        auto start = high_resolution_clock::now();
+        IngestPipeline pipeline(base, options);
+        for (const auto &payload : encoded) pipeline.submit(payload);
+        pipeline.drain();
+        auto end = high_resolution_clock::now();
+        auto stats = pipeline.get_stats();
+        size_t size = pipeline.with_target([](const ORSet& t) { return t.size(); });
+        report("Pipelined ingest, " + to_string(threads) + " decoder(s) and filter(s)",
+               duration_cast<microseconds>(end - start).count() / 1000.0, size);
+        cout << "  built " << stats.pairs_decoded << " of " << payloads * (shared + fresh) << " pairs, kept "
+             << stats.pairs_kept << ", " << stats.batches << " batches" << endl;
+    }
+}
+
+// Compressed size and speed of encoded states: a 100K-element state with
+// keys that share prefixes, and deltas of 10 to 10K changes against it. Each
+// at three levels, compressing encode() as it is and with the tag columns
+// split out (encode_compressed()).
+void benchmark_block_codec(vector<BenchmarkResult>& results) {
+    cout << "\n=== Block Compression [ORSet] ===\n";
+
+    ORSet writer("replica-a"), other("replica-b");
+    for (int i = 0; i < 100000; i++) (i % 3 ? writer : other).add("user:" + to_string(i * 7919 % 1000003) + ":session");
+    writer.merge(other);
+    for (int i = 0; i < 100000; i += 10) writer.remove("user:" + to_string(i * 7919 % 1000003) + ":session");
+
+    vector<pair<string, string>> payloads = {{"full state", ORSetCodec::encode(writer)}};
+    for (int changes : {10, 1000, 10000}) {
+        ORSet changed = writer;
+        for (int i = 0; i < changes; i++) {
+            if (i % 4) {
+                changed.add("user:" + to_string(2000000 + i) + ":session");
+            } else {
+                changed.remove("user:" + to_string(i * 7919 % 1000003) + ":session");
+            }
+        }
+        payloads.push_back({to_string(changes) + "-change delta", ORSetCodec::encode(changed.missing_for(writer.summary()))});
+    }
+
+    for (const auto &payload : payloads) {
+        const string& raw = payload.second;
+        int reps = max<int>(1, int(2000000 / raw.size()));
+        cout << payload.first << ", " << raw.size() << " bytes encoded:" << endl;
+        for (int level : {1, 6, 9}) {
+            for (bool columns : {false, true}) {
+                string packed;
+                auto start = high_resolution_clock::now();
+                for (int r = 0; r < reps; r++) {
+                    packed = columns ? ORSetCodec::compress_state(raw, level) : BlockCodec::compress(raw, level);
+                }
+                auto mid = high_resolution_clock::now();
+                for (int r = 0; r < reps; r++) {
+                    string back = columns ? ORSetCodec::decompress_state(packed) : BlockCodec::decompress(packed);
+                    if (back.size() != raw.size()) throw runtime_error("benchmark_block_codec: bad round trip");
+                }
+                auto end = high_resolution_clock::now();
+                double compress_ms = duration_cast<microseconds>(mid - start).count() / 1000.0;
+                double decompress_ms = duration_cast<microseconds>(end - mid).count() / 1000.0;
+                double mb = raw.size() * double(reps) / 1048576.0;
+                string name = "Compress " + payload.first + ", level " + to_string(level) +
+                              (columns ? ", tag columns" : ", plain");
+                results.push_back({"ORSet", name, compress_ms, (size_t)reps, (reps / compress_ms) * 1000.0});
+                cout << "  level " << level << (columns ? " columns: " : " plain:   ") << packed.size() << " bytes ("
+                     << fixed << setprecision(1) << 100.0 * packed.size() / raw.size() << "%), compress "
+                     << mb / (compress_ms / 1000) << " MB/s, decompress " << mb / (decompress_ms / 1000) << " MB/s"
+                     << defaultfloat << setprecision(6) << endl;
+            }
+        }
+    }
+}
+
+// Decoding a counter column: the zigzag counter steps of a 1M-tag state in
+// element order (adds issued in another order than the elements sort in),
+// as LEB128 varints and as Stream VByte with each kernel this CPU has.
+void benchmark_stream_vbyte(vector<BenchmarkResult>& results) {
+    cout << "\n=== Counter Column Decoding [ORSet] ===\n";
+
+    const size_t tags = 1000000;
+    vector<pair<string, uint64_t>> pairs;
+    for (size_t i = 0; i < tags; i++) pairs.push_back({"user:" + to_string(i * 7919 % 10000019) + ":session", i + 1});
+    sort(pairs.begin(), pairs.end());
+    vector<uint32_t> steps;
+    uint64_t last = 0;
+    for (const auto &pair : pairs) {
+        int64_t step = int64_t(pair.second - last);
+        last = pair.second;
+        steps.push_back(uint32_t((uint64_t(step) << 1) ^ uint64_t(step >> 63)));
+    }
+
+    ByteWriter varints;
+    for (uint32_t step : steps) varints.put_varint(step);
+    string packed = StreamVByte::encode(steps);
+    const int reps = 20;
+    auto report = [&](const string& name, double time_ms, size_t bytes) {
+        results.push_back({"ORSet", name, time_ms, tags * reps, (tags * reps / time_ms) * 1000.0});
+        cout << name << ": " << tags * reps / time_ms / 1e6 << " billion values/sec, " << double(bytes) / tags
+             << " bytes/value" << endl;
+    };
+
+    vector<uint32_t> out(tags);
+    auto start = high_resolution_clock::now();
+    for (int r = 0; r < reps; r++) {
+        ByteReader in(varints.buffer);
+        for (size_t i = 0; i < tags; i++) out[i] = uint32_t(in.get_varint());
+    }
+    auto end = high_resolution_clock::now();
+    if (out != steps) throw runtime_error("benchmark_stream_vbyte: bad LEB128 decode");
+    report("Counter column, LEB128", duration_cast<microseconds>(end - start).count() / 1000.0, varints.buffer.size());
+
+    for (auto kernel : {StreamVByte::Kernel::Scalar, StreamVByte::Kernel::SSSE3, StreamVByte::Kernel::AVX2}) {
+        if (kernel != StreamVByte::Kernel::Scalar && int(kernel) > int(StreamVByte::best_kernel())) continue;
+        fill(out.begin(), out.end(), 0);
+        start = high_resolution_clock::now();
+        for (int r = 0; r < reps; r++) StreamVByte::decode(packed, tags, out.data(), kernel);
+        end = high_resolution_clock::now();
+        if (out != steps) throw runtime_error("benchmark_stream_vbyte: bad Stream VByte decode");
+        report(string("Counter column, Stream VByte ") + StreamVByte::kernel_name(kernel),
+               duration_cast<microseconds>(end - start).count() / 1000.0, packed.size());
+    }
+}
+
+// front-coded element block vs the flat (length, bytes)* layout it
+// replaced, on keys with long shared prefixes
+void benchmark_front_coding(vector<BenchmarkResult>& results) {
+    cout << "\n=== Front-Coded Snapshots [ORSet] ===\n";
+
+    const int count = 100000;
+    ORSet state("A");
+    for (int i = 0; i < count; i++) {
+        state.add("tenant/" + to_string(i % 50) + "/object/" + to_string(1000000 + i * 7919 % 1000003));
+    }
+    set<string> elements = state.elements();
+    vector<string_view> sorted(elements.begin(), elements.end());
+    ByteWriter flat, coded;
+    flat.put_varint(sorted.size());
+    for (string_view element : sorted) flat.put_string(element);
+    ORSetCodec::write_element_block(sorted, coded);
+    string snapshot = ORSetCodec::encode(state);
+    cout << "Element block: " << flat.buffer.size() << " bytes flat, " << coded.buffer.size() << " front-coded ("
+         << double(flat.buffer.size()) / coded.buffer.size() << "x); snapshot " << snapshot.size() << " bytes"
+         << endl;
+
+    const int reps = 10;
+    auto start = high_resolution_clock::now();
+    size_t loaded = 0;
+    for (int r = 0; r < reps; r++) {
+        ByteReader in(flat.buffer);
+        vector<string> elements(in.get_varint());
+        for (auto &element : elements) element = string(in.get_string());
+        loaded += elements.size();
+    }
+    auto end = high_resolution_clock::now();
+    double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+    results.push_back({"ORSet", "Element block load, flat", time_ms, loaded, (loaded / time_ms) * 1000.0});
+    cout << "Element block load, flat: " << loaded / time_ms / 1000.0 << "M elements/sec" << endl;
+
+    start = high_resolution_clock::now();
+    loaded = 0;
+    for (int r = 0; r < reps; r++) {
+        ByteReader in(coded.buffer);
+        ElementBlockView block(in);
+        vector<string> elements;
+        elements.reserve(block.size());
+        ElementBlockView::Cursor cursor(block);
+        while (!cursor.done()) elements.push_back(cursor.next());
+        loaded += elements.size();
+    }
+    end = high_resolution_clock::now();
+    time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+    results.push_back({"ORSet", "Element block load, front-coded", time_ms, loaded, (loaded / time_ms) * 1000.0});
+    cout << "Element block load, front-coded: " << loaded / time_ms / 1000.0 << "M elements/sec" << endl;
+
+    start = high_resolution_clock::now();
+    for (int r = 0; r < reps; r++) ORSetCodec::decode(snapshot);
+    end = high_resolution_clock::now();
+    time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+    results.push_back({"ORSet", "Snapshot decode", time_ms, size_t(count) * reps, (count * reps / time_ms) * 1000.0});
+    cout << "Snapshot decode: " << count * reps / time_ms / 1000.0 << "M elements/sec" << endl;
+
+    const int lookups = 100000;
+    mt19937 rng(3);
+    size_t hits = 0;
+    start = high_resolution_clock::now();
+    for (int i = 0; i < lookups; i++) {
+        int key = int(rng() % (2 * count));
+        hits += ORSetCodec::contains_encoded(
+            snapshot, "tenant/" + to_string(key % 50) + "/object/" + to_string(1000000 + key * 7919 % 1000003));
+    }
+    end = high_resolution_clock::now();
+    if (hits == 0 || hits == size_t(lookups)) throw runtime_error("benchmark_front_coding: lookups should hit and miss");
+    time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+    results.push_back({"ORSet", "Encoded snapshot lookup", time_ms, size_t(lookups), (lookups / time_ms) * 1000.0});
+    cout << "Encoded snapshot lookup: " << lookups / time_ms << "K lookups/sec (" << hits << " hits)" << endl;
+}
+
+// contains() on a live ORSet vs its FrozenORSet with keys, keys plus
+// fingerprints and fingerprints only; memory is counted heap bytes
+void benchmark_frozen_orset(vector<BenchmarkResult>& results) {
+    cout << "\n=== Frozen Read-Only Set [ORSet] ===\n";
+
+    const int count = 200000;
+    size_t heap_before = live_heap_bytes.load();
+    ORSet live("A");
+    for (int i = 0; i < count; i++) live.add("user:" + to_string(i * 7919 % 10000019) + ":profile");
+    size_t live_bytes = live_heap_bytes.load() - heap_before;
+
+    const int lookups = 1000000;
+    vector<string> queries; // half hits, half misses, spread over the whole set
+    mt19937 rng(11);
+    for (int i = 0; i < (1 << 18); i++) {
+        int id = int(rng() % count);
+        queries.push_back("user:" + to_string(id * 7919 % 10000019) + (i % 2 ? ":profile" : ":missing"));
+    }
+    auto measure = [&](const string& name, size_t bytes, auto contains) {
+        size_t hits = 0;
+        auto start = high_resolution_clock::now();
+        for (int i = 0; i < lookups; i++) hits += contains(queries[i % queries.size()]);
+        auto end = high_resolution_clock::now();
+        if (hits < size_t(lookups) / 2 || hits > size_t(lookups) / 2 + lookups / 1000) {
+            throw runtime_error("benchmark_frozen_orset: wrong hits for " + name);
+        }
+        double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+        results.push_back({"ORSet", "contains(), " + name, time_ms, size_t(lookups), (lookups / time_ms) * 1000.0});
+        cout << name << ": " << lookups / time_ms / 1000.0 << "M lookups/sec, " << double(bytes) / count
+             << " bytes/element" << endl;
+    };
+    measure("live ORSet", live_bytes, [&](const string& element) { return live.contains(element); });
+
+    struct Mode {
+        const char* name;
+        bool keys, fingerprints;
+    };
+    for (Mode mode : {Mode{"frozen, keys", true, false}, Mode{"frozen, keys + fingerprints", true, true},
+                      Mode{"frozen, fingerprints only", false, true}}) {
+        FrozenORSet::Options options;
+        options.keys = mode.keys;
+        options.fingerprints = mode.fingerprints;
+        heap_before = live_heap_bytes.load();
+        auto start = high_resolution_clock::now();
+        FrozenORSet frozen = FrozenORSet::freeze(live, options);
+        auto end = high_resolution_clock::now();
+        size_t frozen_bytes = live_heap_bytes.load() - heap_before;
+        double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+        results.push_back({"ORSet", string("freeze(), ") + mode.name, time_ms, size_t(count), (count / time_ms) * 1000.0});
+        cout << "freeze(), " << mode.name << ": " << time_ms << " ms, "
+             << double(frozen.hash_bits()) / count << " hash bits/element" << endl;
+        measure(mode.name, frozen_bytes, [&](const string& element) { return frozen.contains(element); });
+    }
+}
+
+void benchmark_tcp_replication(vector<BenchmarkResult>& results) {
+    cout << "\n=== TCP Replication over Loopback [ORSet] ===\n";
+
+    {
+        ReplicationNode server("S"), client("C");
+        for (int i = 0; i < 100; i++) server.add("item_" + to_string(i));
+        atomic<bool> stop{false};
+        thread serving([&]() {
+            while (!stop) server.poll(1);
+        });
+        client.request(server.listen_port(), SyncStrategy::Full);
+        drive({&client});
+
+        const int requests = 20000;
+        for (const char* mode : {"new connection", "reused, one at a time", "reused, pipelined x64"}) {
+            auto start = high_resolution_clock::now();
+            for (int i = 0; i < requests;) {
+                int batch = mode[0] == 'r' && mode[7] == 'p' ? 64 : 1;
+                for (int b = 0; b < batch && i < requests; b++, i++) {
+                    if (mode[0] == 'n') client.disconnect("127.0.0.1", server.listen_port());
+                    client.request(server.listen_port(), SyncStrategy::Delta);
+                }
+                drive({&client});
+            }
+            auto end = high_resolution_clock::now();
+            double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+            string name = string("Delta pull, ") + mode;
+            results.push_back({"ORSet", name, time_ms, (size_t)requests, (requests / time_ms) * 1000.0});
+            cout << name << ": " << (requests / time_ms) * 1000.0 << " requests/sec" << endl;
+        }
+        stop = true;
+        serving.join();
+        if (client.get_state().fingerprint() != server.get_state().fingerprint()) cout << "[DIVERGED]\n";
+    }
+
+    const int node_count = 16, rounds = 10, ops_per_round = 200, keys = 5000;
+    vector<unique_ptr<ReplicationNode>> nodes;
+    vector<ReplicationNode*> all;
+    for (int n = 0; n < node_count; n++) {
+        nodes.push_back(make_unique<ReplicationNode>("N" + to_string(n)));
+        all.push_back(nodes.back().get());
+    }
+    mt19937 rng(17);
+    auto converged = [&]() {
+        for (auto *node : all) {
+            if (node->get_state().fingerprint() != all[0]->get_state().fingerprint()) return false;
+        }
+        return true;
+    };
+    auto start = high_resolution_clock::now();
+    int round = 0;
+    for (; round < rounds || !converged(); round++) {
+        if (round < rounds) {
+            for (auto *node : all) {
+                for (int i = 0; i < ops_per_round; i++) {
+                    string key = "key_" + to_string(rng() % keys);
+                    rng() % 3 ? node->add(key) : node->remove(key);
+                }
+            }
+        }
+        for (int n = 0; n < node_count; n++) {
+            all[n]->request(all[(n + 1) % node_count]->listen_port(), SyncStrategy::Delta);
+        }
+        drive(all, 60000);
     }
+    auto end = high_resolution_clock::now();
+    double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+    size_t bytes = 0, ops = (size_t)node_count * rounds * ops_per_round;
+    for (auto *node : all) bytes += node->get_stats().bytes_sent;
+    results.push_back({"ORSet", "TCP ring of " + to_string(node_count) + " nodes", time_ms, ops,
+                       (ops / time_ms) * 1000.0});
+    cout << "Ring of " << node_count << " nodes: " << ops << " ops replicated in " << round << " rounds, "
+         << time_ms << " ms, " << double(bytes) / ops << " bytes/op on the wire" << endl;
+}
+
+struct ReplicationResult {
+    string mode;
+    size_t ops;
+    double ops_per_sec;
+    size_t heap_bytes_per_replica;
+    double bytes_per_op;
+};
+
+// High-rate ingest on 4 replicas replicated three ways: full-state sync of
+// the state-based ORSet, op broadcast of the ORSet op mode, and op broadcast
+// of the pure op-based PureORSet. Bytes are what each scheme puts on the
+// wire: encoded states, encoded ops and the version vectors used as acks.
+void benchmark_replication_modes(vector<BenchmarkResult>& results, vector<ReplicationResult>& replication) {
+    cout << "\n=== Replication Modes: State vs Op vs Pure Op ===\n";
+
+    const int replica_count = 4, keys = 1000, rounds = 200, ops_per_round = 100, sync_every = 10;
+    auto vv_bytes = [](const map<string, uint64_t>& vv) {
+        ByteWriter out;
+        out.put_varint(vv.size());
+        for (const auto &entry : vv) {
+            out.put_string(entry.first);
+            out.put_varint(entry.second);
+        }
+        return out.buffer.size();
+    };
+
+    auto run = [&](const string& mode, auto make, auto issue, auto sync) {
+        mt19937 rng(17);
+        size_t heap_before = live_heap_bytes.load();
+        size_t wire_bytes = 0;
+        auto replicas = make();
+
+        auto start = high_resolution_clock::now();
+        for (int round = 1; round <= rounds; round++) {
+            for (int r = 0; r < replica_count; r++) {
+                for (int i = 0; i < ops_per_round; i++) {
+                    string key = "key_" + to_string(rng() % keys);
+                    wire_bytes += issue(replicas, r, key, rng() % 3 != 0);
+                }
+            }
+            if (round % sync_every == 0) wire_bytes += sync(replicas);
+        }
+        auto end = high_resolution_clock::now();
+        double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
+        size_t ops = (size_t)replica_count * rounds * ops_per_round;
+        size_t heap_bytes = (live_heap_bytes.load() - heap_before) / replica_count;
+        double bytes_per_op = double(wire_bytes) / ops;
+
+        results.push_back({"Replication", mode + " " + to_string(ops) + " ops", time_ms, ops,
+                           (ops / time_ms) * 1000.0});
+        replication.push_back({mode, ops, (ops / time_ms) * 1000.0, heap_bytes, bytes_per_op});
+        cout << mode << ": " << replicas[0].size() << " live elements, " << (heap_bytes / 1024.0)
+             << " KB per replica, " << bytes_per_op << " bytes/op, " << time_ms << " ms" << endl;
+    };
+
+    auto make_orsets = [&]() {
+        vector<ORSet> replicas;
+        for (int r = 0; r < replica_count; r++) replicas.emplace_back("R" + to_string(r));
+        for (auto &replica : replicas) {
+            for (int o = 0; o < replica_count; o++) replica.add_member("R" + to_string(o));
+        }
+        return replicas;
+    };
+
+    // every replica pulls the full state of every other one
+    run("State-based ORSet", make_orsets,
+        [](vector<ORSet>& replicas, int r, const string& key, bool add) -> size_t {
+            add ? replicas[r].add(key) : replicas[r].remove(key);
+            return 0;
+        },
+        [&](vector<ORSet>& replicas) {
+            size_t bytes = 0;
+            vector<string> states;
+            for (const auto &replica : replicas) states.push_back(ORSetCodec::encode(replica));
+            for (int r = 0; r < replica_count; r++) {
+                for (int o = 0; o < replica_count; o++) {
+                    if (o == r) continue;
+                    replicas[r].merge(ORSetCodec::decode(states[o]));
+                    bytes += states[o].size();
+                }
+            }
+            return bytes;
+        });
+
+    run("Op-based ORSet", make_orsets,
+        [&](vector<ORSet>& replicas, int r, const string& key, bool add) -> size_t {
+            ORSetOp op = add ? replicas[r].add_op(key) : replicas[r].remove_op(key);
+            ByteWriter out;
+            ORSetCodec::encode_op(op, out);
+            for (int o = 0; o < replica_count; o++) {
+                if (o != r) replicas[o].deliver(op);
+            }
+            return out.buffer.size() * (replica_count - 1);
+        },
+        [&](vector<ORSet>& replicas) {
+            size_t bytes = 0;
+            for (int r = 0; r < replica_count; r++) {
+                for (int o = 0; o < replica_count; o++) {
+                    if (o == r) continue;
+                    replicas[r].acknowledge("R" + to_string(o), replicas[o].delivered_vv());
+                    bytes += vv_bytes(replicas[o].delivered_vv());
+                }
+            }
+            for (auto &replica : replicas) replica.compact_stable();
+            return bytes;
+        });
+
+    run("Pure op-based PureORSet",
+        [&]() {
+            vector<PureORSet> replicas;
+            for (int r = 0; r < replica_count; r++) replicas.emplace_back("R" + to_string(r));
+            for (auto &replica : replicas) {
+                for (int o = 0; o < replica_count; o++) replica.add_member("R" + to_string(o));
+            }
+            return replicas;
+        },
+        [&](vector<PureORSet>& replicas, int r, const string& key, bool add) -> size_t {
+            PureOp op = add ? replicas[r].add(key) : replicas[r].remove(key);
+            ByteWriter out;
+            op.encode(out);
+            for (int o = 0; o < replica_count; o++) {
+                if (o != r) replicas[o].deliver(op);
+            }
+            return out.buffer.size() * (replica_count - 1);
+        },
+        [&](vector<PureORSet>& replicas) {
+            size_t bytes = 0;
+            for (int r = 0; r < replica_count; r++) {
+                for (int o = 0; o < replica_count; o++) {
+                    if (o == r) continue;
+                    replicas[r].acknowledge("R" + to_string(o), replicas[o].delivered_vv());
+                    bytes += vv_bytes(replicas[o].delivered_vv());
+                }
+            }
+            for (auto &replica : replicas) replica.compact_stable();
+            return bytes;
+        });
+}
+
+void save_replication_to_file(const vector<ReplicationResult>& replication) {
+    ofstream out("crdt_replication_results.csv");
+    out << "Mode,Operations,Ops/Sec,HeapBytesPerReplica,BytesPerOp\n";
+
+    for (const auto& r : replication) {
+        out << r.mode << "," << r.ops << "," << r.ops_per_sec << "," << r.heap_bytes_per_replica << ","
+            << r.bytes_per_op << "\n";
+    }
+
+    out.close();
+    cout << "[INFO] Replication results saved to crdt_replication_results.csv\n";
+}
+
+struct ChurnSample {
+    string backend;
+    int cycle;
+    size_t ops;
+    size_t elements;
+    size_t internal_size;
+    size_t heap_bytes;
+    double avg_op_ns;
+    double max_op_ns;
+};
+
+// Long-running churn: every cycle each replica adds or removes random keys
+// from a fixed key space, and every few cycles the replicas merge around a
+// ring. Samples metadata, heap and op latency over time so growth shows up
+// as a trend rather than a single number.
+template <typename Set>
+void benchmark_long_churn(const string& backend, vector<ChurnSample>& samples) {
+    cout << "\n=== Long-Running Churn [" << backend << "] ===\n";
+
+    const int replica_count = 4, keys = 2000, ops_per_cycle = 100;
+    const int cycles = 1000, merge_every = 5, sample_every = 50;
+    mt19937 rng(7);
+
+    size_t heap_before = live_heap_bytes.load();
+    vector<Set> replicas;
+    for (int r = 0; r < replica_count; r++) {
+        replicas.emplace_back("R" + to_string(r));
+    }
+    declare_group(replicas, 0);
+
+    size_t total_ops = 0, window_ops = 0;
+    double window_ns = 0, window_max_ns = 0;
+    for (int cycle = 1; cycle <= cycles; cycle++) {
+        for (auto &replica : replicas) {
+            for (int i = 0; i < ops_per_cycle; i++) {
+                string key = "tenant/" + to_string(rng() % 16) + "/key_" + to_string(rng() % keys);
+                bool add = rng() % 2;
+                auto start = high_resolution_clock::now();
+                if (add) replica.add(key); else replica.remove(key);
+                double ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+                window_ns += ns;
+                window_max_ns = max(window_max_ns, ns);
+                window_ops++;
+            }
+        }
+        if (cycle % merge_every == 0) {
+            for (int r = 0; r < replica_count; r++) {
+                replicas[r].merge(replicas[(r + 1) % replica_count]);
+            }
+        }
+        total_ops += (size_t)replica_count * ops_per_cycle;
+
+        if (cycle % sample_every == 0) {
+            size_t heap_bytes = (live_heap_bytes.load() - heap_before) / replica_count;
+            samples.push_back({backend, cycle, total_ops, replicas[0].size(),
+                               replicas[0].internal_size(), heap_bytes,
+                               window_ns / window_ops, window_max_ns});
+            window_ops = 0;
+            window_ns = window_max_ns = 0;
+        }
+    }
+
+    const ChurnSample& first = samples[samples.size() - cycles / sample_every];
+    const ChurnSample& last = samples.back();
+    cout << "cycle " << first.cycle << ": internal_size " << first.internal_size << ", "
+         << (first.heap_bytes / 1024.0) << " KB, " << first.avg_op_ns << " ns/op\n";
+    cout << "cycle " << last.cycle << ": internal_size " << last.internal_size << ", "
+         << (last.heap_bytes / 1024.0) << " KB, " << last.avg_op_ns << " ns/op\n";
+}
+
+void save_churn_to_file(const vector<ChurnSample>& samples) {
+    ofstream out("crdt_churn_results.csv");
+    out << "Backend,Cycle,Ops,Elements,InternalSize,HeapBytes,AvgOp(ns),MaxOp(ns)\n";
+
+    for (const auto& c : samples) {
+        out << c.backend << "," << c.cycle << "," << c.ops << "," << c.elements << ","
+            << c.internal_size << "," << c.heap_bytes << "," << c.avg_op_ns << ","
+            << c.max_op_ns << "\n";
+    }
+
+    out.close();
+    cout << "[INFO] Churn time series saved to crdt_churn_results.csv\n";
 }
 
 void save_results_to_file(const vector<BenchmarkResult>& results) {
     ofstream out("crdt_benchmark_results.csv");
-    out << "Benchmark,Time(ms),Operations,Ops/Sec\n";
+    out << "Backend,Benchmark,Time(ms),Operations,Ops/Sec\n";
 
     for (const auto& r : results) {
-        out << r.name << "," << r.avg_time_ms << ","
+        out << r.backend << "," << r.name << "," << r.avg_time_ms << ","
             << r.operations << "," << r.ops_per_sec << "\n";
     }
 
@@ -344,7 +3092,70 @@ void save_results_to_file(const vector<BenchmarkResult>& results) {
     cout << "\n[INFO] Results saved to crdt_benchmark_results.csv\n";
 }
 
-int main() {
+// One row per benchmark, one column per backend: time in ms for the timed
+// benchmarks, heap KB for the memory rows.
+void save_matrix_to_file(const vector<BenchmarkResult>& results,
+                         const vector<MemoryResult>& memory) {
+    vector<string> backends, rows;
+    map<string, map<string, double>> cells;
+    auto record = [&](const string& backend, const string& row, double value) {
+        if (find(backends.begin(), backends.end(), backend) == backends.end()) backends.push_back(backend);
+        if (!cells.count(row)) rows.push_back(row);
+        cells[row][backend] = value;
+    };
+    for (const auto& r : results) {
+        record(r.backend, r.name + " (ms)", r.avg_time_ms);
+    }
+    for (const auto& m : memory) {
+        record(m.backend, "Heap for " + to_string(m.elements) + " elements (KB)", m.heap_bytes / 1024.0);
+    }
+
+    ofstream out("crdt_backend_matrix.csv");
+    out << "Benchmark";
+    for (const auto& backend : backends) out << "," << backend;
+    out << "\n";
+    for (const auto& row : rows) {
+        out << row;
+        for (const auto& backend : backends) {
+            auto it = cells[row].find(backend);
+            out << ",";
+            if (it != cells[row].end()) out << it->second;
+        }
+        out << "\n";
+    }
+
+    out.close();
+    cout << "[INFO] Backend matrix saved to crdt_backend_matrix.csv\n";
+}
+
+// The generic suites, run once per OR-Set backend
+template <typename Set>
+void run_backend_tests(TestRunner& runner, const string& backend) {
+    test_basic_operations<Set>(runner, backend);
+    test_concurrent_operations<Set>(runner, backend);
+    test_merge_idempotency<Set>(runner, backend);
+    test_complex_scenario<Set>(runner, backend);
+}
+
+template <typename Set>
+void run_backend_benchmarks(const string& backend, vector<BenchmarkResult>& results,
+                            vector<MemoryResult>& memory, vector<ChurnSample>& churn,
+                            vector<MergeCase>& merge_cases) {
+    benchmark_add_operations<Set>(backend, results);
+    benchmark_contains_operations<Set>(backend, results);
+    benchmark_merge_operations<Set>(backend, results);
+    benchmark_merge_matrix<Set>(backend, merge_cases);
+    benchmark_remove_operations<Set>(backend, results);
+    benchmark_memory_usage<Set>(backend, memory);
+    benchmark_churn_operations<Set>(backend, results);
+    benchmark_hot_key_readds<Set>(backend, results);
+    benchmark_long_churn<Set>(backend, churn);
+}
+
+int main(int argc, char** argv) {
+    // "./crdt_benchmark tests" runs the test suite only
+    bool tests_only = argc > 1 && string(argv[1]) == "tests";
+
     cout << "========================================\n";
     cout << "  OR-Set CRDT Test & Benchmark Suite  \n";
     cout << "========================================\n";
@@ -352,23 +3163,80 @@ int main() {
     TestRunner runner;
 
     // Run tests
-    test_basic_operations(runner);
-    test_concurrent_operations(runner);
-    test_merge_idempotency(runner);
-    test_complex_scenario(runner);
+    run_backend_tests<ORSet>(runner, "ORSet");
+    run_backend_tests<FlatORSet>(runner, "FlatORSet");
+    run_backend_tests<DotStoreORSet>(runner, "DotStoreORSet");
+    run_backend_tests<PersistentORSet>(runner, "PersistentORSet");
+    run_backend_tests<ShardedORSet<>>(runner, "ShardedORSet");
+    test_tag_collapse(runner);
+    test_causal_stability(runner);
+    test_pure_orset(runner);
+    test_orset_codec(runner);
+    test_block_codec(runner);
+    test_stream_vbyte(runner);
+    test_version_vector_summaries(runner);
+    test_delta_buffer(runner);
+    test_delta_accumulator(runner);
+    test_sync_planner(runner);
+    test_iblt(runner);
+    test_cardinality_sketch(runner);
+    test_state_fingerprint(runner);
+    test_replication_node(runner);
+    test_orset_store<BlockingEngine>(runner, "BlockingEngine");
+    test_orset_store<UringEngine>(runner, "UringEngine");
+#if defined(__cpp_impl_coroutine)
+    test_async_replication(runner);
+#endif
+    test_ingest_pipeline(runner);
+    test_frozen_orset(runner);
+    test_ormap_operations(runner);
+    test_clset_operations(runner);
     runner.print_summary();
 
+    if (tests_only) {
+        return runner.failures() == 0 ? 0 : 1;
+    }
+
     // Run benchmarks
     vector<BenchmarkResult> results;
-
-    benchmark_add_operations(results);
-    benchmark_contains_operations(results);
-    benchmark_merge_operations(results);
-    benchmark_remove_operations(results);
-    benchmark_memory_usage();
+    vector<MemoryResult> memory;
+    vector<ChurnSample> churn;
+    vector<MergeCase> merge_cases;
+    vector<ReplicationResult> replication;
+
+    run_backend_benchmarks<ORSet>("ORSet", results, memory, churn, merge_cases);
+    run_backend_benchmarks<FlatORSet>("FlatORSet", results, memory, churn, merge_cases);
+    run_backend_benchmarks<DotStoreORSet>("DotStoreORSet", results, memory, churn, merge_cases);
+    run_backend_benchmarks<PersistentORSet>("PersistentORSet", results, memory, churn, merge_cases);
+    run_backend_benchmarks<ShardedORSet<>>("ShardedORSet", results, memory, churn, merge_cases);
+    run_backend_benchmarks<CLSet>("CLSet", results, memory, churn, merge_cases);
+    benchmark_op_based_stability(results);
+    benchmark_replication_modes(results, replication);
+    benchmark_summary_sync(results);
+    benchmark_delta_buffer(results);
+    benchmark_delta_coalescing(results);
+    benchmark_sync_planner(results);
+    benchmark_iblt_sync(results);
+    benchmark_cardinality_sketch(results);
+    benchmark_convergence_check(results);
+    benchmark_tcp_replication(results);
+    benchmark_segmented_send(results);
+    benchmark_durable_store(results);
+#if defined(__cpp_impl_coroutine)
+    benchmark_async_replication(results);
+#endif
+    benchmark_ingest_pipeline(results);
+    benchmark_block_codec(results);
+    benchmark_stream_vbyte(results);
+    benchmark_front_coding(results);
+    benchmark_frozen_orset(results);
 
     // Save results
     save_results_to_file(results);
+    save_matrix_to_file(results, memory);
+    save_churn_to_file(churn);
+    save_merge_matrix_to_file(merge_cases);
+    save_replication_to_file(replication);
 
     cout << "\n========================================\n";
     cout << "  All tests and benchmarks completed!  \n";
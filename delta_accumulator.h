@@ -0,0 +1,109 @@
+// delta_accumulator.h - Coalesces the deltas of many local mutations
+#ifndef DELTA_ACCUMULATOR_H
+#define DELTA_ACCUMULATOR_H
+
+#include "crdt.h"
+
+// Collects the deltas of one replica's add()/remove() calls between two
+// syncs and emits them as a single ORSet delta. Joining in place cancels
+// what peers never need to see:
+//   - a tag added and then removed or superseded within the interval leaves
+//     no pair behind, only its dot
+//   - a remove whose tags were all added within the interval leaves no
+//     remove-log entry
+// What is left is the live new pairs, the dots of the interval (one range,
+// since the replica's dots are consecutive) and the removes of tags that
+// predate the interval, which peers may hold.
+//
+//     DeltaAccumulator delta("A");
+//     replica.add("x", delta);
+//     replica.remove("x", delta);
+//     ORSet shipped = delta.take(); // no pairs, dots of both ops
+class DeltaAccumulator {
+  private:
+    struct Added {
+        string element;
+        vector<Tag> superseded; // older tags peers may hold, dropped by this add
+    };
+
+    string replica_id;
+    uint64_t first_dot, last_dot; // own dots issued in this interval
+    set<Tag> extra_dots;          // other dots the delta's context must carry
+    map<Tag, Added> added;        // live tags added in this interval
+    map<Tag, ORSet::RemovedTags> removes;
+
+    void note_dot(const Tag& dot) {
+        if (first_dot == 0) {
+            first_dot = last_dot = dot.counter;
+        } else if (dot.counter == last_dot + 1) {
+            last_dot = dot.counter;
+        } else {
+            extra_dots.insert(dot);
+        }
+    }
+
+    // Replaces tags added in this interval by the older tags they
+    // superseded and cancels their pairs; older tags pass through.
+    vector<Tag> cancel(const vector<Tag>& tags) {
+        vector<Tag> older;
+        for (const auto &tag : tags) {
+            auto it = added.find(tag);
+            if (it == added.end()) {
+                older.push_back(tag);
+                continue;
+            }
+            older.insert(older.end(), it->second.superseded.begin(), it->second.superseded.end());
+            added.erase(it);
+        }
+        return older;
+    }
+
+  public:
+    DeltaAccumulator(const string& id) : replica_id(id), first_dot(0), last_dot(0) {}
+
+    void join_add(const string& element, const Tag& tag, const vector<Tag>& superseded) {
+        note_dot(tag);
+        vector<Tag> older = cancel(superseded);
+        extra_dots.insert(older.begin(), older.end());
+        added.emplace(tag, Added{element, move(older)});
+    }
+
+    void join_remove(const string& element, const Tag& dot, vector<Tag> removed) {
+        note_dot(dot);
+        vector<Tag> older = cancel(removed);
+        if (older.empty()) return;
+        extra_dots.insert(older.begin(), older.end());
+        removes.emplace(dot, ORSet::RemovedTags{element, move(older)});
+    }
+
+    bool empty() const { return first_dot == 0 && extra_dots.empty(); }
+    size_t live_pairs() const { return added.size(); }
+    size_t remove_entries() const { return removes.size(); }
+
+    // The interval's delta; the accumulator starts over empty
+    ORSet take() {
+        ORSet delta(replica_id);
+        for (const auto &entry : added) {
+            delta.insert_pair(delta.internal_set.end(), {entry.second.element, entry.first});
+            delta.element_cache.insert(entry.second.element);
+        }
+        if (first_dot == 1) {
+            delta.context.vv[replica_id] = last_dot;
+        } else if (first_dot > 0) {
+            for (uint64_t counter = first_dot; counter <= last_dot; counter++) {
+                delta.context.cloud.insert(delta.context.cloud.end(), Tag{replica_id, counter});
+            }
+        }
+        for (const auto &dot : extra_dots) delta.context.insert(dot);
+        delta.remove_log = move(removes);
+        delta.local_counter = last_dot;
+
+        first_dot = last_dot = 0;
+        extra_dots.clear();
+        added.clear();
+        removes.clear();
+        return delta;
+    }
+};
+
+#endif
@@ -0,0 +1,135 @@
+// delta_buffer.h - Delta-state replication of an ORSet with per-peer acks
+#ifndef DELTA_BUFFER_H
+#define DELTA_BUFFER_H
+
+#include "crdt.h"
+#include "delta_accumulator.h"
+#include "orset_codec.h"
+
+// What a replica ships to one peer: the join of every delta interval the
+// peer has not acknowledged, or the full state when some of those intervals
+// were already dropped. The peer acknowledges `upto` once merged. The
+// sender's version vector rides along as its acknowledgement, which a delta's
+// own context is too partial to give.
+struct DeltaMessage {
+    string sender;
+    uint64_t upto; // newest interval included
+    bool full;     // payload is the full state
+    map<string, uint64_t> sender_vv;
+    ORSet payload;
+};
+
+// Owns a replica's ORSet and the deltas it still owes its peers. Local
+// mutations join their delta into the open interval (a DeltaAccumulator); seal() (done by
+// prepare()) closes it under the next sequence number and appends it to the
+// delta log. Per peer, the newest acknowledged sequence number decides which
+// intervals to ship, and intervals every peer has acknowledged are dropped.
+//
+// The log is capped at `byte_cap` encoded bytes. Past the cap the oldest
+// intervals are dropped even if unacknowledged; a peer that still needed
+// them gets the full state instead, so buffer memory stays bounded when a
+// peer is slow or gone.
+//
+// Peers are fixed at construction, and every replica ships its own deltas to
+// every peer directly (full mesh).
+class DeltaBuffer {
+  private:
+    struct Interval {
+        uint64_t seq;
+        ORSet delta;
+        size_t bytes; // encoded size
+    };
+
+    string replica_id;
+    ORSet state;
+    DeltaAccumulator open; // deltas since the last seal
+    deque<Interval> log;
+    uint64_t last_seq;     // newest sealed interval
+    uint64_t dropped_upto; // intervals up to here were dropped by the cap
+    map<string, uint64_t> acked;
+    size_t buffered_bytes;
+    size_t byte_cap;
+    size_t full_state_fallbacks;
+    // last joined payload, reused for peers at the same point
+    uint64_t cached_from, cached_upto;
+    ORSet cached_payload;
+
+    void collect() {
+        uint64_t floor = last_seq;
+        for (const auto &entry : acked) floor = min(floor, entry.second);
+        while (!log.empty() && log.front().seq <= floor) {
+            buffered_bytes -= log.front().bytes;
+            log.pop_front();
+        }
+    }
+
+  public:
+    DeltaBuffer(const string& id, const vector<string>& peers, size_t cap)
+        : replica_id(id), state(id), open(id), last_seq(0), dropped_upto(0),
+          buffered_bytes(0), byte_cap(cap), full_state_fallbacks(0), cached_from(0), cached_upto(0),
+          cached_payload(id) {
+        for (const auto &peer : peers) {
+            acked[peer] = 0;
+            state.add_member(peer);
+        }
+    }
+
+    void add(const string& element) { state.add(element, open); }
+    void remove(const string& element) { state.remove(element, open); }
+
+    // Closes the open interval; returns its sequence number, or the newest
+    // one if nothing changed
+    uint64_t seal() {
+        if (open.empty()) return last_seq;
+        ORSet delta = open.take();
+        size_t bytes = ORSetCodec::encode(delta).size();
+        log.push_back({++last_seq, move(delta), bytes});
+        buffered_bytes += bytes;
+
+        while (buffered_bytes > byte_cap && !log.empty()) {
+            dropped_upto = log.front().seq;
+            buffered_bytes -= log.front().bytes;
+            log.pop_front();
+        }
+        collect();
+        return last_seq;
+    }
+
+    // Everything `peer` has not acknowledged yet
+    DeltaMessage prepare(const string& peer) {
+        seal();
+        uint64_t from = acked.at(peer);
+        if (from < dropped_upto) {
+            full_state_fallbacks++;
+            return {replica_id, last_seq, true, state.summary(), state};
+        }
+        if (from != cached_from || last_seq != cached_upto) {
+            cached_payload = ORSet(replica_id);
+            for (const auto &interval : log) {
+                if (interval.seq > from) cached_payload.join_delta(interval.delta);
+            }
+            cached_from = from;
+            cached_upto = last_seq;
+        }
+        return {replica_id, last_seq, false, state.summary(), cached_payload};
+    }
+
+    void receive(const DeltaMessage& message) {
+        state.merge(message.payload);
+        state.acknowledge(message.sender, message.sender_vv);
+    }
+
+    void acknowledge(const string& peer, uint64_t upto) {
+        uint64_t& known = acked.at(peer);
+        known = max(known, upto);
+        collect();
+    }
+
+    const ORSet& get_state() const { return state; }
+
+    size_t buffered_intervals() const { return log.size(); }
+    size_t buffered_byte_count() const { return buffered_bytes; }
+    size_t fallback_count() const { return full_state_fallbacks; }
+};
+
+#endif
@@ -0,0 +1,241 @@
+// frozen_orset.h - Immutable read-only snapshot of an ORSet's live elements
+#ifndef FROZEN_ORSET_H
+#define FROZEN_ORSET_H
+
+#include "crdt.h"
+
+// The live elements of an ORSet, frozen for nodes that only serve reads.
+// Tags, context and remove log are dropped; what is left is:
+//   - a minimal perfect hash (BBHash, Limasset et al.) mapping each element
+//     to its own slot in [0, n): a bit array per level, each element taking
+//     the first level where no other element hashes to its position. Its
+//     slot is the rank of that bit, read from one 64-byte block plus its
+//     running count. About 3.7 bits per element at gamma 2.
+//   - the elements back to back in one string, each after its length, and
+//     a u32 offset per slot
+//   - optionally a 16-bit fingerprint per slot, checked before the element,
+//     so a miss touches no key bytes. With keys dropped, the fingerprints
+//     alone answer contains() with a 1/65536 false positive rate.
+// A lookup hashes the element once, probes about 1.6 levels and compares
+// one element. freeze() is O(n) and hashes each element once, so a
+// read replica can rebuild after every sync.
+//
+//     FrozenORSet frozen = FrozenORSet::freeze(replica);
+//     frozen.contains("x");
+class FrozenORSet {
+  public:
+    struct Options {
+        bool keys = true;          // keep the elements: exact contains(), elements()
+        bool fingerprints = false; // 16 bits per element, answers misses early
+        double gamma = 2.0;        // bits per element and level; lower is smaller and slower
+    };
+
+  private:
+    static constexpr size_t kMaxLevels = 32;
+    static constexpr size_t kWordsPerBlock = 8; // rank block: one cache line
+
+    struct Level {
+        uint64_t first_bit; // in bits
+        uint64_t size;      // bits, a multiple of 64
+    };
+
+    vector<Level> levels;
+    vector<uint64_t> bits;           // all levels back to back
+    vector<uint64_t> ranks;          // set bits before each block
+    vector<uint64_t> unplaced;       // hashes of elements no level placed
+    vector<uint32_t> unplaced_slots; // and their slots, after the placed ones
+    string keys;                     // (varint length, bytes) per element, in freeze() order
+    vector<uint32_t> offsets;        // of each slot's element in keys
+    vector<uint16_t> fingerprints;
+    size_t count = 0;
+    Options options;
+
+    static uint64_t hash(string_view element) { return mix64(std::hash<string_view>()(element)); }
+
+    static uint64_t position(uint64_t h, size_t level, uint64_t size) {
+        uint64_t x = mix64(h + (level + 1) * 0x9e3779b97f4a7c15ULL);
+        return uint64_t((unsigned __int128)x * size >> 64); // x scaled to [0, size)
+    }
+
+    static uint16_t fingerprint(uint64_t h) { return uint16_t(h >> 48); }
+
+    // The element stored at keys[at]; moves at past it
+    string_view stored(size_t& at) const {
+        uint64_t length = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t byte = uint8_t(keys[at++]);
+            length |= uint64_t(byte & 0x7f) << shift;
+            if (byte < 0x80) break;
+        }
+        string_view element(keys.data() + at, length);
+        at += length;
+        return element;
+    }
+
+    size_t rank(uint64_t bit) const {
+        size_t word = bit / 64, block = word / kWordsPerBlock;
+        size_t r = ranks[block];
+        for (size_t w = block * kWordsPerBlock; w < word; w++) r += __builtin_popcountll(bits[w]);
+        return r + __builtin_popcountll(bits[word] & ((uint64_t(1) << (bit % 64)) - 1));
+    }
+
+    // The one slot an element hashing to h can have, if the element is
+    // there. Elements placed at a later level see a cleared bit here.
+    size_t find(uint64_t h, string_view element) const {
+        for (size_t l = 0; l < levels.size(); l++) {
+            uint64_t bit = levels[l].first_bit + position(h, l, levels[l].size);
+            if (bits[bit / 64] >> (bit % 64) & 1) {
+                size_t slot = rank(bit);
+                return matches(slot, h, element) ? slot : count;
+            }
+        }
+        for (size_t i = 0; i < unplaced.size(); i++) {
+            if (unplaced[i] == h && matches(unplaced_slots[i], h, element)) return unplaced_slots[i];
+        }
+        return count;
+    }
+
+    bool matches(size_t slot, uint64_t h, string_view element) const {
+        if (options.fingerprints && fingerprints[slot] != fingerprint(h)) return false;
+        return !options.keys || key(slot) == element;
+    }
+
+    template <typename Strings>
+    void build(const Strings& elements) {
+        // one pass over the source: hash, and append to keys as (length, bytes)
+        count = elements.size();
+        vector<uint64_t> hashes;
+        vector<uint32_t> stored_at;
+        hashes.reserve(count);
+        if (options.keys) stored_at.reserve(count);
+        for (const auto &element : elements) {
+            hashes.push_back(hash(element));
+            if (!options.keys) continue;
+            if (keys.size() + element.size() + 5 > numeric_limits<uint32_t>::max()) {
+                throw runtime_error("FrozenORSet: elements exceed 4 GB");
+            }
+            stored_at.push_back(uint32_t(keys.size()));
+            uint64_t length = element.size();
+            for (; length >= 0x80; length >>= 7) keys.push_back(char(length | 0x80));
+            keys.push_back(char(length));
+            keys.append(element);
+        }
+
+        // place by level; remaining holds the indices not placed yet
+        vector<uint32_t> remaining(count);
+        iota(remaining.begin(), remaining.end(), 0);
+        vector<uint64_t> placed_at(count); // global bit of each placed element
+        vector<uint64_t> seen, collided;
+        for (size_t l = 0; l < kMaxLevels && !remaining.empty(); l++) {
+            uint64_t size = max<uint64_t>(64, (uint64_t(ceil(options.gamma * remaining.size())) + 63) / 64 * 64);
+            seen.assign(size / 64, 0);
+            collided.assign(size / 64, 0);
+            for (uint32_t i : remaining) {
+                uint64_t p = position(hashes[i], l, size);
+                uint64_t bit = uint64_t(1) << (p % 64);
+                if (seen[p / 64] & bit) collided[p / 64] |= bit;
+                seen[p / 64] |= bit;
+            }
+            uint64_t first = bits.size() * 64;
+            for (size_t w = 0; w < seen.size(); w++) bits.push_back(seen[w] & ~collided[w]);
+            levels.push_back({first, size});
+            size_t kept = 0;
+            for (uint32_t i : remaining) {
+                uint64_t p = position(hashes[i], l, size);
+                if (collided[p / 64] >> (p % 64) & 1) {
+                    remaining[kept++] = i;
+                } else {
+                    placed_at[i] = first + p;
+                }
+            }
+            remaining.resize(kept);
+        }
+        while (bits.size() % kWordsPerBlock) bits.push_back(0);
+        ranks.resize(bits.size() / kWordsPerBlock);
+        for (size_t b = 0, total = 0; b < ranks.size(); b++) {
+            ranks[b] = total;
+            for (size_t w = 0; w < kWordsPerBlock; w++) total += __builtin_popcountll(bits[b * kWordsPerBlock + w]);
+        }
+
+        // elements sharing a 64-bit hash are never placed; they take the last slots
+        vector<uint32_t> slots(count);
+        for (uint32_t i : remaining) placed_at[i] = numeric_limits<uint64_t>::max();
+        for (size_t i = 0; i < count; i++) {
+            if (placed_at[i] != numeric_limits<uint64_t>::max()) slots[i] = uint32_t(rank(placed_at[i]));
+        }
+        size_t next_slot = count - remaining.size();
+        for (uint32_t i : remaining) {
+            unplaced.push_back(hashes[i]);
+            unplaced_slots.push_back(uint32_t(next_slot));
+            slots[i] = uint32_t(next_slot++);
+        }
+
+        if (options.fingerprints) {
+            fingerprints.resize(count);
+            for (size_t i = 0; i < count; i++) fingerprints[slots[i]] = fingerprint(hashes[i]);
+        }
+        if (options.keys) {
+            offsets.resize(count);
+            for (size_t i = 0; i < count; i++) offsets[slots[i]] = stored_at[i];
+        }
+        keys.shrink_to_fit();
+        bits.shrink_to_fit();
+    }
+
+  public:
+    FrozenORSet() : FrozenORSet(vector<string>(), Options()) {}
+
+    // From distinct elements
+    template <typename Strings>
+    FrozenORSet(const Strings& elements, Options opts) : options(opts) {
+        if (!options.keys && !options.fingerprints) {
+            throw invalid_argument("FrozenORSet: keep the keys or the fingerprints");
+        }
+        if (!(options.gamma >= 1.0)) throw invalid_argument("FrozenORSet: gamma below 1");
+        if (elements.size() > numeric_limits<uint32_t>::max()) throw invalid_argument("FrozenORSet: too many elements");
+        build(elements);
+    }
+
+    static FrozenORSet freeze(const ORSet& set) { return freeze(set, Options()); }
+
+    static FrozenORSet freeze(const ORSet& set, Options opts) { return FrozenORSet(set.element_cache, opts); }
+
+    bool contains(string_view element) const { return find(hash(element), element) < count; }
+
+    // The slot of an element in [0, size()), size() for a non-element. With
+    // fingerprints only, a non-element rarely gets another element's slot.
+    size_t slot(string_view element) const { return find(hash(element), element); }
+
+    // Element in a slot; needs Options::keys
+    string_view key(size_t slot) const {
+        if (!options.keys) throw logic_error("FrozenORSet: keys were not kept");
+        size_t at = offsets[slot];
+        return stored(at);
+    }
+
+    size_t size() const { return count; }
+
+    bool has_keys() const { return options.keys; }
+
+    // Elements in freeze() order, read straight through keys; needs Options::keys
+    template <typename F>
+    void for_each(F f) const {
+        if (!options.keys) throw logic_error("FrozenORSet: keys were not kept");
+        for (size_t at = 0; at < keys.size();) f(stored(at));
+    }
+
+    set<string> elements() const {
+        set<string> out;
+        for_each([&](string_view element) { out.emplace(element); });
+        return out;
+    }
+
+    size_t hash_bits() const { return bits.size() * 64 + ranks.size() * 64; }
+
+    size_t memory_bytes() const {
+        return sizeof(*this) + bits.size() * 8 + ranks.size() * 8 + levels.size() * sizeof(Level) + keys.size() +
+               offsets.size() * 4 + fingerprints.size() * 2 + unplaced.size() * 12;
+    }
+};
+
+#endif
@@ -0,0 +1,337 @@
+// ingest_pipeline.h - Staged ingest of remote ORSet states: decode, filter, apply
+#ifndef INGEST_PIPELINE_H
+#define INGEST_PIPELINE_H
+
+#include "crdt.h"
+#include "orset_codec.h"
+
+// Bounded single-producer single-consumer ring. Producer and consumer each
+// own one index and only read the other's, so neither ever locks; each
+// keeps a cached copy of the other's index and rereads it only when the
+// ring looks full (or empty).
+template <typename T>
+class SpscQueue {
+  private:
+    vector<T> slots;
+    size_t mask;
+    alignas(64) atomic<size_t> head{0}; // next to pop; written by the consumer
+    size_t cached_tail = 0;
+    alignas(64) atomic<size_t> tail{0}; // next to push; written by the producer
+    size_t cached_head = 0;
+
+  public:
+    // capacity rounded up to a power of two
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < max<size_t>(capacity, 2)) size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Moves value in; false (value untouched) when full
+    bool try_push(T& value) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - cached_head == slots.size()) {
+            cached_head = head.load(memory_order_acquire);
+            if (t - cached_head == slots.size()) return false;
+        }
+        slots[t & mask] = move(value);
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& out) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(memory_order_acquire);
+            if (h == cached_tail) return false;
+        }
+        out = move(slots[h & mask]);
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return slots.size(); }
+};
+
+// Ingests encoded remote states (ORSetCodec) into one target ORSet in three
+// stages, connected by SpscQueues:
+//   - decode: `decoders` threads, fed round-robin by submit(), decode only
+//     what the target's summary lacks (decode_missing()), so pairs the
+//     target already knows are never built
+//   - filter: `filters` threads cut each delta again against the newest
+//     summary, which catches what other payloads in flight brought since;
+//     deltas with nothing new are dropped here
+//   - apply:  one thread joins up to `max_batch` deltas and merges them into
+//     the target in one pass (merge_joined()), then publishes the new
+//     summary for the other stages
+// The applier is the only writer of the target. The other stages read a
+// summary published after an earlier batch; an older summary only lets more
+// through, and every delta still merges like the full state it came from,
+// since states join in any order. A stage that fails on an item counts it
+// as rejected and carries on with the next.
+//
+// Queues are bounded: when the applier falls behind, the filters wait, then
+// the decoders, then try_submit() fails. A network reader that stops
+// reading its socket then passes the backpressure on to the sender.
+class IngestPipeline {
+  public:
+    struct Options {
+        size_t decoders = 1;
+        size_t filters = 1;
+        size_t queue_capacity = 64;
+        size_t max_batch = 64;
+    };
+
+    struct Stats {
+        size_t submitted = 0;
+        size_t rejected = 0; // failed to decode, filter or apply
+        size_t dropped = 0;  // nothing new for the target
+        size_t applied = 0;  // merged, in `batches` merges
+        size_t batches = 0;
+        size_t pairs_decoded = 0; // pairs built by the decoders
+        size_t pairs_kept = 0;    // pairs left after filtering
+    };
+
+  private:
+    struct Decoded {
+        unique_ptr<ORSet> state;          // only what the target lacked
+        map<string, uint64_t> sender_vv;  // summary of the whole encoded state
+    };
+
+    struct Filtered {
+        unique_ptr<ORSet> delta;
+        string sender;
+        map<string, uint64_t> sender_vv; // of the whole encoded state, for acknowledge()
+    };
+
+    using SummaryPtr = shared_ptr<const map<string, uint64_t>>;
+
+    Options options;
+    ORSet target;
+    mutable mutex target_lock; // held by the applier while merging, and by with_target()
+    SummaryPtr published;      // atomic_load()/atomic_store() only
+
+    vector<unique_ptr<SpscQueue<string>>> inputs;       // submit() -> decoder d
+    vector<unique_ptr<SpscQueue<Decoded>>> decoded;     // decoder d -> filter d % filters
+    vector<unique_ptr<SpscQueue<Filtered>>> filtered;   // filter f -> applier
+    size_t next_input = 0;
+
+    atomic<bool> stopping{false};
+    atomic<size_t> finished{0}; // applied, dropped or rejected
+    atomic<size_t> rejected{0}, dropped{0}, applied{0}, batches{0}, pairs_decoded{0}, pairs_kept{0};
+    size_t submitted = 0;
+    vector<thread> threads;
+
+    // Spins briefly, yields, then sleeps: stages wait for each other without
+    // locks, and an idle stage stops taking CPU from the busy ones
+    struct Backoff {
+        unsigned spins = 0;
+        void pause() {
+            if (++spins < 64) return;
+            if (spins < 128) {
+                this_thread::yield();
+            } else {
+                this_thread::sleep_for(chrono::microseconds(50));
+            }
+        }
+        void reset() { spins = 0; }
+    };
+
+    // Pushes, waiting while the queue is full. False if the pipeline stops.
+    template <typename T>
+    bool push_waiting(SpscQueue<T>& queue, T& item) {
+        Backoff backoff;
+        while (!queue.try_push(item)) {
+            if (stopping) return false;
+            backoff.pause();
+        }
+        return true;
+    }
+
+    void decode_loop(size_t d) {
+        Backoff backoff;
+        string payload;
+        while (!stopping) {
+            if (!inputs[d]->try_pop(payload)) {
+                backoff.pause();
+                continue;
+            }
+            backoff.reset();
+            Decoded item;
+            try {
+                SummaryPtr summary = atomic_load(&published);
+                item.state = make_unique<ORSet>(ORSetCodec::decode_missing(payload, *summary, &item.sender_vv));
+            } catch (const exception&) {
+                rejected++;
+                finished++;
+                continue;
+            }
+            if (!push_waiting(*decoded[d], item)) return;
+        }
+    }
+
+    void filter_loop(size_t f) {
+        Backoff backoff;
+        Decoded item;
+        while (!stopping) {
+            bool any = false;
+            for (size_t d = f; d < decoded.size(); d += options.filters) {
+                if (!decoded[d]->try_pop(item)) continue;
+                any = true;
+                const ORSet& state = *item.state;
+                SummaryPtr summary = atomic_load(&published);
+                Filtered out;
+                try {
+                    out.delta = make_unique<ORSet>(state.missing_for(*summary));
+                } catch (const exception&) {
+                    rejected++;
+                    finished++;
+                    continue;
+                }
+                pairs_decoded += state.internal_size();
+                const ORSet& delta = *out.delta;
+                if (delta.internal_size() == 0 && delta.logged_remove_count() == 0 && delta.summary().empty() &&
+                    delta.causal_context().cloud.empty()) {
+                    dropped++;
+                    finished++;
+                    continue;
+                }
+                pairs_kept += delta.internal_size();
+                out.sender = state.get_replica_id();
+                out.sender_vv = move(item.sender_vv);
+                if (!push_waiting(*filtered[f], out)) return;
+            }
+            if (any) {
+                backoff.reset();
+            } else {
+                backoff.pause();
+            }
+        }
+    }
+
+    void apply_loop() {
+        Backoff backoff;
+        Filtered item;
+        while (!stopping) {
+            ORSet batch("");
+            vector<pair<string, map<string, uint64_t>>> senders;
+            for (size_t f = 0; f < filtered.size() && senders.size() < options.max_batch; f++) {
+                while (senders.size() < options.max_batch && filtered[f]->try_pop(item)) {
+                    try {
+                        batch.join_delta(*item.delta);
+                        senders.emplace_back(move(item.sender), move(item.sender_vv));
+                    } catch (const exception&) {
+                        rejected++;
+                        finished++;
+                    }
+                }
+            }
+            if (senders.empty()) {
+                backoff.pause();
+                continue;
+            }
+            backoff.reset();
+            // a batch that fails to apply is rejected as a whole; the
+            // thread keeps running, so drain() still sees it finish
+            bool merged = true;
+            {
+                lock_guard<mutex> guard(target_lock);
+                try {
+                    target.merge_joined(batch, senders);
+                } catch (const exception&) {
+                    merged = false;
+                }
+                atomic_store(&published, SummaryPtr(make_shared<const map<string, uint64_t>>(target.summary())));
+            }
+            if (merged) {
+                applied += senders.size();
+                batches++;
+            } else {
+                rejected += senders.size();
+            }
+            finished += senders.size();
+        }
+    }
+
+  public:
+    explicit IngestPipeline(ORSet initial) : IngestPipeline(move(initial), Options()) {}
+
+    IngestPipeline(ORSet initial, Options opts) : options(opts), target(move(initial)) {
+        if (options.decoders == 0 || options.filters == 0 || options.max_batch == 0) {
+            throw invalid_argument("IngestPipeline: every stage needs a thread and batches an item");
+        }
+        options.filters = min(options.filters, options.decoders); // a filter without a decoder idles
+        published = make_shared<const map<string, uint64_t>>(target.summary());
+        for (size_t d = 0; d < options.decoders; d++) {
+            inputs.push_back(make_unique<SpscQueue<string>>(options.queue_capacity));
+            decoded.push_back(make_unique<SpscQueue<Decoded>>(options.queue_capacity));
+        }
+        for (size_t f = 0; f < options.filters; f++) {
+            filtered.push_back(make_unique<SpscQueue<Filtered>>(options.queue_capacity));
+        }
+        for (size_t d = 0; d < options.decoders; d++) threads.emplace_back([this, d]() { decode_loop(d); });
+        for (size_t f = 0; f < options.filters; f++) threads.emplace_back([this, f]() { filter_loop(f); });
+        threads.emplace_back([this]() { apply_loop(); });
+    }
+
+    // Stops after the payloads already submitted are ingested
+    ~IngestPipeline() {
+        drain();
+        stopping = true;
+        for (auto &t : threads) t.join();
+    }
+
+    IngestPipeline(const IngestPipeline&) = delete;
+    IngestPipeline& operator=(const IngestPipeline&) = delete;
+
+    // Hands an encoded state to the next decoder with room; false when
+    // every decoder queue is full. Call from one thread only.
+    bool try_submit(string& payload) {
+        for (size_t i = 0; i < inputs.size(); i++) {
+            size_t d = next_input;
+            next_input = (next_input + 1) % inputs.size();
+            if (inputs[d]->try_push(payload)) {
+                submitted++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // try_submit(), waiting while the pipeline is full
+    void submit(string payload) {
+        Backoff backoff;
+        while (!try_submit(payload)) backoff.pause();
+    }
+
+    // Waits until everything submitted has been applied, dropped or rejected
+    void drain() {
+        Backoff backoff;
+        while (finished.load() < submitted) backoff.pause();
+    }
+
+    // Runs f(const ORSet&) on the target between two batches
+    template <typename F>
+    auto with_target(F f) const {
+        lock_guard<mutex> guard(target_lock);
+        return f(target);
+    }
+
+    Stats get_stats() const {
+        Stats stats;
+        stats.submitted = submitted;
+        stats.rejected = rejected;
+        stats.dropped = dropped;
+        stats.applied = applied;
+        stats.batches = batches;
+        stats.pairs_decoded = pairs_decoded;
+        stats.pairs_kept = pairs_kept;
+        return stats;
+    }
+};
+
+#endif
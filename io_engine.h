@@ -0,0 +1,328 @@
+// io_engine.h - Blocking and io_uring file I/O engines for ORSetStore
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Both engines take the same requests, each tagged with a caller-chosen
+// nonzero token that reap() hands back once the request completed:
+//   - write_buffer(): writes the first `length` bytes of staging buffer `i`
+//     at `offset`; the staging buffers belong to the engine
+//   - write():        writes caller memory, which must stay valid until the
+//                     token comes back
+//   - sync():         fdatasync()
+// A write given a sync token is followed by an fdatasync() that only starts
+// once the write is complete, so the sync token means "these bytes are
+// durable". I/O errors and short writes throw runtime_error from the call
+// that finds them.
+//
+// BlockingEngine does everything inside the call; submit() and reap() only
+// hand back the tokens.
+class BlockingEngine {
+  private:
+    vector<unique_ptr<char[]>> buffers;
+    size_t buffer_size;
+    vector<uint64_t> completed;
+
+    [[noreturn]] static void fail(const string& what) {
+        throw runtime_error("BlockingEngine: " + what + ": " + strerror(errno));
+    }
+
+  public:
+    explicit BlockingEngine(size_t buffer_count = 8, size_t buffer_bytes = 64 * 1024) : buffer_size(buffer_bytes) {
+        for (size_t i = 0; i < buffer_count; i++) buffers.emplace_back(new char[buffer_bytes]);
+    }
+
+    static bool async() { return false; }
+    size_t buffer_count() const { return buffers.size(); }
+    size_t buffer_bytes() const { return buffer_size; }
+    char* buffer(size_t i) { return buffers[i].get(); }
+
+    void write(int fd, string_view data, uint64_t offset, uint64_t token, uint64_t sync_token = 0) {
+        while (!data.empty()) {
+            ssize_t n = pwrite(fd, data.data(), data.size(), offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) fail("pwrite");
+            data.remove_prefix(n);
+            offset += n;
+        }
+        completed.push_back(token);
+        if (sync_token) sync(fd, sync_token);
+    }
+
+    void write_buffer(int fd, size_t i, size_t length, uint64_t offset, uint64_t token, uint64_t sync_token = 0) {
+        write(fd, string_view(buffer(i), length), offset, token, sync_token);
+    }
+
+    void sync(int fd, uint64_t token) {
+        if (fdatasync(fd) < 0) fail("fdatasync");
+        completed.push_back(token);
+    }
+
+    void submit() {}
+
+    size_t in_flight() const { return 0; }
+
+    void reap(vector<uint64_t>& done, bool /*wait*/) {
+        done.insert(done.end(), completed.begin(), completed.end());
+        completed.clear();
+    }
+};
+
+// io_uring through the raw system calls. Requests become submission queue
+// entries and go to the kernel together on submit(), one system call for a
+// whole batch; the caller carries on while they run. Completions are read
+// straight from the shared completion ring, so reap() without waiting makes
+// no system call at all. Staging buffers are page-aligned and registered
+// with the ring, so their writes skip the per-request page pinning.
+//
+// Where io_uring is unavailable (old kernel, seccomp, io_uring_disabled)
+// the engine falls back to BlockingEngine; async() tells which one runs.
+class UringEngine {
+  private:
+    int ring_fd = -1;
+    void* sq_ring = MAP_FAILED;
+    void* cq_ring = MAP_FAILED;
+    size_t sq_ring_bytes = 0, cq_ring_bytes = 0, sqes_bytes = 0;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe* sqes = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned sq_entries = 0, cq_entries = 0;
+    unsigned queued = 0;  // entries written, not submitted yet
+    size_t requests = 0;  // submitted or queued, not reaped
+    bool registered = false;
+
+    vector<char*> buffers;
+    size_t buffer_size;
+    unordered_map<uint64_t, size_t> write_lengths; // token -> bytes it must write
+    vector<uint64_t> completed;                   // reaped while making room
+    unique_ptr<BlockingEngine> fallback;
+
+    [[noreturn]] static void fail(const string& what, int error) {
+        throw runtime_error("UringEngine: " + what + ": " + strerror(error));
+    }
+
+    bool setup(unsigned entries) {
+        io_uring_params params{};
+        ring_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd < 0) return false;
+        sq_entries = params.sq_entries;
+        cq_entries = params.cq_entries;
+        sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_ring_bytes = cq_ring_bytes = max(sq_ring_bytes, cq_ring_bytes);
+        sq_ring = mmap(nullptr, sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                       IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED) return false;
+        cq_ring = single ? sq_ring
+                         : mmap(nullptr, cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) return false;
+        sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+        void* mapped = mmap(nullptr, sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                            IORING_OFF_SQES);
+        if (mapped == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(mapped);
+
+        char* sq = static_cast<char*>(sq_ring);
+        char* cq = static_cast<char*>(cq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void teardown() {
+        if (sqes) munmap(sqes, sqes_bytes);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_bytes);
+        if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_bytes);
+        if (ring_fd >= 0) close(ring_fd);
+        sqes = nullptr;
+        sq_ring = cq_ring = MAP_FAILED;
+        ring_fd = -1;
+    }
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        for (;;) {
+            int n = int(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+            if (n >= 0 || errno != EINTR) return n;
+        }
+    }
+
+    // Reads every completion posted so far
+    void drain_completions() {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        string error;
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            requests--;
+            auto length = write_lengths.find(cqe.user_data);
+            if (cqe.res < 0 && error.empty()) {
+                error = string(length != write_lengths.end() ? "write" : "fdatasync") + ": " + strerror(-cqe.res);
+            } else if (length != write_lengths.end() && size_t(cqe.res) != length->second && error.empty()) {
+                error = "short write";
+            }
+            if (length != write_lengths.end()) write_lengths.erase(length);
+            completed.push_back(cqe.user_data);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        if (!error.empty()) throw runtime_error("UringEngine: " + error);
+    }
+
+    // A free submission entry, submitting the queued ones when the ring is
+    // full and waiting when the completion ring could overflow
+    io_uring_sqe& next_entry() {
+        unsigned tail = *sq_tail;
+        if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries) {
+            submit();
+            tail = *sq_tail;
+        }
+        while (requests >= cq_entries) {
+            if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0) fail("io_uring_enter", errno);
+            drain_completions();
+        }
+        io_uring_sqe& sqe = sqes[tail & *sq_mask];
+        memset(&sqe, 0, sizeof(sqe));
+        sq_array[tail & *sq_mask] = tail & *sq_mask;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        queued++;
+        requests++;
+        return sqe;
+    }
+
+    void queue_write(int fd, const char* data, size_t length, uint64_t offset, uint64_t token, uint64_t sync_token,
+                     int buffer_index) {
+        if (sync_token && *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) + 2 > sq_entries) submit();
+        io_uring_sqe& sqe = next_entry();
+        sqe.opcode = buffer_index >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(data);
+        sqe.len = unsigned(length);
+        sqe.off = offset;
+        sqe.buf_index = uint16_t(max(buffer_index, 0));
+        sqe.user_data = token;
+        write_lengths[token] = length;
+        if (!sync_token) return;
+        sqe.flags = IOSQE_IO_LINK; // the sync waits for the write
+        io_uring_sqe& next = next_entry();
+        next.opcode = IORING_OP_FSYNC;
+        next.fd = fd;
+        next.fsync_flags = IORING_FSYNC_DATASYNC;
+        next.user_data = sync_token;
+    }
+
+  public:
+    explicit UringEngine(size_t buffer_count = 8, size_t buffer_bytes = 64 * 1024, unsigned entries = 64)
+        : buffer_size(buffer_bytes) {
+        if (!setup(entries)) {
+            teardown();
+            fallback = make_unique<BlockingEngine>(buffer_count, buffer_bytes);
+            return;
+        }
+        // the destructor does not run if this throws, so undo the setup here
+        vector<iovec> ranges;
+        try {
+            buffers.reserve(buffer_count);
+            ranges.reserve(buffer_count);
+            for (size_t i = 0; i < buffer_count; i++) {
+                char* buffer = static_cast<char*>(aligned_alloc(4096, (buffer_bytes + 4095) / 4096 * 4096));
+                if (!buffer) throw bad_alloc();
+                buffers.push_back(buffer);
+                ranges.push_back({buffer, buffer_bytes});
+            }
+        } catch (...) {
+            teardown();
+            for (char* buffer : buffers) free(buffer);
+            throw;
+        }
+        // registration can fail on a low RLIMIT_MEMLOCK; plain writes still work
+        registered = syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, ranges.data(),
+                             unsigned(ranges.size())) == 0;
+    }
+
+    ~UringEngine() {
+        // requests still running write into buffers freed below
+        if (!fallback) {
+            try {
+                while (requests > 0) {
+                    submit();
+                    if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0) break;
+                    drain_completions();
+                }
+            } catch (const exception&) {
+            }
+        }
+        teardown();
+        for (char* buffer : buffers) free(buffer);
+    }
+
+    UringEngine(const UringEngine&) = delete;
+    UringEngine& operator=(const UringEngine&) = delete;
+
+    bool async() const { return !fallback; }
+    bool registered_buffers() const { return registered; }
+    size_t buffer_count() const { return fallback ? fallback->buffer_count() : buffers.size(); }
+    size_t buffer_bytes() const { return buffer_size; }
+    char* buffer(size_t i) { return fallback ? fallback->buffer(i) : buffers[i]; }
+
+    void write(int fd, string_view data, uint64_t offset, uint64_t token, uint64_t sync_token = 0) {
+        if (fallback) return fallback->write(fd, data, offset, token, sync_token);
+        queue_write(fd, data.data(), data.size(), offset, token, sync_token, -1);
+    }
+
+    void write_buffer(int fd, size_t i, size_t length, uint64_t offset, uint64_t token, uint64_t sync_token = 0) {
+        if (fallback) return fallback->write_buffer(fd, i, length, offset, token, sync_token);
+        queue_write(fd, buffers[i], length, offset, token, sync_token, registered ? int(i) : -1);
+    }
+
+    void sync(int fd, uint64_t token) {
+        if (fallback) return fallback->sync(fd, token);
+        io_uring_sqe& sqe = next_entry();
+        sqe.opcode = IORING_OP_FSYNC;
+        sqe.fd = fd;
+        sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe.user_data = token;
+    }
+
+    // One system call for everything queued since the last one
+    void submit() {
+        if (fallback || queued == 0) return;
+        int n = enter(queued, 0, 0);
+        if (n < 0) fail("io_uring_enter", errno);
+        queued -= unsigned(n);
+    }
+
+    size_t in_flight() const { return fallback ? 0 : requests; }
+
+    // Appends the tokens of completed requests to `done`. With `wait`, and
+    // requests outstanding, blocks until at least one completes.
+    void reap(vector<uint64_t>& done, bool wait) {
+        if (fallback) return fallback->reap(done, wait);
+        submit();
+        drain_completions();
+        if (wait && completed.empty() && requests > 0) {
+            if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0) fail("io_uring_enter", errno);
+            drain_completions();
+        }
+        done.insert(done.end(), completed.begin(), completed.end());
+        completed.clear();
+    }
+};
+
+#endif
@@ -0,0 +1,255 @@
+// ormap.h - Observed-Remove Map built on the OR-Set dot machinery
+#ifndef ORMAP_H
+#define ORMAP_H
+
+#include "crdt.h"
+
+// Last-writer-wins register. Writes are ordered by a Lamport timestamp with
+// the replica id as tie breaker, so concurrent writes resolve the same way
+// on every replica.
+class LWWRegister {
+    friend struct ORMapCodec;
+
+  private:
+    string replica_id;
+    string value;
+    uint64_t timestamp;
+    string writer;
+
+  public:
+    LWWRegister(const string& id) : replica_id(id), timestamp(0) {}
+
+    void set(const string& v) {
+        timestamp++;
+        value = v;
+        writer = replica_id;
+    }
+
+    const string& get() const { return value; }
+
+    void merge(const LWWRegister& other) {
+        if (tie(other.timestamp, other.writer) > tie(timestamp, writer)) {
+            value = other.value;
+            timestamp = other.timestamp;
+            writer = other.writer;
+        }
+    }
+};
+
+// Increment/decrement counter: one grow-only total per replica and direction.
+class PNCounter {
+    friend struct ORMapCodec;
+
+  private:
+    string replica_id;
+    map<string, uint64_t> increments;
+    map<string, uint64_t> decrements;
+
+  public:
+    PNCounter(const string& id) : replica_id(id) {}
+
+    void increment(uint64_t amount = 1) { increments[replica_id] += amount; }
+    void decrement(uint64_t amount = 1) { decrements[replica_id] += amount; }
+
+    int64_t value() const {
+        int64_t total = 0;
+        for (const auto &entry : increments) total += entry.second;
+        for (const auto &entry : decrements) total -= entry.second;
+        return total;
+    }
+
+    void merge(const PNCounter& other) {
+        for (const auto &entry : other.increments) {
+            uint64_t& mine = increments[entry.first];
+            mine = max(mine, entry.second);
+        }
+        for (const auto &entry : other.decrements) {
+            uint64_t& mine = decrements[entry.first];
+            mine = max(mine, entry.second);
+        }
+    }
+};
+
+// OR-Map: each key is kept alive by dots exactly like an OR-Set element, and
+// carries a nested CRDT value (LWWRegister, PNCounter, ORSet, ...). V must be
+// constructible from a replica id and provide merge(const V&).
+//
+// update(key) stamps the key with a fresh dot, remove(key) drops the dots it
+// observed, and merge resolves key liveness against the causal context while
+// merging the nested values of surviving keys in the same pass. A key updated
+// concurrently with its removal survives with the updater's value (add-wins).
+template <typename V>
+class ORMap {
+    friend struct ORMapCodec;
+
+  private:
+    struct Entry {
+        set<Tag> dots;
+        V value;
+    };
+
+    string replica_id;
+    uint64_t local_counter;
+    map<string, Entry> entries;
+    CausalContext context;
+
+    // dots of one side that survive against the other side's state
+    static void merge_dots(set<Tag>& mine, const set<Tag>& theirs,
+                           const CausalContext& my_context,
+                           const CausalContext& their_context) {
+        for (auto it = mine.begin(); it != mine.end();) {
+            if (!theirs.count(*it) && their_context.contains(*it)) {
+                it = mine.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (const auto &tag : theirs) {
+            if (!my_context.contains(tag)) {
+                mine.insert(tag);
+            }
+        }
+    }
+
+  public:
+    ORMap(const string& id) : replica_id(id), local_counter(0) {}
+
+    // Apply fn to the value stored under key, creating it if absent.
+    template <typename F>
+    void update(const string& key, F&& fn) {
+        local_counter++;
+        Tag tag{replica_id, local_counter};
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            it = entries.emplace(key, Entry{{}, V(replica_id)}).first;
+        }
+        // the new dot supersedes every dot this replica issued for the key;
+        // they are all in the causal context, so dropping them is a local remove
+        auto &dots = it->second.dots;
+        dots.erase(dots.lower_bound(Tag{replica_id, 0}),
+                   dots.upper_bound(Tag{replica_id, numeric_limits<uint64_t>::max()}));
+        dots.insert(tag);
+        context.insert(tag);
+        fn(it->second.value);
+    }
+
+    void remove(const string& key) {
+        entries.erase(key); // its dots remain in the causal context
+    }
+
+    // ============= DELTA MUTATORS =============
+    //
+    // update()/remove() that also join their delta into `delta`, as ORSet's
+    // add(e, delta)/remove(e, delta) do: the key's new dot and the nested
+    // value, or only the removed dots, plus those dots in the context. Any
+    // ORMap merges such a delta like a full state.
+
+    template <typename F, typename Delta>
+    void update(const string& key, F&& fn, Delta& delta) {
+        auto it = entries.find(key);
+        vector<Tag> superseded;
+        if (it != entries.end()) {
+            auto &dots = it->second.dots;
+            superseded.assign(dots.lower_bound(Tag{replica_id, 0}),
+                              dots.upper_bound(Tag{replica_id, numeric_limits<uint64_t>::max()}));
+        }
+        update(key, forward<F>(fn));
+        delta.join_update(key, Tag{replica_id, local_counter}, superseded, entries.at(key).value);
+    }
+
+    template <typename Delta>
+    void remove(const string& key, Delta& delta) {
+        auto it = entries.find(key);
+        if (it == entries.end()) return;
+        vector<Tag> removed(it->second.dots.begin(), it->second.dots.end());
+        entries.erase(it);
+        delta.join_remove(key, removed);
+    }
+
+    // delta of update(): tag now keeps key alive, superseding older dots,
+    // and value is joined into the nested value
+    void join_update(const string& key, const Tag& tag, const vector<Tag>& superseded, const V& value) {
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            it = entries.emplace(key, Entry{{}, V(replica_id)}).first;
+        }
+        for (const auto &old : superseded) {
+            it->second.dots.erase(old);
+            context.insert(old);
+        }
+        it->second.dots.insert(tag);
+        context.insert(tag);
+        it->second.value.merge(value);
+    }
+
+    // delta of remove(): the dots of key that were observed and dropped
+    void join_remove(const string& key, const vector<Tag>& removed) {
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            for (const auto &tag : removed) it->second.dots.erase(tag);
+            if (it->second.dots.empty()) entries.erase(it);
+        }
+        for (const auto &tag : removed) context.insert(tag);
+    }
+
+    bool contains(const string& key) const { return entries.count(key) > 0; }
+
+    const V* get(const string& key) const {
+        auto it = entries.find(key);
+        return it == entries.end() ? nullptr : &it->second.value;
+    }
+
+    set<string> keys() const {
+        set<string> result;
+        for (const auto &entry : entries) {
+            result.insert(result.end(), entry.first);
+        }
+        return result;
+    }
+
+    // Single merge-join over both key spaces: dots are resolved as in
+    // ORSet::merge and nested values of keys present on both sides are merged.
+    void merge(const ORMap& other) {
+        auto it = entries.begin();
+        auto oit = other.entries.begin();
+        while (it != entries.end() || oit != other.entries.end()) {
+            if (oit == other.entries.end() || (it != entries.end() && it->first < oit->first)) {
+                merge_dots(it->second.dots, {}, context, other.context);
+                it = it->second.dots.empty() ? entries.erase(it) : next(it);
+            } else if (it == entries.end() || oit->first < it->first) {
+                set<Tag> dots;
+                merge_dots(dots, oit->second.dots, context, other.context);
+                if (!dots.empty()) {
+                    // the value is written to under our replica id from now on,
+                    // so it must not be a copy that carries the peer's id
+                    V value(replica_id);
+                    value.merge(oit->second.value);
+                    entries.emplace_hint(it, oit->first, Entry{move(dots), move(value)});
+                }
+                ++oit;
+            } else {
+                merge_dots(it->second.dots, oit->second.dots, context, other.context);
+                if (it->second.dots.empty()) {
+                    it = entries.erase(it);
+                } else {
+                    it->second.value.merge(oit->second.value);
+                    ++it;
+                }
+                ++oit;
+            }
+        }
+        context.merge(other.context);
+        local_counter = max(local_counter, context.max_counter(replica_id));
+    }
+
+    size_t size() const { return entries.size(); }
+    size_t internal_size() const {
+        size_t dots = 0;
+        for (const auto &entry : entries) dots += entry.second.dots.size();
+        return dots;
+    }
+    uint64_t get_counter() const { return local_counter; }
+    const CausalContext& causal_context() const { return context; }
+};
+
+#endif
@@ -0,0 +1,169 @@
+// ormap_codec.h - Binary encoding of ORMap state
+#ifndef ORMAP_CODEC_H
+#define ORMAP_CODEC_H
+
+#include "ormap.h"
+#include "orset_codec.h"
+
+// State layout (all integers are varints):
+//
+//   header      "ORM" version, replica_id, local_counter
+//   dictionary  count, replica ids           - dots refer to replicas by index
+//   context     count, (replica, counter)*   - version vector
+//               count, (replica, counter)*   - dot cloud
+//   entries     count, (key, count, (replica, counter)*, value)*
+//               - sorted keys, the dots keeping each alive and its value
+//
+// Values are written by write_value() for each nested type:
+//   LWWRegister  value, timestamp, writer
+//   PNCounter    count, (replica, total)* increments, then decrements
+//   ORSet        ORSetCodec::encode() bytes, length-prefixed
+//
+// A nested value always belongs to the map's replica, so its replica id is
+// not written and decoding gives it the map's.
+struct ORMapCodec {
+    static const uint8_t kVersion = 1;
+
+    template <typename V>
+    static string encode(const ORMap<V>& map) {
+        ByteWriter out;
+        out.put_bytes("ORM", 3);
+        out.put_u8(kVersion);
+        out.put_string(map.replica_id);
+        out.put_varint(map.local_counter);
+
+        std::map<string, uint64_t> dictionary;
+        for (const auto &entry : map.context.vv) dictionary.emplace(entry.first, 0);
+        for (const auto &tag : map.context.cloud) dictionary.emplace(tag.replica_id, 0);
+        for (const auto &entry : map.entries) {
+            for (const auto &tag : entry.second.dots) dictionary.emplace(tag.replica_id, 0);
+        }
+        out.put_varint(dictionary.size());
+        uint64_t index = 0;
+        for (auto &entry : dictionary) {
+            entry.second = index++;
+            out.put_string(entry.first);
+        }
+
+        out.put_varint(map.context.vv.size());
+        for (const auto &entry : map.context.vv) {
+            out.put_varint(dictionary[entry.first]);
+            out.put_varint(entry.second);
+        }
+        out.put_varint(map.context.cloud.size());
+        for (const auto &tag : map.context.cloud) {
+            out.put_varint(dictionary[tag.replica_id]);
+            out.put_varint(tag.counter);
+        }
+
+        out.put_varint(map.entries.size());
+        for (const auto &entry : map.entries) {
+            out.put_string(entry.first);
+            out.put_varint(entry.second.dots.size());
+            for (const auto &tag : entry.second.dots) {
+                out.put_varint(dictionary[tag.replica_id]);
+                out.put_varint(tag.counter);
+            }
+            write_value(entry.second.value, out);
+        }
+        return move(out.buffer);
+    }
+
+    template <typename V>
+    static ORMap<V> decode(string_view bytes) {
+        ByteReader in(bytes);
+        if (in.get_bytes(3) != "ORM") throw runtime_error("ORMapCodec: bad magic");
+        if (in.get_u8() != kVersion) throw runtime_error("ORMapCodec: unsupported version");
+
+        ORMap<V> map(in.get_string());
+        map.local_counter = in.get_varint();
+
+        // every id takes at least its length byte
+        uint64_t replicas = in.get_varint();
+        if (replicas > in.remaining()) throw runtime_error("ORMapCodec: bad dictionary size");
+        vector<string> dictionary(replicas);
+        for (auto &id : dictionary) id = in.get_string();
+        auto replica = [&]() -> const string& {
+            uint64_t index = in.get_varint();
+            if (index >= dictionary.size()) throw runtime_error("ORMapCodec: bad replica index");
+            return dictionary[index];
+        };
+
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            const string& id = replica();
+            map.context.vv[id] = in.get_varint();
+        }
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            const string& id = replica();
+            map.context.cloud.insert(Tag{id, in.get_varint()});
+        }
+
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            string key = in.get_string();
+            if (!map.entries.empty() && !(prev(map.entries.end())->first < key)) {
+                throw runtime_error("ORMapCodec: keys out of order");
+            }
+            set<Tag> dots;
+            for (uint64_t m = in.get_varint(); m > 0; m--) {
+                const string& id = replica();
+                dots.insert(Tag{id, in.get_varint()});
+            }
+            if (dots.empty()) throw runtime_error("ORMapCodec: key without dots");
+            V value = read_value<V>(in, map.replica_id);
+            map.entries.emplace_hint(map.entries.end(), move(key), typename ORMap<V>::Entry{move(dots), move(value)});
+        }
+        if (!in.done()) throw runtime_error("ORMapCodec: trailing bytes");
+        return map;
+    }
+
+    static void write_value(const LWWRegister& value, ByteWriter& out) {
+        out.put_string(value.value);
+        out.put_varint(value.timestamp);
+        out.put_string(value.writer);
+    }
+
+    static void write_value(const PNCounter& value, ByteWriter& out) {
+        for (const auto *totals : {&value.increments, &value.decrements}) {
+            out.put_varint(totals->size());
+            for (const auto &entry : *totals) {
+                out.put_string(entry.first);
+                out.put_varint(entry.second);
+            }
+        }
+    }
+
+    static void write_value(const ORSet& value, ByteWriter& out) { out.put_string(ORSetCodec::encode(value)); }
+
+    template <typename V>
+    static V read_value(ByteReader& in, const string& replica_id);
+};
+
+template <>
+inline LWWRegister ORMapCodec::read_value<LWWRegister>(ByteReader& in, const string& replica_id) {
+    LWWRegister value(replica_id);
+    value.value = in.get_string();
+    value.timestamp = in.get_varint();
+    value.writer = in.get_string();
+    return value;
+}
+
+template <>
+inline PNCounter ORMapCodec::read_value<PNCounter>(ByteReader& in, const string& replica_id) {
+    PNCounter value(replica_id);
+    for (auto *totals : {&value.increments, &value.decrements}) {
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            string id = in.get_string();
+            (*totals)[id] = in.get_varint();
+        }
+    }
+    return value;
+}
+
+template <>
+inline ORSet ORMapCodec::read_value<ORSet>(ByteReader& in, const string& replica_id) {
+    ORSet value = ORSetCodec::decode(in.get_bytes(in.get_varint()));
+    if (value.get_replica_id() != replica_id) throw runtime_error("ORMapCodec: nested set of another replica");
+    return value;
+}
+
+#endif
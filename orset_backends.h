@@ -0,0 +1,553 @@
+// orset_backends.h - Alternative OR-Set storage backends behind one interface
+#ifndef ORSET_BACKENDS_H
+#define ORSET_BACKENDS_H
+
+#include "crdt.h"
+#include "clset.h"
+
+// Every backend is constructed from a replica id and exposes
+//   add(e), remove(e), contains(e), elements(), merge(other),
+//   size(), internal_size()
+// with the same observable add-wins semantics as ORSet (CLSet excepted, see
+// clset.h). Benchmarks and tests are templates over this interface.
+template <typename T, typename = void>
+struct is_orset_backend : false_type {};
+
+template <typename T>
+struct is_orset_backend<T, void_t<
+    decltype(T(declval<const string&>())),
+    decltype(declval<T&>().add(declval<const string&>())),
+    decltype(declval<T&>().remove(declval<const string&>())),
+    decltype(declval<const T&>().contains(declval<const string&>()) == true),
+    decltype(set<string>(declval<const T&>().elements())),
+    decltype(declval<T&>().merge(declval<const T&>())),
+    decltype(size_t(declval<const T&>().size())),
+    decltype(size_t(declval<const T&>().internal_size()))>> : true_type {};
+
+// ============= FLAT SORTED =============
+
+// Pairs live in one sorted vector. Adds go to an unsorted buffer that is
+// folded in once it fills up; removes only mark entries dead until half the
+// vector is dead. Lookups are binary searches over contiguous memory and merge
+// is a merge-join of two arrays.
+class FlatORSet {
+  private:
+    static const size_t kPendingLimit = 512;
+
+    string replica_id;
+    uint64_t local_counter;
+    vector<pair<string, Tag>> sorted_pairs;
+    vector<bool> dead;          // parallel to sorted_pairs
+    size_t dead_count;
+    vector<pair<string, Tag>> pending; // recent adds, unsorted
+    unordered_map<string, uint32_t> tag_counts; // live tags per element
+    CausalContext context;
+
+    void drop_tag(const string& element) {
+        auto it = tag_counts.find(element);
+        if (--it->second == 0) tag_counts.erase(it);
+    }
+
+    // live pairs in order, without touching this replica's layout
+    vector<pair<string, Tag>> live_pairs() const {
+        vector<pair<string, Tag>> result;
+        result.reserve(sorted_pairs.size() - dead_count + pending.size());
+        for (size_t i = 0; i < sorted_pairs.size(); i++) {
+            if (!dead[i]) result.push_back(sorted_pairs[i]);
+        }
+        size_t middle = result.size();
+        result.insert(result.end(), pending.begin(), pending.end());
+        sort(result.begin() + middle, result.end());
+        inplace_merge(result.begin(), result.begin() + middle, result.end());
+        return result;
+    }
+
+    void flush() {
+        if (pending.empty() && dead_count == 0) return;
+        sorted_pairs = live_pairs();
+        dead.assign(sorted_pairs.size(), false);
+        dead_count = 0;
+        pending.clear();
+    }
+
+    // drop this replica's earlier tags for element, as ORSet::add does
+    void supersede_own_tags(const string& element) {
+        auto it = tag_counts.find(element);
+        if (it == tag_counts.end()) return;
+        auto first = lower_bound(sorted_pairs.begin(), sorted_pairs.end(),
+                                 make_pair(element, Tag{replica_id, 0}));
+        for (auto i = size_t(first - sorted_pairs.begin());
+             i < sorted_pairs.size() && sorted_pairs[i].first == element &&
+             sorted_pairs[i].second.replica_id == replica_id; i++) {
+            if (!dead[i]) {
+                dead[i] = true;
+                dead_count++;
+                it->second--;
+            }
+        }
+        if (it->second > 0) {
+            for (size_t i = 0; i < pending.size();) {
+                if (pending[i].first == element && pending[i].second.replica_id == replica_id) {
+                    pending[i] = move(pending.back());
+                    pending.pop_back();
+                    it->second--;
+                } else {
+                    i++;
+                }
+            }
+        }
+        if (it->second == 0) tag_counts.erase(it);
+    }
+
+  public:
+    FlatORSet(const string& id) : replica_id(id), local_counter(0), dead_count(0) {}
+
+    void add(const string& element) {
+        local_counter++;
+        Tag tag{replica_id, local_counter};
+        supersede_own_tags(element);
+        pending.push_back({element, tag});
+        context.insert(tag);
+        tag_counts[element]++;
+        // folding costs O(n), so the buffer grows with the set to keep adds
+        // amortized O(log n)
+        if (pending.size() >= max(kPendingLimit, sorted_pairs.size() / 4)) flush();
+    }
+
+    void remove(const string& element) {
+        auto it = tag_counts.find(element);
+        if (it == tag_counts.end()) return;
+        uint32_t remaining = it->second;
+        tag_counts.erase(it);
+
+        auto first = lower_bound(sorted_pairs.begin(), sorted_pairs.end(),
+                                 make_pair(element, Tag{"", 0}));
+        for (auto i = size_t(first - sorted_pairs.begin());
+             i < sorted_pairs.size() && sorted_pairs[i].first == element; i++) {
+            if (!dead[i]) {
+                dead[i] = true;
+                dead_count++;
+                remaining--;
+            }
+        }
+        // only scan the buffer when some tags of element are still in it
+        if (remaining > 0) {
+            pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                         [&](const pair<string, Tag>& p) { return p.first == element; }),
+                          pending.end());
+        }
+        if (dead_count * 2 > sorted_pairs.size()) flush();
+    }
+
+    bool contains(const string& element) const { return tag_counts.count(element) > 0; }
+
+    set<string> elements() const {
+        set<string> result;
+        for (const auto &entry : tag_counts) result.insert(entry.first);
+        return result;
+    }
+
+    void merge(const FlatORSet& other) {
+        flush();
+        vector<pair<string, Tag>> theirs = other.live_pairs();
+        vector<pair<string, Tag>> merged;
+        merged.reserve(sorted_pairs.size() + theirs.size());
+
+        size_t i = 0, j = 0;
+        while (i < sorted_pairs.size() || j < theirs.size()) {
+            if (j == theirs.size() || (i < sorted_pairs.size() && sorted_pairs[i] < theirs[j])) {
+                if (other.context.contains(sorted_pairs[i].second)) {
+                    drop_tag(sorted_pairs[i].first);
+                } else {
+                    merged.push_back(move(sorted_pairs[i]));
+                }
+                i++;
+            } else if (i == sorted_pairs.size() || theirs[j] < sorted_pairs[i]) {
+                if (!context.contains(theirs[j].second)) {
+                    tag_counts[theirs[j].first]++;
+                    merged.push_back(move(theirs[j]));
+                }
+                j++;
+            } else {
+                merged.push_back(move(sorted_pairs[i]));
+                i++;
+                j++;
+            }
+        }
+        sorted_pairs = move(merged);
+        dead.assign(sorted_pairs.size(), false);
+        context.merge(other.context);
+        local_counter = max(local_counter, context.max_counter(replica_id));
+    }
+
+    size_t size() const { return tag_counts.size(); }
+    size_t internal_size() const { return sorted_pairs.size() - dead_count + pending.size(); }
+};
+
+// ============= DOT STORE =============
+
+// Element -> dots hash map (the dot-store layout of delta-state CRDT papers).
+// add/remove/contains are O(1) on average and removes need no scan at all.
+class DotStoreORSet {
+  private:
+    string replica_id;
+    uint64_t local_counter;
+    unordered_map<string, vector<Tag>> store; // element -> live dots
+    size_t pair_count;
+    CausalContext context;
+
+  public:
+    DotStoreORSet(const string& id) : replica_id(id), local_counter(0), pair_count(0) {}
+
+    void add(const string& element) {
+        local_counter++;
+        Tag tag{replica_id, local_counter};
+        auto &dots = store[element];
+        size_t before = dots.size();
+        // the new dot supersedes this replica's earlier dots, as in ORSet::add
+        dots.erase(std::remove_if(dots.begin(), dots.end(),
+                                  [&](const Tag& t) { return t.replica_id == replica_id; }),
+                   dots.end());
+        pair_count -= before - dots.size();
+        dots.push_back(tag);
+        context.insert(tag);
+        pair_count++;
+    }
+
+    void remove(const string& element) {
+        auto it = store.find(element);
+        if (it == store.end()) return;
+        pair_count -= it->second.size();
+        store.erase(it);
+    }
+
+    bool contains(const string& element) const { return store.count(element) > 0; }
+
+    set<string> elements() const {
+        set<string> result;
+        for (const auto &entry : store) result.insert(entry.first);
+        return result;
+    }
+
+    void merge(const DotStoreORSet& other) {
+        // drop our dots the other side has seen and no longer holds
+        for (auto it = store.begin(); it != store.end();) {
+            auto oit = other.store.find(it->first);
+            auto &dots = it->second;
+            size_t before = dots.size();
+            dots.erase(std::remove_if(dots.begin(), dots.end(), [&](const Tag& tag) {
+                bool held = oit != other.store.end() &&
+                            find(oit->second.begin(), oit->second.end(), tag) != oit->second.end();
+                return !held && other.context.contains(tag);
+            }), dots.end());
+            pair_count -= before - dots.size();
+            it = dots.empty() ? store.erase(it) : next(it);
+        }
+        // adopt their dots we have never seen; dots we hold are in our context
+        for (const auto &entry : other.store) {
+            for (const auto &tag : entry.second) {
+                if (!context.contains(tag)) {
+                    store[entry.first].push_back(tag);
+                    pair_count++;
+                }
+            }
+        }
+        context.merge(other.context);
+        local_counter = max(local_counter, context.max_counter(replica_id));
+    }
+
+    size_t size() const { return store.size(); }
+    size_t internal_size() const { return pair_count; }
+};
+
+// ============= PERSISTENT =============
+
+// Immutable treap with path copying. Every update shares all untouched
+// subtrees with the previous version, so copying a replica (snapshots, the
+// `ORSet C_copy = C` pattern) is O(1) and versions are cheap to keep around.
+// Priorities are a hash of the element, so the tree shape depends only on
+// the element set, and its depth is O(log n) expected: upsert, erase, join
+// and build recurse that deep at most.
+class PersistentORSet {
+  private:
+    struct Node;
+    typedef shared_ptr<const Node> NodePtr;
+
+    struct Node {
+        string element;
+        vector<Tag> tags;
+        size_t priority;
+        NodePtr left, right;
+    };
+
+    string replica_id;
+    uint64_t local_counter;
+    NodePtr root;
+    size_t element_count;
+    size_t pair_count;
+    CausalContext context;
+
+    static size_t priority_of(const string& element) {
+        size_t h = hash<string>{}(element);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static NodePtr make(const string& element, vector<Tag> tags, size_t priority,
+                        NodePtr left, NodePtr right) {
+        return make_shared<const Node>(Node{element, move(tags), priority, move(left), move(right)});
+    }
+
+    static const Node* lookup(const NodePtr& t, const string& element) {
+        const Node* node = t.get();
+        while (node && node->element != element) {
+            node = element < node->element ? node->left.get() : node->right.get();
+        }
+        return node;
+    }
+
+    static NodePtr upsert(const NodePtr& t, const string& element, vector<Tag> tags, size_t priority) {
+        if (!t) return make(element, move(tags), priority, nullptr, nullptr);
+        if (element == t->element) return make(element, move(tags), t->priority, t->left, t->right);
+        if (element < t->element) {
+            NodePtr l = upsert(t->left, element, move(tags), priority);
+            if (l->priority > t->priority) { // rotate right
+                return make(l->element, l->tags, l->priority, l->left,
+                            make(t->element, t->tags, t->priority, l->right, t->right));
+            }
+            return make(t->element, t->tags, t->priority, l, t->right);
+        }
+        NodePtr r = upsert(t->right, element, move(tags), priority);
+        if (r->priority > t->priority) { // rotate left
+            return make(r->element, r->tags, r->priority,
+                        make(t->element, t->tags, t->priority, t->left, r->left), r->right);
+        }
+        return make(t->element, t->tags, t->priority, t->left, r);
+    }
+
+    static NodePtr join(const NodePtr& a, const NodePtr& b) {
+        if (!a) return b;
+        if (!b) return a;
+        if (a->priority > b->priority) {
+            return make(a->element, a->tags, a->priority, a->left, join(a->right, b));
+        }
+        return make(b->element, b->tags, b->priority, join(a, b->left), b->right);
+    }
+
+    static NodePtr erase(const NodePtr& t, const string& element) {
+        if (!t) return t;
+        if (element == t->element) return join(t->left, t->right);
+        if (element < t->element) {
+            return make(t->element, t->tags, t->priority, erase(t->left, element), t->right);
+        }
+        return make(t->element, t->tags, t->priority, t->left, erase(t->right, element));
+    }
+
+    template <typename F>
+    static void in_order(const Node* node, F&& fn) {
+        vector<const Node*> stack;
+        while (node || !stack.empty()) {
+            while (node) {
+                stack.push_back(node);
+                node = node->left.get();
+            }
+            node = stack.back();
+            stack.pop_back();
+            fn(*node);
+            node = node->right.get();
+        }
+    }
+
+    // Cartesian-tree construction from sorted entries in O(n)
+    static NodePtr build(vector<pair<string, vector<Tag>>>& entries) {
+        struct Building {
+            string element;
+            vector<Tag> tags;
+            size_t priority;
+            shared_ptr<Building> left, right;
+        };
+        vector<shared_ptr<Building>> spine;
+        for (auto &entry : entries) {
+            size_t priority = priority_of(entry.first);
+            auto node = make_shared<Building>(Building{move(entry.first), move(entry.second),
+                                                       priority, nullptr, nullptr});
+            shared_ptr<Building> last;
+            while (!spine.empty() && spine.back()->priority < node->priority) {
+                last = spine.back();
+                spine.pop_back();
+            }
+            node->left = last;
+            if (!spine.empty()) spine.back()->right = node;
+            spine.push_back(node);
+        }
+        function<NodePtr(const shared_ptr<Building>&)> freeze = [&](const shared_ptr<Building>& b) -> NodePtr {
+            if (!b) return nullptr;
+            return make(b->element, move(b->tags), b->priority, freeze(b->left), freeze(b->right));
+        };
+        return spine.empty() ? nullptr : freeze(spine.front());
+    }
+
+  public:
+    PersistentORSet(const string& id)
+        : replica_id(id), local_counter(0), element_count(0), pair_count(0) {}
+
+    void add(const string& element) {
+        local_counter++;
+        Tag tag{replica_id, local_counter};
+        const Node* existing = lookup(root, element);
+        vector<Tag> tags;
+        if (existing) {
+            // the new dot supersedes this replica's earlier dots, as in ORSet::add
+            for (const auto &t : existing->tags) {
+                if (t.replica_id != replica_id) tags.push_back(t);
+            }
+            pair_count -= existing->tags.size() - tags.size();
+        } else {
+            element_count++;
+        }
+        tags.push_back(tag);
+        pair_count++;
+        root = upsert(root, element, move(tags), priority_of(element));
+        context.insert(tag);
+    }
+
+    void remove(const string& element) {
+        const Node* existing = lookup(root, element);
+        if (!existing) return;
+        element_count--;
+        pair_count -= existing->tags.size();
+        root = erase(root, element);
+    }
+
+    bool contains(const string& element) const { return lookup(root, element) != nullptr; }
+
+    set<string> elements() const {
+        set<string> result;
+        in_order(root.get(), [&](const Node& node) { result.insert(result.end(), node.element); });
+        return result;
+    }
+
+    void merge(const PersistentORSet& other) {
+        if (root == other.root) { // same version, only contexts can differ
+            context.merge(other.context);
+            local_counter = max(local_counter, context.max_counter(replica_id));
+            return;
+        }
+        vector<const Node*> mine, theirs;
+        in_order(root.get(), [&](const Node& node) { mine.push_back(&node); });
+        in_order(other.root.get(), [&](const Node& node) { theirs.push_back(&node); });
+
+        auto keep = [](const vector<Tag>& tags, const vector<Tag>* held, const CausalContext& seen,
+                       vector<Tag>& out) {
+            for (const auto &tag : tags) {
+                bool in_held = held && find(held->begin(), held->end(), tag) != held->end();
+                if (in_held || !seen.contains(tag)) out.push_back(tag);
+            }
+        };
+
+        vector<pair<string, vector<Tag>>> merged;
+        size_t i = 0, j = 0;
+        while (i < mine.size() || j < theirs.size()) {
+            vector<Tag> tags;
+            string element;
+            if (j == theirs.size() || (i < mine.size() && mine[i]->element < theirs[j]->element)) {
+                element = mine[i]->element;
+                keep(mine[i]->tags, nullptr, other.context, tags);
+                i++;
+            } else if (i == mine.size() || theirs[j]->element < mine[i]->element) {
+                element = theirs[j]->element;
+                keep(theirs[j]->tags, nullptr, context, tags);
+                j++;
+            } else {
+                element = mine[i]->element;
+                keep(mine[i]->tags, &theirs[j]->tags, other.context, tags);
+                for (const auto &tag : theirs[j]->tags) {
+                    if (!context.contains(tag)) tags.push_back(tag);
+                }
+                i++;
+                j++;
+            }
+            if (!tags.empty()) merged.emplace_back(move(element), move(tags));
+        }
+
+        element_count = merged.size();
+        pair_count = 0;
+        for (const auto &entry : merged) pair_count += entry.second.size();
+        root = build(merged);
+        context.merge(other.context);
+        local_counter = max(local_counter, context.max_counter(replica_id));
+    }
+
+    size_t size() const { return element_count; }
+    size_t internal_size() const { return pair_count; }
+};
+
+// ============= SHARDED =============
+
+// Hash-partitions elements over independent inner sets. An element always
+// lands in the same shard on every replica, so shard i only ever merges with
+// shard i and each shard is a complete OR-Set for its slice of the key space.
+// Large merges run the shards on separate threads.
+template <typename Shard = ORSet, size_t kShards = 16>
+class ShardedORSet {
+  private:
+    vector<Shard> shards;
+
+    Shard& shard_for(const string& element) { return shards[hash<string>{}(element) % kShards]; }
+    const Shard& shard_for(const string& element) const {
+        return shards[hash<string>{}(element) % kShards];
+    }
+
+  public:
+    ShardedORSet(const string& id) : shards(kShards, Shard(id)) {}
+
+    void add(const string& element) { shard_for(element).add(element); }
+    void remove(const string& element) { shard_for(element).remove(element); }
+    bool contains(const string& element) const { return shard_for(element).contains(element); }
+
+    set<string> elements() const {
+        set<string> result;
+        for (const auto &shard : shards) {
+            set<string> part = shard.elements();
+            result.insert(part.begin(), part.end());
+        }
+        return result;
+    }
+
+    void merge(const ShardedORSet& other) {
+        size_t workers = min<size_t>(thread::hardware_concurrency(), kShards);
+        if (workers <= 1 || internal_size() + other.internal_size() < 65536) {
+            for (size_t i = 0; i < kShards; i++) shards[i].merge(other.shards[i]);
+            return;
+        }
+        vector<thread> threads;
+        for (size_t w = 0; w < workers; w++) {
+            threads.emplace_back([&, w] {
+                for (size_t i = w; i < kShards; i += workers) shards[i].merge(other.shards[i]);
+            });
+        }
+        for (auto &t : threads) t.join();
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const auto &shard : shards) total += shard.size();
+        return total;
+    }
+    size_t internal_size() const {
+        size_t total = 0;
+        for (const auto &shard : shards) total += shard.internal_size();
+        return total;
+    }
+};
+
+static_assert(is_orset_backend<ORSet>::value, "ORSet must satisfy the backend interface");
+static_assert(is_orset_backend<CLSet>::value, "CLSet must satisfy the backend interface");
+static_assert(is_orset_backend<FlatORSet>::value, "FlatORSet must satisfy the backend interface");
+static_assert(is_orset_backend<DotStoreORSet>::value, "DotStoreORSet must satisfy the backend interface");
+static_assert(is_orset_backend<PersistentORSet>::value, "PersistentORSet must satisfy the backend interface");
+static_assert(is_orset_backend<ShardedORSet<>>::value, "ShardedORSet must satisfy the backend interface");
+
+#endif
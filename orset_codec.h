@@ -0,0 +1,736 @@
+// orset_codec.h - Binary encoding of ORSet state and ops
+#ifndef ORSET_CODEC_H
+#define ORSET_CODEC_H
+
+#include "crdt.h"
+#include "block_codec.h"
+#include "stream_vbyte.h"
+
+// Append-only byte buffer with LEB128 varints and length-prefixed strings.
+class ByteWriter {
+  public:
+    string buffer;
+
+    void put_u8(uint8_t value) { buffer.push_back(char(value)); }
+
+    void put_varint(uint64_t value) {
+        while (value >= 0x80) {
+            buffer.push_back(char(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(char(value));
+    }
+
+    void put_bytes(const void* data, size_t size) {
+        buffer.append(static_cast<const char*>(data), size);
+    }
+
+    void put_string(string_view value) {
+        put_varint(value.size());
+        buffer.append(value);
+    }
+};
+
+// ByteWriter's interface, writing a list of byte ranges for writev() or
+// sendmsg() instead of one buffer. Strings of kReferenceBytes or more are
+// not copied: their range points at the caller's string, which must stay
+// unchanged until the ranges are sent. Everything else is copied into
+// scratch blocks, since an iovec per short field costs more than the copy.
+// Joined, the ranges are exactly what ByteWriter would have written.
+class SegmentWriter {
+  private:
+    ByteWriter scratch;   // the block being filled
+    deque<string> blocks; // finished blocks; a deque never moves them
+    vector<string_view> segments;
+    size_t total = 0;
+
+    void seal() {
+        if (scratch.buffer.empty()) return;
+        blocks.push_back(move(scratch.buffer));
+        scratch.buffer.clear();
+        segments.push_back(blocks.back());
+    }
+
+  public:
+    static const size_t kReferenceBytes = 256;
+
+    SegmentWriter() = default;
+    SegmentWriter(SegmentWriter&&) = default;
+    SegmentWriter& operator=(SegmentWriter&&) = default;
+    SegmentWriter(const SegmentWriter&) = delete; // ranges would point at the original
+    SegmentWriter& operator=(const SegmentWriter&) = delete;
+
+    void put_u8(uint8_t value) {
+        scratch.put_u8(value);
+        total++;
+    }
+
+    void put_varint(uint64_t value) {
+        size_t before = scratch.buffer.size();
+        scratch.put_varint(value);
+        total += scratch.buffer.size() - before;
+    }
+
+    void put_bytes(const void* data, size_t size) {
+        scratch.put_bytes(data, size);
+        total += size;
+    }
+
+    void put_string(string_view value) {
+        put_varint(value.size());
+        if (value.size() < kReferenceBytes) {
+            scratch.buffer.append(value);
+        } else {
+            seal();
+            segments.push_back(value);
+        }
+        total += value.size();
+    }
+
+    // The ranges in order; nothing may be written after this
+    const vector<string_view>& finish() {
+        seal();
+        return segments;
+    }
+
+    size_t size() const { return total; }
+
+    string join() {
+        string bytes;
+        bytes.reserve(total);
+        for (string_view segment : finish()) bytes.append(segment);
+        return bytes;
+    }
+};
+
+// Reads what ByteWriter wrote; throws runtime_error on truncated or
+// malformed input instead of reading past the end.
+class ByteReader {
+  private:
+    string_view data;
+    size_t pos;
+
+    void require(size_t size) const {
+        if (size > data.size() - pos) throw runtime_error("ByteReader: truncated input");
+    }
+
+  public:
+    ByteReader(string_view bytes) : data(bytes), pos(0) {}
+
+    uint8_t get_u8() {
+        require(1);
+        return uint8_t(data[pos++]);
+    }
+
+    uint64_t get_varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = get_u8();
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        throw runtime_error("ByteReader: varint too long");
+    }
+
+    string_view get_bytes(size_t size) {
+        require(size);
+        string_view result = data.substr(pos, size);
+        pos += size;
+        return result;
+    }
+
+    string get_string() {
+        size_t size = get_varint();
+        return string(get_bytes(size));
+    }
+
+    size_t position() const { return pos; }
+    size_t remaining() const { return data.size() - pos; }
+    bool done() const { return pos == data.size(); }
+};
+
+// Read-only view of a front-coded block of sorted, distinct strings:
+//
+//   count, restart interval, entries length
+//   entries   (shared, suffix length, suffix)*
+//             - shared: leading bytes in common with the previous string,
+//               0 at every interval-th entry (a restart)
+//   restarts  little-endian u32 offset into entries of each restart
+//
+// Keys like "tenant/123/object/..." then cost only the part that differs
+// from their neighbour. Restart entries are stored whole, so find() binary
+// searches them and decodes at most one interval; nothing is allocated but
+// the one string being rebuilt.
+class ElementBlockView {
+  private:
+    uint64_t count = 0;
+    uint64_t interval = 1;
+    string_view entries;
+    string_view restarts;
+
+    size_t restart_offset(size_t i) const {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(restarts.data()) + 4 * i;
+        return size_t(bytes[0]) | size_t(bytes[1]) << 8 | size_t(bytes[2]) << 16 | size_t(bytes[3]) << 24;
+    }
+
+  public:
+    static const uint64_t kRestartInterval = 16;
+
+    // Parses the block at in's position and moves in past it
+    explicit ElementBlockView(ByteReader& in) {
+        count = in.get_varint();
+        interval = in.get_varint();
+        if (interval == 0) throw runtime_error("ORSetCodec: bad restart interval");
+        entries = in.get_bytes(in.get_varint());
+        uint64_t restart_count = count / interval + (count % interval != 0);
+        if (restart_count > entries.size()) throw runtime_error("ORSetCodec: bad element count");
+        restarts = in.get_bytes(4 * restart_count);
+    }
+
+    size_t size() const { return count; }
+
+    // Rebuilds the strings in order, starting at a restart
+    class Cursor {
+      private:
+        const ElementBlockView& block;
+        size_t base;
+        ByteReader in;
+        uint64_t index;
+        string current;
+
+      public:
+        explicit Cursor(const ElementBlockView& b, size_t restart = 0)
+            : block(b), base(restart ? b.restart_offset(restart) : 0), in(b.entries.substr(min(base, b.entries.size()))),
+              index(restart * b.interval) {}
+
+        bool done() const { return index == block.count; }
+
+        // true once every entry was read and nothing is left over
+        bool finished() const { return done() && in.done(); }
+
+        uint64_t position() const { return index; }
+
+        const string& next() {
+            if (done()) throw runtime_error("ORSetCodec: element block overrun");
+            bool restart = index % block.interval == 0;
+            if (restart && block.restart_offset(index / block.interval) != base + in.position()) {
+                throw runtime_error("ORSetCodec: bad restart offset");
+            }
+            uint64_t shared = in.get_varint();
+            if (shared > current.size() || (restart && shared)) throw runtime_error("ORSetCodec: bad shared prefix");
+            current.resize(shared);
+            current.append(in.get_bytes(in.get_varint()));
+            index++;
+            return current;
+        }
+    };
+
+    // Index of key in the block, if present
+    optional<size_t> find(string_view key) const {
+        size_t restart_count = restarts.size() / 4;
+        auto restart_key = [&](size_t i) {
+            size_t offset = restart_offset(i);
+            if (offset >= entries.size()) throw runtime_error("ORSetCodec: bad restart offset");
+            ByteReader in(entries.substr(offset));
+            if (in.get_varint() != 0) throw runtime_error("ORSetCodec: bad shared prefix");
+            return in.get_bytes(in.get_varint());
+        };
+        if (restart_count == 0 || key < restart_key(0)) return nullopt;
+        // last restart whose key is not after key
+        size_t low = 0, high = restart_count;
+        while (high - low > 1) {
+            size_t mid = low + (high - low) / 2;
+            if (restart_key(mid) <= key) {
+                low = mid;
+            } else {
+                high = mid;
+            }
+        }
+        Cursor cursor(*this, low);
+        for (uint64_t n = 0; n < interval && !cursor.done(); n++) {
+            uint64_t index = cursor.position();
+            const string& current = cursor.next();
+            if (current == key) return index;
+            if (current > key) break;
+        }
+        return nullopt;
+    }
+};
+
+// State layout (all integers are varints):
+//
+//   header      "ORS" version, replica_id, local_counter
+//   dictionary  count, replica ids           - tags refer to replicas by index
+//   context     count, (replica, counter)*   - version vector
+//               count, (replica, first, length)*
+//                                            - dot cloud as runs of counters
+//   elements    front-coded block (ElementBlockView) - sorted, distinct
+//   tags        per element: count, (replica, counter)*
+//   removes     count, (replica, counter, element, count, (replica, counter)*)*
+//               - remove dot, element and the tags it removed
+//               count, (replica, counter)*   - remove log floor
+//
+// Elements and their tags are kept in separate blocks so each column holds
+// one kind of data.
+struct ORSetCodec {
+    static const uint8_t kVersion = 4;
+    // Most dots a decoded cloud may hold; peers' bytes are decoded, and a
+    // short frame must not make us allocate without bound
+    static const uint64_t kMaxCloudDots = uint64_t(1) << 22;
+
+    static string encode(const ORSet& set) {
+        ByteWriter out;
+        write_state(set, out);
+        return move(out.buffer);
+    }
+
+    // Same bytes as encode(), as ranges into scratch blocks and into `set`'s
+    // long elements. `set` must not change until they are sent.
+    static SegmentWriter encode_segments(const ORSet& set) {
+        SegmentWriter out;
+        write_state(set, out);
+        return out;
+    }
+
+    // Writes the state layout to a ByteWriter or a SegmentWriter
+    template<class Writer>
+    static void write_state(const ORSet& set, Writer& out) {
+        out.put_bytes("ORS", 3);
+        out.put_u8(kVersion);
+        out.put_string(set.replica_id);
+        out.put_varint(set.local_counter);
+
+        map<string, uint64_t> dictionary;
+        auto intern = [&](const string& id) { dictionary.emplace(id, 0); };
+        for (const auto &entry : set.context.vv) intern(entry.first);
+        for (const auto &tag : set.context.cloud) intern(tag.replica_id);
+        for (const auto &pair : set.internal_set) intern(pair.second.replica_id);
+        for (const auto &entry : set.remove_log) {
+            intern(entry.first.replica_id);
+            for (const auto &tag : entry.second.tags) intern(tag.replica_id);
+        }
+        for (const auto &entry : set.remove_log_floor) intern(entry.first);
+        out.put_varint(dictionary.size());
+        uint64_t index = 0;
+        for (auto &entry : dictionary) {
+            entry.second = index++;
+            // copied, not referenced: the dictionary is gone once we return
+            out.put_varint(entry.first.size());
+            out.put_bytes(entry.first.data(), entry.first.size());
+        }
+
+        out.put_varint(set.context.vv.size());
+        for (const auto &entry : set.context.vv) {
+            out.put_varint(dictionary[entry.first]);
+            out.put_varint(entry.second);
+        }
+        // deltas carry whole ranges of dots in the cloud, so runs are short
+        vector<pair<const Tag*, uint64_t>> runs;
+        for (const auto &tag : set.context.cloud) {
+            if (!runs.empty() && runs.back().first->replica_id == tag.replica_id &&
+                runs.back().first->counter + runs.back().second == tag.counter) {
+                runs.back().second++;
+            } else {
+                runs.push_back({&tag, 1});
+            }
+        }
+        out.put_varint(runs.size());
+        for (const auto &run : runs) {
+            out.put_varint(dictionary[run.first->replica_id]);
+            out.put_varint(run.first->counter);
+            out.put_varint(run.second);
+        }
+
+        vector<string_view> elements;
+        elements.reserve(set.element_cache.size());
+        for (auto it = set.internal_set.begin(); it != set.internal_set.end();) {
+            elements.push_back(it->first);
+            const string& element = it->first;
+            while (it != set.internal_set.end() && it->first == element) ++it;
+        }
+        write_element_block(elements, out);
+        for (auto it = set.internal_set.begin(); it != set.internal_set.end();) {
+            auto last = it;
+            size_t count = 0;
+            while (last != set.internal_set.end() && last->first == it->first) {
+                ++last;
+                count++;
+            }
+            out.put_varint(count);
+            for (; it != last; ++it) {
+                out.put_varint(dictionary[it->second.replica_id]);
+                out.put_varint(it->second.counter);
+            }
+        }
+
+        out.put_varint(set.remove_log.size());
+        for (const auto &entry : set.remove_log) {
+            out.put_varint(dictionary[entry.first.replica_id]);
+            out.put_varint(entry.first.counter);
+            out.put_string(entry.second.element);
+            out.put_varint(entry.second.tags.size());
+            for (const auto &tag : entry.second.tags) {
+                out.put_varint(dictionary[tag.replica_id]);
+                out.put_varint(tag.counter);
+            }
+        }
+        out.put_varint(set.remove_log_floor.size());
+        for (const auto &entry : set.remove_log_floor) {
+            out.put_varint(dictionary[entry.first]);
+            out.put_varint(entry.second);
+        }
+    }
+
+    // Writes sorted, distinct strings as a front-coded block. With a
+    // SegmentWriter, long suffixes point into the strings.
+    template<class Writer>
+    static void write_element_block(const vector<string_view>& sorted, Writer& out) {
+        const uint64_t interval = ElementBlockView::kRestartInterval;
+        auto varint_size = [](uint64_t value) {
+            size_t size = 1;
+            for (; value >= 0x80; value >>= 7) size++;
+            return size;
+        };
+        // shared prefixes and entry offsets first: the lengths come before the entries
+        vector<uint32_t> shared(sorted.size(), 0), restarts;
+        size_t length = 0;
+        for (size_t i = 0; i < sorted.size(); i++) {
+            if (i % interval == 0) {
+                if (length > numeric_limits<uint32_t>::max()) throw runtime_error("ORSetCodec: element block too large");
+                restarts.push_back(uint32_t(length));
+            } else {
+                string_view previous = sorted[i - 1], current = sorted[i];
+                size_t limit = min(previous.size(), current.size());
+                size_t n = 0;
+                while (n < limit && previous[n] == current[n]) n++;
+                shared[i] = uint32_t(n);
+            }
+            size_t suffix = sorted[i].size() - shared[i];
+            length += varint_size(shared[i]) + varint_size(suffix) + suffix;
+        }
+        out.put_varint(sorted.size());
+        out.put_varint(interval);
+        out.put_varint(length);
+        for (size_t i = 0; i < sorted.size(); i++) {
+            out.put_varint(shared[i]);
+            out.put_string(sorted[i].substr(shared[i]));
+        }
+        for (uint32_t offset : restarts) {
+            char bytes[4] = {char(offset), char(offset >> 8), char(offset >> 16), char(offset >> 24)};
+            out.put_bytes(bytes, 4);
+        }
+    }
+
+    // Whether the encoded state has element, found by binary search in its
+    // element block without decoding the state
+    static bool contains_encoded(string_view bytes, string_view element) {
+        ByteReader in(bytes);
+        skip_to_elements(in);
+        return ElementBlockView(in).find(element).has_value();
+    }
+
+    // Reads the header, dictionary and context; returns the dictionary size
+    static uint64_t skip_to_elements(ByteReader& in) {
+        if (in.get_bytes(3) != "ORS") throw runtime_error("ORSetCodec: bad magic");
+        if (in.get_u8() != kVersion) throw runtime_error("ORSetCodec: unsupported version");
+        in.get_string();
+        in.get_varint();
+        uint64_t replicas = in.get_varint();
+        for (uint64_t n = replicas; n > 0; n--) in.get_string();
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            in.get_varint();
+            in.get_varint();
+        }
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            in.get_varint();
+            in.get_varint();
+            in.get_varint();
+        }
+        return replicas;
+    }
+
+    static ORSet decode(string_view bytes) { return read_state(bytes, nullptr); }
+
+    // decode(bytes).missing_for(peer_vv), without building the pairs whose
+    // tags the peer has seen: for a state that mostly overlaps the peer's,
+    // most of the decoding work is allocating those. A peer behind the
+    // state's remove log floor gets the full state, as from missing_for().
+    // The delta's summary only has what the peer lacked; `state_vv`, if
+    // given, receives the encoded state's whole summary.
+    static ORSet decode_missing(string_view bytes, const map<string, uint64_t>& peer_vv,
+                                map<string, uint64_t>* state_vv = nullptr) {
+        ORSet partial = read_state(bytes, &peer_vv);
+        if (state_vv) *state_vv = partial.summary();
+        for (const auto &entry : partial.remove_log_floor) {
+            auto it = peer_vv.find(entry.first);
+            if (it == peer_vv.end() || it->second < entry.second) return decode(bytes);
+        }
+        return partial.missing_for(peer_vv);
+    }
+
+    // Pairs whose tags peer_vv has seen are skipped, unless it is null
+    static ORSet read_state(string_view bytes, const map<string, uint64_t>* peer_vv) {
+        ByteReader in(bytes);
+        if (in.get_bytes(3) != "ORS") throw runtime_error("ORSetCodec: bad magic");
+        if (in.get_u8() != kVersion) throw runtime_error("ORSetCodec: unsupported version");
+
+        ORSet set(in.get_string());
+        set.local_counter = in.get_varint();
+
+        // every id takes at least its length byte
+        uint64_t replicas = in.get_varint();
+        if (replicas > in.remaining()) throw runtime_error("ORSetCodec: bad dictionary size");
+        vector<string> dictionary(replicas);
+        for (auto &id : dictionary) id = in.get_string();
+        auto replica = [&]() -> const string& {
+            uint64_t index = in.get_varint();
+            if (index >= dictionary.size()) throw runtime_error("ORSetCodec: bad replica index");
+            return dictionary[index];
+        };
+
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            const string& id = replica();
+            set.context.vv[id] = in.get_varint();
+        }
+        // a run costs a few bytes whatever its length, so the dots it
+        // expands to are capped rather than trusted
+        uint64_t cloud_budget = kMaxCloudDots;
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            const string& id = replica();
+            uint64_t first = in.get_varint();
+            uint64_t length = in.get_varint();
+            if (length > numeric_limits<uint64_t>::max() - first) throw runtime_error("ORSetCodec: bad dot run");
+            if (length > cloud_budget) throw runtime_error("ORSetCodec: dot cloud too large");
+            cloud_budget -= length;
+            for (uint64_t i = 0; i < length; i++) {
+                set.context.cloud.insert(set.context.cloud.end(), Tag{id, first + i});
+            }
+        }
+
+        // counter of each dictionary entry the peer has seen up to
+        vector<uint64_t> peer_seen(dictionary.size(), 0);
+        if (peer_vv) {
+            for (size_t i = 0; i < dictionary.size(); i++) {
+                auto it = peer_vv->find(dictionary[i]);
+                if (it != peer_vv->end()) peer_seen[i] = it->second;
+            }
+        }
+
+        ElementBlockView block(in);
+        ElementBlockView::Cursor cursor(block);
+        while (!cursor.done()) {
+            const string& view = cursor.next();
+            string element; // built once a pair of it is kept
+            bool kept = false;
+            for (uint64_t n = in.get_varint(); n > 0; n--) {
+                uint64_t index = in.get_varint();
+                if (index >= dictionary.size()) throw runtime_error("ORSetCodec: bad replica index");
+                uint64_t counter = in.get_varint();
+                if (peer_vv && counter <= peer_seen[index]) continue;
+                if (!kept) element = string(view);
+                kept = true;
+                set.insert_pair(set.internal_set.end(), {element, Tag{dictionary[index], counter}});
+            }
+            if (kept || !peer_vv) set.element_cache.insert(view);
+        }
+        if (!cursor.finished()) throw runtime_error("ORSetCodec: trailing element bytes");
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            const string& id = replica();
+            Tag event{id, in.get_varint()};
+            auto &removed = set.remove_log[event];
+            removed.element = in.get_string();
+            for (uint64_t m = in.get_varint(); m > 0; m--) {
+                const string& tag_id = replica();
+                removed.tags.push_back(Tag{tag_id, in.get_varint()});
+            }
+        }
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            const string& id = replica();
+            set.remove_log_floor[id] = in.get_varint();
+        }
+        if (!in.done()) throw runtime_error("ORSetCodec: trailing bytes");
+        return set;
+    }
+
+    // ============= COMPRESSED STATE =============
+    //
+    // encode() output through BlockCodec, with the tag block taken apart
+    // into columns first: the tag counts per element, the replica of each
+    // tag, and each counter as the zigzag difference from the previous
+    // counter of the same replica. Each column is compressed on its own, so
+    // the Huffman tables see one kind of value: counts that are nearly all
+    // 1, one or two replicas, and small counter steps instead of 3-byte
+    // counters interleaved with everything else. Below kColumnBytes the
+    // four sets of code tables cost more than they save, and the encoding
+    // is compressed as one stream.
+    //
+    // The columns are Stream VByte (stream_vbyte.h) when every value fits in
+    // 32 bits, so a bulk sync decodes them with SIMD shuffles rather than one
+    // LEB128 byte at a time; wider values fall back to LEB128.
+    //
+    //   "ORZ" version, layout
+    //   layout 0: one BlockCodec stream
+    //   layout 1: element count, prefix length, then four BlockCodec
+    //             streams, each length-prefixed: the state without its tag
+    //             block (which goes back after `prefix length` bytes),
+    //             counts, replicas, counter steps as LEB128
+    //   layout 2: element count, tag count, prefix length, the same four
+    //             streams with the columns in Stream VByte
+    static const size_t kColumnBytes = 4096;
+
+    static string encode_compressed(const ORSet& set, int level = BlockCodec::kDefaultLevel) {
+        return compress_state(encode(set), level);
+    }
+
+    static ORSet decode_compressed(string_view bytes) { return decode(decompress_state(bytes)); }
+
+    static string compress_state(string_view encoded, int level = BlockCodec::kDefaultLevel) {
+        ByteWriter out;
+        out.put_bytes("ORZ", 3);
+        out.put_u8(kVersion);
+        if (encoded.size() < kColumnBytes) {
+            out.put_u8(0);
+            out.buffer.append(BlockCodec::compress(encoded, level));
+            return move(out.buffer);
+        }
+
+        ByteReader in(encoded);
+        uint64_t replicas = skip_to_elements(in);
+        uint64_t elements = ElementBlockView(in).size();
+        size_t prefix = in.position();
+
+        vector<uint64_t> columns[3]; // counts, replicas, counter steps
+        vector<uint64_t> last(replicas, 0);
+        uint64_t widest = 0;
+        for (uint64_t e = 0; e < elements; e++) {
+            uint64_t count = in.get_varint();
+            columns[0].push_back(count);
+            for (; count > 0; count--) {
+                uint64_t index = in.get_varint();
+                if (index >= replicas) throw runtime_error("ORSetCodec: bad replica index");
+                uint64_t counter = in.get_varint();
+                int64_t step = int64_t(counter - last[index]);
+                last[index] = counter;
+                columns[1].push_back(index);
+                columns[2].push_back((uint64_t(step) << 1) ^ uint64_t(step >> 63));
+            }
+            widest = max(widest, columns[0].back());
+        }
+        for (uint64_t step : columns[2]) widest = max(widest, step);
+        string rest(encoded.substr(0, prefix));
+        rest.append(encoded.substr(in.position()));
+
+        // Stream VByte where every value fits 32 bits, LEB128 otherwise
+        bool stream_vbyte = widest <= numeric_limits<uint32_t>::max();
+        out.put_u8(stream_vbyte ? 2 : 1);
+        out.put_varint(elements);
+        if (stream_vbyte) out.put_varint(columns[1].size());
+        out.put_varint(prefix);
+        out.put_string(BlockCodec::compress(rest, level));
+        for (const auto &column : columns) {
+            string bytes;
+            if (stream_vbyte) {
+                vector<uint32_t> narrow(column.begin(), column.end());
+                bytes = StreamVByte::encode(narrow);
+            } else {
+                ByteWriter varints;
+                for (uint64_t value : column) varints.put_varint(value);
+                bytes = move(varints.buffer);
+            }
+            out.put_string(BlockCodec::compress(bytes, level));
+        }
+        return move(out.buffer);
+    }
+
+    // The encode() bytes back from compress_state()
+    static string decompress_state(string_view bytes) {
+        ByteReader in(bytes);
+        if (in.get_bytes(3) != "ORZ") throw runtime_error("ORSetCodec: bad compressed magic");
+        if (in.get_u8() != kVersion) throw runtime_error("ORSetCodec: unsupported version");
+        uint8_t layout = in.get_u8();
+        if (layout == 0) return BlockCodec::decompress(bytes.substr(in.position()));
+        if (layout != 1 && layout != 2) throw runtime_error("ORSetCodec: bad compressed layout");
+        uint64_t elements = in.get_varint();
+        uint64_t tags = layout == 2 ? in.get_varint() : 0;
+        uint64_t prefix = in.get_varint();
+        string rest = BlockCodec::decompress(in.get_bytes(in.get_varint()));
+        if (prefix > rest.size()) throw runtime_error("ORSetCodec: bad prefix length");
+
+        // every column as 64-bit values, whichever way it was written
+        vector<uint64_t> columns[3];
+        for (int c = 0; c < 3; c++) {
+            string column = BlockCodec::decompress(in.get_bytes(in.get_varint()));
+            if (layout == 2) {
+                size_t count = c == 0 ? elements : tags, read = 0;
+                if (count > column.size()) throw runtime_error("ORSetCodec: bad column length");
+                vector<uint32_t> values = StreamVByte::decode_values(column, count, &read);
+                if (read != column.size()) throw runtime_error("ORSetCodec: trailing column bytes");
+                columns[c].assign(values.begin(), values.end());
+            } else {
+                ByteReader varints(column);
+                while (!varints.done()) columns[c].push_back(varints.get_varint());
+            }
+        }
+        if (!in.done()) throw runtime_error("ORSetCodec: trailing bytes");
+        if (columns[0].size() != elements || columns[1].size() != columns[2].size()) {
+            throw runtime_error("ORSetCodec: column lengths disagree");
+        }
+
+        ByteWriter out;
+        out.put_bytes(rest.data(), prefix);
+        unordered_map<uint64_t, uint64_t> last;
+        size_t tag = 0;
+        for (uint64_t count : columns[0]) {
+            out.put_varint(count);
+            if (count > columns[1].size() - tag) throw runtime_error("ORSetCodec: tag columns too short");
+            for (; count > 0; count--, tag++) {
+                uint64_t zigzag = columns[2][tag];
+                uint64_t& counter = last[columns[1][tag]];
+                counter += uint64_t(int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1));
+                out.put_varint(columns[1][tag]);
+                out.put_varint(counter);
+            }
+        }
+        if (tag != columns[1].size()) throw runtime_error("ORSetCodec: trailing column values");
+        out.put_bytes(rest.data() + prefix, rest.size() - prefix);
+        return move(out.buffer);
+    }
+
+    static void encode_op(const ORSetOp& op, ByteWriter& out) {
+        out.put_u8(op.kind);
+        out.put_string(op.element);
+        out.put_string(op.tag.replica_id);
+        out.put_varint(op.tag.counter);
+        out.put_varint(op.removed.size());
+        for (const auto &tag : op.removed) {
+            out.put_string(tag.replica_id);
+            out.put_varint(tag.counter);
+        }
+        out.put_varint(op.deps.size());
+        for (const auto &dep : op.deps) {
+            out.put_string(dep.first);
+            out.put_varint(dep.second);
+        }
+    }
+
+    static ORSetOp decode_op(ByteReader& in) {
+        ORSetOp op;
+        uint8_t kind = in.get_u8();
+        if (kind > ORSetOp::Remove) throw runtime_error("ORSetCodec: bad op kind");
+        op.kind = ORSetOp::Kind(kind);
+        op.element = in.get_string();
+        op.tag.replica_id = in.get_string();
+        op.tag.counter = in.get_varint();
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            string id = in.get_string();
+            op.removed.push_back(Tag{id, in.get_varint()});
+        }
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            string id = in.get_string();
+            op.deps[id] = in.get_varint();
+        }
+        return op;
+    }
+};
+
+#endif
@@ -0,0 +1,373 @@
+// orset_store.h - Durable ORSet: delta write-ahead log and snapshots
+#ifndef ORSET_STORE_H
+#define ORSET_STORE_H
+
+#include "crdt.h"
+#include "io_engine.h"
+#include "orset_codec.h"
+
+// A replica whose every mutation is logged before it counts as durable.
+// Each add(), remove() and merge() appends its delta (the encoded ORSet
+// delta from the delta mutators, or the merged state) as one record to the
+// write-ahead log and returns the log position after it. Deltas join in any
+// order and any number of times, so recovery only has to join whatever
+// records it finds onto the latest snapshot.
+//
+// Records are staged in the engine's buffers and written in batches, each
+// followed by an fdatasync(). A new batch goes out when the previous one is
+// durable, so the batch size follows the sync latency (group commit). With
+// UringEngine the mutating thread never waits for the disk, except when
+// every staging buffer is in flight; durable_lsn() and wait_durable() tell
+// when a position is safe. With BlockingEngine every mutation writes and
+// syncs before it returns.
+//
+// Files in `dir`:
+//   wal.<g>       records, appended in generation g
+//   snapshot.<g>  one record holding the full state; covers every wal.<h>
+//                 with h < g
+// Records are framed as u32 length, u32 checksum (FNV-1a) and the encoded
+// state, little-endian. A torn record ends its log file. snapshot() starts
+// generation g+1 and writes the state in the background; once it and the
+// directory entry are durable, older files are deleted.
+template <typename Engine>
+class ORSetStore {
+  public:
+    struct Stats {
+        size_t records = 0;
+        size_t batches = 0; // each one write and one fdatasync()
+        size_t snapshots = 0;
+        size_t stalls = 0;  // waits for a free staging buffer
+    };
+
+  private:
+    // token = id << 3 | kind
+    enum Kind : uint64_t { WalWrite, WalSync, SnapshotWrite, SnapshotSync, DirectorySync };
+
+    struct Batch {
+        size_t buffer;    // staging buffer, or SIZE_MAX when `owned` holds the bytes
+        string owned;     // records too large for a staging buffer
+        uint64_t end;     // log position after its last record
+        bool synced = false;
+    };
+
+    struct Snapshot {
+        uint64_t generation;
+        int fd;
+        string bytes;
+    };
+
+    static const size_t kNone = SIZE_MAX;
+    static const size_t kFrameHeader = 8;
+
+    filesystem::path dir;
+    string replica_id;
+    ORSet state;
+    Engine io;
+    int dir_fd = -1;
+    int wal_fd = -1;
+    vector<int> retired_fds; // earlier logs, open until their batches finish
+    uint64_t generation = 0; // of the log being appended
+    uint64_t wal_offset = 0; // bytes handed to the engine in this generation
+    uint64_t logged = 0;     // log position: record bytes since open, across generations
+    uint64_t durable = 0;
+    size_t current = kNone;  // staging buffer being filled
+    size_t fill = 0;
+    vector<size_t> free_buffers;
+    map<uint64_t, Batch> batches; // in flight, by id (submission order)
+    uint64_t next_id = 1;
+    optional<Snapshot> snapshot_in_flight;
+    Stats stats;
+
+    [[noreturn]] static void fail(const string& what) {
+        throw runtime_error("ORSetStore: " + what + ": " + strerror(errno));
+    }
+
+    static uint32_t checksum(string_view payload) { return uint32_t(fnv1a(payload)); }
+
+    static void put_u32(char* out, uint32_t value) {
+        for (int i = 0; i < 4; i++) out[i] = char(value >> (8 * i));
+    }
+
+    static uint32_t get_u32(const char* in) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) value |= uint32_t(uint8_t(in[i])) << (8 * i);
+        return value;
+    }
+
+    static string frame(const string& payload) {
+        string record(kFrameHeader, '\0');
+        put_u32(&record[0], uint32_t(payload.size()));
+        put_u32(&record[4], checksum(payload));
+        return record + payload;
+    }
+
+    // Payloads of the intact records at the start of `bytes`
+    static vector<string_view> records(string_view bytes) {
+        vector<string_view> payloads;
+        while (bytes.size() >= kFrameHeader) {
+            uint32_t length = get_u32(bytes.data());
+            if (length > bytes.size() - kFrameHeader) break;
+            string_view payload = bytes.substr(kFrameHeader, length);
+            if (checksum(payload) != get_u32(bytes.data() + 4)) break;
+            payloads.push_back(payload);
+            bytes.remove_prefix(kFrameHeader + length);
+        }
+        return payloads;
+    }
+
+    static string read_file(const filesystem::path& path) {
+        ifstream in(path, ios::binary);
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+
+    // generation -> path, for files named <prefix>.<generation>
+    map<uint64_t, filesystem::path> files(const string& prefix) const {
+        map<uint64_t, filesystem::path> found;
+        for (const auto &entry : filesystem::directory_iterator(dir)) {
+            string name = entry.path().filename().string();
+            if (name.compare(0, prefix.size() + 1, prefix + ".") != 0) continue;
+            string number = name.substr(prefix.size() + 1);
+            if (number.empty() || number.find_first_not_of("0123456789") != string::npos) continue;
+            found[stoull(number)] = entry.path();
+        }
+        return found;
+    }
+
+    int open_file(const filesystem::path& path) {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) fail("open " + path.string());
+        return fd;
+    }
+
+    void open_log(uint64_t g) {
+        generation = g;
+        wal_fd = open_file(dir / ("wal." + to_string(g)));
+        wal_offset = 0;
+        // the new file's entry must survive a crash before records in it
+        // count: a batch with no records, ordered like the others
+        uint64_t id = next_id++;
+        batches[id] = Batch{kNone, "", logged};
+        io.sync(dir_fd, id << 3 | WalSync);
+    }
+
+    // Latest intact snapshot, then every record logged since
+    void recover() {
+        uint64_t base = 0, last = 0;
+        auto snapshots = files("snapshot");
+        for (auto it = snapshots.rbegin(); it != snapshots.rend(); ++it) {
+            string bytes = read_file(it->second);
+            vector<string_view> payload = records(bytes);
+            if (payload.size() != 1) continue; // torn: an older one still covers it
+            state = ORSetCodec::decode(payload[0]);
+            base = it->first;
+            break;
+        }
+        for (const auto &entry : snapshots) last = max(last, entry.first);
+        for (const auto &entry : files("wal")) {
+            last = max(last, entry.first);
+            if (entry.first < base) continue;
+            string bytes = read_file(entry.second);
+            for (string_view payload : records(bytes)) state.join_delta(ORSetCodec::decode(payload));
+        }
+        open_log(last + 1);
+    }
+
+    void acquire_buffer() {
+        while (free_buffers.empty()) {
+            stats.stalls++;
+            reap(true);
+        }
+        current = free_buffers.back();
+        free_buffers.pop_back();
+        fill = 0;
+    }
+
+    // Hands the staged records to the engine as one write and sync
+    void seal() {
+        if (current == kNone || fill == 0) return;
+        uint64_t id = next_id++;
+        batches[id] = Batch{current, "", logged};
+        io.write_buffer(wal_fd, current, fill, wal_offset, id << 3 | WalWrite, id << 3 | WalSync);
+        wal_offset += fill;
+        current = kNone;
+        fill = 0;
+        stats.batches++;
+    }
+
+    void seal_owned(string record) {
+        uint64_t id = next_id++;
+        Batch& batch = batches[id] = Batch{kNone, move(record), logged};
+        io.write(wal_fd, batch.owned, wal_offset, id << 3 | WalWrite, id << 3 | WalSync);
+        wal_offset += batch.owned.size();
+        stats.batches++;
+    }
+
+    void finish_snapshot() {
+        uint64_t g = snapshot_in_flight->generation;
+        close(snapshot_in_flight->fd);
+        snapshot_in_flight.reset();
+        for (const auto &entry : files("wal")) {
+            if (entry.first < g) filesystem::remove(entry.second);
+        }
+        for (const auto &entry : files("snapshot")) {
+            if (entry.first < g) filesystem::remove(entry.second);
+        }
+        stats.snapshots++;
+    }
+
+    void reap(bool wait) {
+        vector<uint64_t> done;
+        io.reap(done, wait);
+        for (uint64_t token : done) {
+            uint64_t id = token >> 3;
+            switch (Kind(token & 7)) {
+            case WalSync: {
+                Batch& batch = batches.at(id);
+                batch.synced = true;
+                if (batch.buffer != kNone) free_buffers.push_back(batch.buffer);
+                batch.owned.clear();
+                break;
+            }
+            case SnapshotSync:
+                // the file is durable; now its directory entry
+                io.sync(dir_fd, id << 3 | DirectorySync);
+                break;
+            case DirectorySync:
+                finish_snapshot();
+                break;
+            default:
+                break;
+            }
+        }
+        // durable up to the end of the oldest batches that all synced
+        while (!batches.empty() && batches.begin()->second.synced) {
+            durable = batches.begin()->second.end;
+            batches.erase(batches.begin());
+        }
+        if (batches.empty()) {
+            for (int fd : retired_fds) close(fd);
+            retired_fds.clear();
+        }
+    }
+
+    // Reaps what completed, and starts the next batch once the last one is
+    // durable
+    void pump() {
+        reap(false);
+        if (batches.empty()) seal();
+        io.submit();
+    }
+
+    uint64_t log(const ORSet& delta) {
+        string payload = ORSetCodec::encode(delta);
+        size_t size = kFrameHeader + payload.size();
+        stats.records++;
+        if (size > io.buffer_bytes()) {
+            seal();
+            logged += size;
+            seal_owned(frame(payload));
+        } else {
+            if (current != kNone && fill + size > io.buffer_bytes()) seal();
+            if (current == kNone) acquire_buffer();
+            char* out = io.buffer(current) + fill;
+            put_u32(out, uint32_t(payload.size()));
+            put_u32(out + 4, checksum(payload));
+            memcpy(out + kFrameHeader, payload.data(), payload.size());
+            fill += size;
+            logged += size;
+        }
+        pump();
+        return logged;
+    }
+
+  public:
+    // Opens or creates the store in `dir` and recovers its state
+    template <typename... EngineArgs>
+    ORSetStore(const string& directory, const string& id, EngineArgs&&... engine_args)
+        : dir(directory), replica_id(id), state(id), io(forward<EngineArgs>(engine_args)...) {
+        filesystem::create_directories(dir);
+        dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd < 0) fail("open " + dir.string());
+        for (size_t i = io.buffer_count(); i > 0; i--) free_buffers.push_back(i - 1);
+        recover();
+    }
+
+    ~ORSetStore() {
+        try {
+            wait_durable(logged);
+            while (snapshot_in_flight || io.in_flight() > 0) reap(true);
+        } catch (const exception&) {
+        }
+        if (snapshot_in_flight) close(snapshot_in_flight->fd);
+        for (int fd : retired_fds) close(fd);
+        if (wal_fd >= 0) close(wal_fd);
+        if (dir_fd >= 0) close(dir_fd);
+    }
+
+    ORSetStore(const ORSetStore&) = delete;
+    ORSetStore& operator=(const ORSetStore&) = delete;
+
+    // Mutations return the log position that makes them durable; a remove
+    // that removed nothing logs nothing
+    uint64_t add(const string& element) {
+        ORSet delta(replica_id);
+        state.add(element, delta);
+        return log(delta);
+    }
+
+    uint64_t remove(const string& element) {
+        ORSet delta(replica_id);
+        state.remove(element, delta);
+        return delta.logged_remove_count() == 0 ? logged : log(delta);
+    }
+
+    uint64_t merge(const ORSet& other) {
+        uint64_t position = log(other);
+        state.merge(other);
+        return position;
+    }
+
+    uint64_t logged_lsn() const { return logged; }
+
+    uint64_t durable_lsn() {
+        pump();
+        return durable;
+    }
+
+    void wait_durable(uint64_t lsn) {
+        pump();
+        while (durable < lsn) {
+            reap(true);
+            if (batches.empty()) seal();
+            io.submit();
+        }
+    }
+
+    // Starts a snapshot of the current state in a new generation. Returns
+    // false if one is still being written.
+    bool snapshot() {
+        pump();
+        if (snapshot_in_flight) return false;
+        seal();
+        retired_fds.push_back(wal_fd);
+        uint64_t g = generation + 1;
+        open_log(g);
+        int fd = open_file(dir / ("snapshot." + to_string(g)));
+        snapshot_in_flight = Snapshot{g, fd, frame(ORSetCodec::encode(state))};
+        io.write(fd, snapshot_in_flight->bytes, 0, g << 3 | SnapshotWrite, g << 3 | SnapshotSync);
+        pump();
+        return true;
+    }
+
+    bool snapshot_pending() {
+        pump();
+        return bool(snapshot_in_flight);
+    }
+
+    const ORSet& get_state() const { return state; }
+    const Engine& engine() const { return io; }
+    uint64_t get_generation() const { return generation; }
+    const Stats& get_stats() const { return stats; }
+};
+
+#endif
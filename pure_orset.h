@@ -0,0 +1,194 @@
+// pure_orset.h - Pure op-based OR-Set with a partially ordered log (PO-log)
+#ifndef PURE_ORSET_H
+#define PURE_ORSET_H
+
+#include "crdt.h"
+#include "orset_codec.h"
+
+// A pure op ships only the operation and its argument, plus the causal
+// timestamp the broadcast layer needs: the op's dot and what its origin had
+// delivered when issuing it. No tags of other adds travel with a remove.
+struct PureOp {
+    enum Kind { Add, Remove } kind;
+    string element;
+    Tag tag;                  // origin and sequence number
+    map<string, uint64_t> vc; // origin's delivered ops at issue time
+
+    // a causally precedes b when b's origin had delivered a before issuing b
+    static bool precedes(const Tag& a, const PureOp& b) {
+        auto it = b.vc.find(a.replica_id);
+        return it != b.vc.end() && it->second >= a.counter;
+    }
+
+    void encode(ByteWriter& out) const {
+        out.put_u8(kind);
+        out.put_string(element);
+        out.put_string(tag.replica_id);
+        out.put_varint(tag.counter);
+        out.put_varint(vc.size());
+        for (const auto &entry : vc) {
+            out.put_string(entry.first);
+            out.put_varint(entry.second);
+        }
+    }
+
+    static PureOp decode(ByteReader& in) {
+        PureOp op;
+        uint8_t kind = in.get_u8();
+        if (kind > Remove) throw runtime_error("PureOp: bad op kind");
+        op.kind = Kind(kind);
+        op.element = in.get_string();
+        op.tag.replica_id = in.get_string();
+        op.tag.counter = in.get_varint();
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            string id = in.get_string();
+            op.vc[id] = in.get_varint();
+        }
+        return op;
+    }
+};
+
+// Pure op-based add-wins set. The state is
+//   - the stable elements: adds every replica has delivered, timestamps dropped
+//   - the PO-log: adds that are not stable yet, keyed by element
+// Delivering an op discards every logged op on the same element that
+// causally precedes it, because the newer op makes it redundant. A remove is
+// never logged: once it has discarded what it observed, nothing later can
+// depend on it. Queries read both parts: an element is present if it is
+// stable or has an add in the log.
+//
+// Ops are delivered in causal order (buffered until their dependencies
+// arrive). compact_stable() moves adds that became causally stable out of the
+// log, so the log only holds ops concurrent with something still in flight.
+class PureORSet {
+  private:
+    string replica_id;
+    uint64_t local_counter;
+    CausalContext delivered;
+    StabilityTracker stability;
+    unordered_set<string> stable_elements;
+    unordered_map<string, vector<Tag>> polog; // element -> unstable add dots
+    size_t log_size;
+    vector<PureOp> pending_ops;
+
+    bool causally_ready(const PureOp& op) const {
+        for (const auto &dep : op.vc) {
+            if (dep.first != op.tag.replica_id && delivered.max_counter(dep.first) < dep.second) {
+                return false;
+            }
+        }
+        return delivered.max_counter(op.tag.replica_id) + 1 == op.tag.counter;
+    }
+
+    void effect(const PureOp& op) {
+        auto it = polog.find(op.element);
+        if (it != polog.end()) {
+            auto &adds = it->second;
+            size_t before = adds.size();
+            adds.erase(std::remove_if(adds.begin(), adds.end(),
+                                      [&](const Tag& add) { return PureOp::precedes(add, op); }),
+                       adds.end());
+            log_size -= before - adds.size();
+            if (adds.empty()) polog.erase(it);
+        }
+        // stable adds precede every op delivered from now on
+        stable_elements.erase(op.element);
+        if (op.kind == PureOp::Add) {
+            polog[op.element].push_back(op.tag);
+            log_size++;
+        }
+        delivered.insert(op.tag);
+    }
+
+    PureOp issue(PureOp::Kind kind, const string& element) {
+        local_counter++;
+        PureOp op{kind, element, Tag{replica_id, local_counter}, delivered.vv};
+        effect(op);
+        return op;
+    }
+
+  public:
+    PureORSet(const string& id) : replica_id(id), local_counter(0), stability(id), log_size(0) {}
+
+    // Apply locally and return the op to broadcast
+    PureOp add(const string& element) { return issue(PureOp::Add, element); }
+    PureOp remove(const string& element) { return issue(PureOp::Remove, element); }
+
+    // Applies op, or buffers it until its dependencies arrive. Duplicates are
+    // ignored. Returns the number of ops applied.
+    size_t deliver(const PureOp& op) {
+        if (delivered.contains(op.tag)) return 0;
+        if (!causally_ready(op)) {
+            pending_ops.push_back(op);
+            return 0;
+        }
+        effect(op);
+        size_t applied = 1;
+        for (bool progress = true; progress;) {
+            progress = false;
+            for (size_t i = 0; i < pending_ops.size(); i++) {
+                if (delivered.contains(pending_ops[i].tag)) {
+                    pending_ops.erase(pending_ops.begin() + i--);
+                } else if (causally_ready(pending_ops[i])) {
+                    PureOp ready = move(pending_ops[i]);
+                    pending_ops.erase(pending_ops.begin() + i--);
+                    effect(ready);
+                    applied++;
+                    progress = true;
+                }
+            }
+        }
+        local_counter = max(local_counter, delivered.max_counter(replica_id));
+        return applied;
+    }
+
+    bool contains(const string& element) const {
+        return stable_elements.count(element) > 0 || polog.count(element) > 0;
+    }
+
+    set<string> elements() const {
+        set<string> result(stable_elements.begin(), stable_elements.end());
+        for (const auto &entry : polog) result.insert(entry.first);
+        return result;
+    }
+
+    const map<string, uint64_t>& delivered_vv() const { return delivered.vv; }
+
+    void acknowledge(const string& replica, const map<string, uint64_t>& acked) {
+        stability.acknowledge(replica, acked, delivered);
+    }
+
+    void add_member(const string& replica) { stability.add_member(replica); }
+
+    map<string, uint64_t> stable_vv() const { return stability.stable_vv(delivered); }
+
+    // Moves causally stable adds from the PO-log into the stable elements.
+    // Returns the number of log entries freed.
+    size_t compact_stable() {
+        map<string, uint64_t> stable = stable_vv();
+        size_t before = log_size;
+        for (auto it = polog.begin(); it != polog.end();) {
+            auto &adds = it->second;
+            size_t count = adds.size();
+            adds.erase(std::remove_if(adds.begin(), adds.end(), [&](const Tag& add) {
+                auto sit = stable.find(add.replica_id);
+                return sit != stable.end() && add.counter <= sit->second;
+            }), adds.end());
+            if (adds.size() < count) stable_elements.insert(it->first);
+            log_size -= count - adds.size();
+            it = adds.empty() ? polog.erase(it) : next(it);
+        }
+        return before - log_size;
+    }
+
+    size_t size() const {
+        size_t result = stable_elements.size();
+        for (const auto &entry : polog) result += !stable_elements.count(entry.first);
+        return result;
+    }
+    size_t internal_size() const { return stable_elements.size() + log_size; }
+    size_t log_entries() const { return log_size; }
+    size_t pending_op_count() const { return pending_ops.size(); }
+};
+
+#endif
@@ -0,0 +1,546 @@
+// replication.h - ORSet replication over TCP with an epoll event loop
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include "crdt.h"
+#include "orset_codec.h"
+#include "sync_planner.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Wire format: every message is a frame
+//
+//   length  u32    bytes after this field
+//   type    u8     MessageType
+//   id      u64    request id, echoed by the reply
+//   body
+//
+// Fixed-width fields are little-endian, bodies use ByteWriter encodings.
+// Both sides send a Hello with their replica id first. Replies come back in
+// request order, so a client can pipeline any number of requests on one
+// connection.
+enum MessageType : uint8_t {
+    Hello = 1,
+    FullRequest,   // empty
+    DeltaRequest,  // summary
+    DigestRequest, // summary, bucket_digest()
+    FullReply,     // state
+    DeltaReply,    // summary, missing_for()
+    DigestReply,   // summary, differing buckets, digest_delta()
+};
+
+// Frame and body encodings, shared by ReplicationNode and other clients of
+// the protocol
+struct ReplicationWire {
+    static const size_t kHeaderSize = 4 + 1 + 8;
+    static const size_t kMaxFrame = size_t(1) << 30;
+
+    static void put_fixed(string& out, uint64_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; i++) out.push_back(char(value >> (8 * i)));
+    }
+
+    static uint64_t get_fixed(const char* data, size_t bytes) {
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; i++) value |= uint64_t(uint8_t(data[i])) << (8 * i);
+        return value;
+    }
+
+    static void put_header(string& out, MessageType type, uint64_t id, size_t body_size) {
+        put_fixed(out, 1 + 8 + body_size, 4);
+        put_fixed(out, type, 1);
+        put_fixed(out, id, 8);
+    }
+
+    template<class Writer>
+    static void put_summary(Writer& out, const map<string, uint64_t>& vv) {
+        out.put_varint(vv.size());
+        for (const auto &entry : vv) {
+            out.put_string(entry.first);
+            out.put_varint(entry.second);
+        }
+    }
+
+    static map<string, uint64_t> get_summary(ByteReader& in) {
+        map<string, uint64_t> vv;
+        for (uint64_t n = in.get_varint(); n > 0; n--) {
+            string id = in.get_string();
+            vv[id] = in.get_varint();
+        }
+        return vv;
+    }
+};
+
+// Sends byte ranges with sendmsg(), at most IOV_MAX per call, and drops
+// what was sent from the front of `iov`. Stops when everything is sent or the
+// socket would block. Returns the bytes sent, or -1 on errors other than
+// EAGAIN (errno is set).
+inline ssize_t send_segments(int fd, vector<iovec>& iov) {
+    size_t first = 0, sent = 0;
+    while (first < iov.size()) {
+        msghdr msg{};
+        msg.msg_iov = &iov[first];
+        msg.msg_iovlen = min(iov.size() - first, size_t(IOV_MAX));
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0) return -1;
+        sent += n;
+        for (size_t left = n; left > 0;) {
+            if (left >= iov[first].iov_len) {
+                left -= iov[first++].iov_len;
+            } else {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + left;
+                iov[first].iov_len -= left;
+                left = 0;
+            }
+        }
+    }
+    iov.erase(iov.begin(), iov.begin() + first);
+    return sent;
+}
+
+// One replica served over TCP. A node listens on a loopback port and pulls
+// from peers with request(): full state, a summary delta or a bucket digest
+// (see SyncPlanner for the strategies). Connections to a peer are opened on
+// first use and reused; requests on them are pipelined. Whatever the reply
+// carries is merged into the node's state, and summaries exchanged on the
+// way count as acknowledgements.
+//
+// Everything is non-blocking and driven by poll(), which waits on epoll and
+// handles whatever is ready: one thread can run many nodes by polling each
+// in turn, and nodes in different processes talk the same way. Setup errors
+// throw runtime_error; a peer that misbehaves or hangs up only loses its
+// connection and the requests still pending on it.
+class ReplicationNode : private ReplicationWire {
+  public:
+    struct Stats {
+        size_t requests_served = 0;
+        size_t replies_applied = 0;
+        size_t failed_requests = 0; // lost with their connection
+        size_t connections_opened = 0;
+        size_t connections_accepted = 0;
+        size_t bytes_sent = 0;
+        size_t bytes_received = 0;
+    };
+
+  private:
+    static const size_t kDirectBytes = 64 * 1024;
+
+    struct Pending {
+        uint64_t id;
+        MessageType type;
+        size_t buckets; // digest requests
+    };
+
+    struct Connection {
+        int fd;
+        string address;  // "host:port" for connections we opened
+        string peer_id;  // from the peer's Hello
+        string in;       // received, not parsed yet
+        size_t in_pos = 0;
+        string out;      // not sent yet
+        size_t out_pos = 0;
+        bool watching_write = false;
+        deque<Pending> pending;
+    };
+
+    string replica_id;
+    ORSet state;
+    int listen_fd = -1, epoll_fd = -1;
+    uint16_t port = 0;
+    unordered_map<int, Connection> connections;
+    unordered_map<string, int> outgoing; // address -> fd
+    unordered_set<int> unflushed;        // frames queued since the last poll()
+    uint64_t next_request = 1;
+    Stats stats;
+
+    [[noreturn]] static void fail(const string& what) {
+        throw runtime_error("ReplicationNode: " + what + ": " + strerror(errno));
+    }
+
+    static void set_nonblocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) fail("fcntl");
+    }
+
+    void watch(Connection& conn, bool write) {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP | (write ? uint32_t(EPOLLOUT) : 0u);
+        event.data.fd = conn.fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &event) < 0) fail("epoll_ctl");
+        conn.watching_write = write;
+    }
+
+    void add_connection(int fd, const string& address) {
+        set_nonblocking(fd);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) fail("epoll_ctl");
+        Connection& conn = connections[fd];
+        conn.fd = fd;
+        conn.address = address;
+        queue_frame(conn, Hello, 0, replica_id);
+    }
+
+    void close_connection(int fd) {
+        auto it = connections.find(fd);
+        if (it == connections.end()) return;
+        stats.failed_requests += it->second.pending.size();
+        unflushed.erase(fd);
+        if (!it->second.address.empty()) outgoing.erase(it->second.address);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        connections.erase(it);
+    }
+
+    // Frames are only queued; poll() sends each connection's queue in one go,
+    // so pipelined requests and their replies share syscalls and packets
+    void queue_frame(Connection& conn, MessageType type, uint64_t id, const string& body) {
+        put_header(conn.out, type, id, body.size());
+        conn.out += body;
+        unflushed.insert(conn.fd);
+    }
+
+    // Replies of kDirectBytes or more skip the queue: whatever is queued, the
+    // frame header and the body's segments go out in sendmsg() calls, and
+    // only what the socket does not take is copied into the queue. Smaller
+    // ones are queued like any frame.
+    void queue_reply(Connection& conn, MessageType type, uint64_t id, SegmentWriter& body) {
+        if (body.size() < kDirectBytes) {
+            queue_frame(conn, type, id, body.join());
+            return;
+        }
+        string header;
+        put_header(header, type, id, body.size());
+        vector<iovec> iov;
+        auto add = [&](const char* data, size_t size) {
+            if (size > 0) iov.push_back({const_cast<char*>(data), size});
+        };
+        add(conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos);
+        add(header.data(), header.size());
+        for (string_view segment : body.finish()) add(segment.data(), segment.size());
+
+        ssize_t n = send_segments(conn.fd, iov);
+        if (n < 0) {
+            close_connection(conn.fd);
+            return;
+        }
+        stats.bytes_sent += n;
+        string rest;
+        for (const auto &range : iov) rest.append(static_cast<const char*>(range.iov_base), range.iov_len);
+        conn.out = move(rest);
+        conn.out_pos = 0;
+        if (!conn.out.empty() && !conn.watching_write) watch(conn, true);
+        if (conn.out.empty() && conn.watching_write) watch(conn, false);
+    }
+
+    // Sends as much as the socket takes. Returns false if the connection
+    // broke and was closed.
+    bool flush(Connection& conn) {
+        while (conn.out_pos < conn.out.size()) {
+            ssize_t n = send(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!conn.watching_write) watch(conn, true);
+                return true;
+            }
+            if (n < 0) {
+                close_connection(conn.fd);
+                return false;
+            }
+            conn.out_pos += n;
+            stats.bytes_sent += n;
+        }
+        conn.out.clear();
+        conn.out_pos = 0;
+        if (conn.watching_write) watch(conn, false);
+        return true;
+    }
+
+    // Reads everything available and handles the complete frames. Returns
+    // false if the connection was closed.
+    bool receive(Connection& conn) {
+        char buffer[64 * 1024];
+        bool hung_up = false; // still handle what arrived before
+        for (;;) {
+            ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n <= 0) {
+                hung_up = true;
+                break;
+            }
+            conn.in.append(buffer, n);
+            stats.bytes_received += n;
+        }
+
+        int fd = conn.fd;
+        while (conn.in.size() - conn.in_pos >= 4) {
+            size_t length = get_fixed(conn.in.data() + conn.in_pos, 4);
+            if (length < kHeaderSize - 4 || length > kMaxFrame) {
+                close_connection(fd);
+                return false;
+            }
+            if (conn.in.size() - conn.in_pos < 4 + length) break;
+            const char* frame = conn.in.data() + conn.in_pos;
+            MessageType type = MessageType(uint8_t(frame[4]));
+            uint64_t id = get_fixed(frame + 5, 8);
+            string_view body(frame + kHeaderSize, length + 4 - kHeaderSize);
+            conn.in_pos += 4 + length;
+            try {
+                handle(conn, type, id, body);
+            } catch (const exception&) {
+                close_connection(fd); // malformed frame or payload
+                return false;
+            }
+            if (!connections.count(fd)) return false;
+        }
+        conn.in.erase(0, conn.in_pos);
+        conn.in_pos = 0;
+        if (hung_up) {
+            close_connection(fd);
+            return false;
+        }
+        return true;
+    }
+
+    void handle(Connection& conn, MessageType type, uint64_t id, string_view body) {
+        ByteReader in(body);
+        switch (type) {
+        case Hello:
+            conn.peer_id = string(body);
+            return;
+        case FullRequest: {
+            stats.requests_served++;
+            SegmentWriter reply = ORSetCodec::encode_segments(state);
+            queue_reply(conn, FullReply, id, reply);
+            return;
+        }
+        case DeltaRequest: {
+            map<string, uint64_t> peer_vv = get_summary(in);
+            if (!conn.peer_id.empty()) state.acknowledge(conn.peer_id, peer_vv);
+            stats.requests_served++;
+            ORSet delta = state.missing_for(peer_vv);
+            SegmentWriter reply;
+            put_summary(reply, state.summary());
+            ORSetCodec::write_state(delta, reply);
+            queue_reply(conn, DeltaReply, id, reply);
+            return;
+        }
+        case DigestRequest: {
+            map<string, uint64_t> peer_vv = get_summary(in);
+            // checked before allocating: the count is the peer's
+            uint64_t buckets = in.get_varint();
+            if (buckets == 0 || buckets > (1u << 24) || buckets > in.remaining() / 8) {
+                throw runtime_error("bad digest size");
+            }
+            vector<uint64_t> digest(buckets);
+            for (auto &sum : digest) sum = get_fixed(in.get_bytes(8).data(), 8);
+            if (!conn.peer_id.empty()) state.acknowledge(conn.peer_id, peer_vv);
+            stats.requests_served++;
+            vector<uint32_t> differing;
+            ORSet answer = state.digest_delta(peer_vv, digest, differing);
+            SegmentWriter reply;
+            put_summary(reply, state.summary());
+            reply.put_varint(differing.size());
+            for (uint32_t b : differing) reply.put_varint(b);
+            ORSetCodec::write_state(answer, reply);
+            queue_reply(conn, DigestReply, id, reply);
+            return;
+        }
+        default:
+            break;
+        }
+
+        // a reply to the oldest request pending on this connection
+        if (conn.pending.empty() || conn.pending.front().id != id) throw runtime_error("unexpected reply");
+        Pending request = conn.pending.front();
+        conn.pending.pop_front();
+        if (type == FullReply && request.type == FullRequest) {
+            state.merge(ORSetCodec::decode(body));
+        } else if (type == DeltaReply && request.type == DeltaRequest) {
+            map<string, uint64_t> peer_vv = get_summary(in);
+            state.merge(ORSetCodec::decode(body.substr(in.position())));
+            if (!conn.peer_id.empty()) state.acknowledge(conn.peer_id, peer_vv);
+        } else if (type == DigestReply && request.type == DigestRequest) {
+            map<string, uint64_t> peer_vv = get_summary(in);
+            // every bucket at most once, each at least one byte
+            uint64_t count = in.get_varint();
+            if (count > request.buckets || count > in.remaining()) throw runtime_error("bad bucket count");
+            vector<uint32_t> differing(count);
+            for (auto &b : differing) {
+                b = in.get_varint();
+                if (b >= request.buckets) throw runtime_error("bad bucket");
+            }
+            state.merge_buckets(ORSetCodec::decode(body.substr(in.position())), request.buckets, differing);
+            if (!conn.peer_id.empty()) state.acknowledge(conn.peer_id, peer_vv);
+        } else {
+            throw runtime_error("reply does not match request");
+        }
+        stats.replies_applied++;
+    }
+
+    Connection& connection_to(const string& host, uint16_t peer_port) {
+        string address = host + ":" + to_string(peer_port);
+        auto it = outgoing.find(address);
+        if (it != outgoing.end()) return connections.at(it->second);
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(peer_port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) throw invalid_argument("bad address " + host);
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) fail("socket");
+        // blocking connect: it completes in the kernel, even for a node
+        // polled by this same thread
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            fail("connect " + address);
+        }
+        stats.connections_opened++;
+        outgoing[address] = fd;
+        add_connection(fd, address);
+        return connections.at(fd);
+    }
+
+    void flush_queued() {
+        vector<int> fds(unflushed.begin(), unflushed.end());
+        unflushed.clear();
+        for (int fd : fds) {
+            auto it = connections.find(fd);
+            if (it != connections.end()) flush(it->second);
+        }
+    }
+
+  public:
+    ReplicationNode(const string& id, uint16_t listen_port = 0, const string& host = "127.0.0.1")
+        : replica_id(id), state(id) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) fail("epoll_create1");
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) fail("socket");
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(listen_port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) throw invalid_argument("bad address " + host);
+        socklen_t length = sizeof(addr);
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) fail("bind");
+        if (listen(listen_fd, SOMAXCONN) < 0) fail("listen");
+        if (getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &length) < 0) fail("getsockname");
+        port = ntohs(addr.sin_port);
+        set_nonblocking(listen_fd);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = listen_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0) fail("epoll_ctl");
+    }
+
+    ~ReplicationNode() {
+        for (auto &entry : connections) close(entry.first);
+        if (listen_fd >= 0) close(listen_fd);
+        if (epoll_fd >= 0) close(epoll_fd);
+    }
+
+    ReplicationNode(const ReplicationNode&) = delete;
+    ReplicationNode& operator=(const ReplicationNode&) = delete;
+
+    uint16_t listen_port() const { return port; }
+
+    void add(const string& element) { state.add(element); }
+    void remove(const string& element) { state.remove(element); }
+    void add_member(const string& peer_id) { state.add_member(peer_id); } // see StabilityTracker
+    const ORSet& get_state() const { return state; }
+
+    // Asks the peer at host:port for what this node is missing; the reply
+    // is merged when poll() receives it. Digests use `buckets` buckets.
+    void request(const string& host, uint16_t peer_port, SyncStrategy strategy, size_t buckets = 1024) {
+        Connection& conn = connection_to(host, peer_port);
+        uint64_t id = next_request++;
+        ByteWriter body;
+        MessageType type;
+        switch (strategy) {
+        case SyncStrategy::Full:
+            type = FullRequest;
+            break;
+        case SyncStrategy::Delta:
+            type = DeltaRequest;
+            put_summary(body, state.summary());
+            break;
+        case SyncStrategy::Digest: {
+            type = DigestRequest;
+            put_summary(body, state.summary());
+            vector<uint64_t> digest = state.bucket_digest(buckets);
+            body.put_varint(digest.size());
+            for (uint64_t sum : digest) put_fixed(body.buffer, sum, 8);
+            break;
+        }
+        default:
+            throw invalid_argument("ReplicationNode: no request for this strategy");
+        }
+        conn.pending.push_back({id, type, buckets});
+        queue_frame(conn, type, id, body.buffer);
+    }
+
+    void request(uint16_t peer_port, SyncStrategy strategy) { request("127.0.0.1", peer_port, strategy); }
+
+    // Closes the connection to host:port, if any; pending requests fail
+    void disconnect(const string& host, uint16_t peer_port) {
+        auto it = outgoing.find(host + ":" + to_string(peer_port));
+        if (it != outgoing.end()) close_connection(it->second);
+    }
+
+    // Waits up to timeout_ms (0: just check, -1: forever) for socket events
+    // and handles them. Returns the number of events handled.
+    size_t poll(int timeout_ms = 0) {
+        flush_queued();
+        epoll_event events[64];
+        int ready = epoll_wait(epoll_fd, events, 64, timeout_ms);
+        if (ready < 0) {
+            if (errno == EINTR) return 0;
+            fail("epoll_wait");
+        }
+        for (int e = 0; e < ready; e++) {
+            int fd = events[e].data.fd;
+            if (fd == listen_fd) {
+                for (;;) {
+                    int client = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (client < 0) break;
+                    stats.connections_accepted++;
+                    add_connection(client, "");
+                }
+                continue;
+            }
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue; // closed earlier in this batch
+            Connection& conn = it->second;
+            if ((events[e].events & EPOLLOUT) && !flush(conn)) continue;
+            if (events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) receive(conn);
+        }
+        flush_queued();
+        return ready;
+    }
+
+    size_t pending_requests() const {
+        size_t count = 0;
+        for (const auto &entry : outgoing) count += connections.at(entry.second).pending.size();
+        return count;
+    }
+
+    size_t connection_count() const { return connections.size(); }
+    const Stats& get_stats() const { return stats; }
+};
+
+#endif
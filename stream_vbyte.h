@@ -0,0 +1,182 @@
+// stream_vbyte.h - Stream VByte coding of 32-bit integers with SIMD decoding
+#ifndef STREAM_VBYTE_H
+#define STREAM_VBYTE_H
+
+#include <bits/stdc++.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STREAM_VBYTE_X86 1
+#endif
+
+using namespace std;
+
+// Stream VByte (Lemire et al.): each value takes 1-4 little-endian bytes,
+// and its length goes into a separate control stream, 2 bits per value, four
+// values per control byte (first value in the low bits):
+//
+//   control  ceil(n / 4) bytes
+//   data     the values' bytes, back to back
+//
+// Unlike LEB128, where every byte says whether another follows, a decoder
+// knows from one control byte where four values start. A 256-entry table
+// gives the shuffle that spreads their bytes into four 32-bit lanes, so a
+// group decodes with one load, one shuffle and one store. The SSSE3 kernel
+// decodes one group per step, the AVX2 kernel two; decode() picks the best
+// one the CPU has at run time, so the header needs no -m flags. Groups whose
+// 16-byte load would run past the input are decoded by the scalar loop,
+// which also catches input shorter than its control bytes say.
+struct StreamVByte {
+    enum class Kernel { Scalar, SSSE3, AVX2 };
+
+  private:
+    struct Tables {
+        uint8_t length[256];      // data bytes of a control byte's four values
+        uint8_t shuffle[256][16]; // source byte per output byte, 0xff for zero
+    };
+
+    static const Tables& tables() {
+        static const Tables built = []() {
+            Tables t;
+            for (int control = 0; control < 256; control++) {
+                int offset = 0;
+                for (int lane = 0; lane < 4; lane++) {
+                    int bytes = ((control >> (2 * lane)) & 3) + 1;
+                    for (int b = 0; b < 4; b++) t.shuffle[control][lane * 4 + b] = b < bytes ? uint8_t(offset + b) : 0xff;
+                    offset += bytes;
+                }
+                t.length[control] = uint8_t(offset);
+            }
+            return t;
+        }();
+        return built;
+    }
+
+    // Values [from, n), reading control and data from the given positions:
+    // a 4-byte load and a mask while 4 bytes remain, byte by byte after.
+    // Returns the end of the data read.
+    static const uint8_t* decode_tail(const uint8_t* control, const uint8_t* data, const uint8_t* end, size_t from,
+                                      size_t n, uint32_t* out) {
+        static const uint32_t mask[4] = {0xff, 0xffff, 0xffffff, 0xffffffff};
+        for (size_t i = from; i < n; i++) {
+            int bytes = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+            uint32_t value = 0;
+            if (end - data >= 4) {
+                memcpy(&value, data, 4);
+                value &= mask[bytes - 1];
+            } else {
+                if (end - data < bytes) throw runtime_error("StreamVByte: truncated data bytes");
+                for (int b = 0; b < bytes; b++) value |= uint32_t(data[b]) << (8 * b);
+            }
+            data += bytes;
+            out[i] = value;
+        }
+        return data;
+    }
+
+#if defined(STREAM_VBYTE_X86)
+    __attribute__((target("ssse3")))
+    static const uint8_t* decode_ssse3(const uint8_t* control, const uint8_t* data, const uint8_t* end, size_t n, uint32_t* out) {
+        const Tables& t = tables();
+        size_t i = 0;
+        for (; i + 4 <= n && end - data >= 16; i += 4) {
+            uint8_t c = control[i / 4];
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+            __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t.shuffle[c]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_shuffle_epi8(bytes, mask));
+            data += t.length[c];
+        }
+        return decode_tail(control, data, end, i, n, out);
+    }
+
+    // Two groups per step: each 128-bit lane loads and shuffles its own group
+    __attribute__((target("avx2")))
+    static const uint8_t* decode_avx2(const uint8_t* control, const uint8_t* data, const uint8_t* end, size_t n, uint32_t* out) {
+        const Tables& t = tables();
+        size_t i = 0;
+        for (; i + 8 <= n && end - data >= 32; i += 8) {
+            uint8_t c0 = control[i / 4], c1 = control[i / 4 + 1];
+            const uint8_t* second = data + t.length[c0];
+            __m256i bytes = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(second)), 1);
+            __m256i mask = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(t.shuffle[c0]))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(t.shuffle[c1])), 1);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_shuffle_epi8(bytes, mask));
+            data = second + t.length[c1];
+        }
+        return decode_ssse3(control + i / 4, data, end, n - i, out + i);
+    }
+#endif
+
+  public:
+    static size_t max_encoded_size(size_t n) { return (n + 3) / 4 + 4 * n; }
+
+    // Appends the encoding of values[0, n)
+    static void encode(const uint32_t* values, size_t n, string& out) {
+        size_t control_at = out.size();
+        out.resize(control_at + (n + 3) / 4, '\0');
+        for (size_t i = 0; i < n; i++) {
+            uint32_t value = values[i];
+            int bytes = value < (1u << 8) ? 1 : value < (1u << 16) ? 2 : value < (1u << 24) ? 3 : 4;
+            out[control_at + i / 4] = char(uint8_t(out[control_at + i / 4]) | ((bytes - 1) << (2 * (i % 4))));
+            for (int b = 0; b < bytes; b++) out.push_back(char(value >> (8 * b)));
+        }
+    }
+
+    static string encode(const vector<uint32_t>& values) {
+        string out;
+        out.reserve(max_encoded_size(values.size()));
+        encode(values.data(), values.size(), out);
+        return out;
+    }
+
+    static Kernel best_kernel() {
+#if defined(STREAM_VBYTE_X86)
+        static const Kernel best = __builtin_cpu_supports("avx2")    ? Kernel::AVX2
+                                   : __builtin_cpu_supports("ssse3") ? Kernel::SSSE3
+                                                                     : Kernel::Scalar;
+        return best;
+#else
+        return Kernel::Scalar;
+#endif
+    }
+
+    static const char* kernel_name(Kernel kernel) {
+        switch (kernel) {
+            case Kernel::AVX2: return "AVX2";
+            case Kernel::SSSE3: return "SSSE3";
+            default: return "scalar";
+        }
+    }
+
+    // Decodes n values into out; returns the bytes read. Throws
+    // runtime_error if the input is shorter than its control bytes say, or
+    // if the kernel is not available on this CPU.
+    static size_t decode(string_view in, size_t n, uint32_t* out, Kernel kernel = best_kernel()) {
+        if (in.size() < (n + 3) / 4) throw runtime_error("StreamVByte: truncated control bytes");
+        if (kernel != Kernel::Scalar && int(kernel) > int(best_kernel())) {
+            throw runtime_error("StreamVByte: kernel not supported on this CPU");
+        }
+        const uint8_t* control = reinterpret_cast<const uint8_t*>(in.data());
+        const uint8_t* data = control + (n + 3) / 4;
+        const uint8_t* end = control + in.size();
+        switch (kernel) {
+#if defined(STREAM_VBYTE_X86)
+            case Kernel::AVX2: data = decode_avx2(control, data, end, n, out); break;
+            case Kernel::SSSE3: data = decode_ssse3(control, data, end, n, out); break;
+#endif
+            default: data = decode_tail(control, data, end, 0, n, out); break;
+        }
+        return size_t(data - control);
+    }
+
+    static vector<uint32_t> decode_values(string_view in, size_t n, size_t* consumed = nullptr) {
+        vector<uint32_t> values(n);
+        size_t read = decode(in, n, values.data());
+        if (consumed) *consumed = read;
+        return values;
+    }
+};
+
+#endif
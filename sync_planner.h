@@ -0,0 +1,190 @@
+// sync_planner.h - Picks delta, digest or full-state sync per peer and round
+#ifndef SYNC_PLANNER_H
+#define SYNC_PLANNER_H
+
+#include "crdt.h"
+#include "orset_codec.h"
+
+enum class SyncStrategy { Delta, Digest, Full, Skip };
+
+inline const char* strategy_name(SyncStrategy strategy) {
+    switch (strategy) {
+    case SyncStrategy::Delta: return "delta";
+    case SyncStrategy::Digest: return "digest";
+    case SyncStrategy::Skip: return "skip";
+    default: return "full";
+    }
+}
+
+// One sync of one peer: what the planner saw, what it predicted for each
+// strategy, what it picked and what that cost on the wire.
+struct SyncDecision {
+    string from, to;
+    ORSet::Divergence divergence;
+    size_t state_pairs = 0;
+    size_t buckets = 0;      // digest size the planner would use
+    double estimate[3] = {}; // predicted bytes, indexed by SyncStrategy; none for Skip
+    SyncStrategy strategy;
+    size_t bytes = 0;        // bytes shipped, both directions
+    size_t differing = 0;    // digest buckets that differed
+};
+
+// Chooses how to bring a peer up to date from its summary alone:
+//   - delta:  missing_for(), priced per unseen pair, remove and dot; not
+//             possible when the peer is behind the remove log floor
+//   - digest: the peer sends bucket_digest(), we answer with the buckets
+//             that differ; priced as the digest plus the expected share of
+//             pairs in differing buckets
+//   - full:   the encoded state
+//   - skip:   nothing, when state fingerprints and summaries already
+//             match; this is checked first and costs O(cloud + remove log)
+// The digest size is chosen per round: with n pairs and d touched elements,
+// 8*B digest bytes against about n*d/B shipped pairs is cheapest near
+// B = sqrt(n*d*pair_bytes/8).
+//
+// Costs per pair and per remove start from rough guesses and follow the
+// measured bytes of every sync (moving averages), so the planner tunes
+// itself to the workload. Every decision is logged.
+class SyncPlanner {
+  private:
+    double pair_bytes = 12;   // per live pair in a state or digest answer
+    double remove_bytes = 16; // per remove log entry
+    double dot_bytes = 1;     // per unseen dot; gaps encode as runs, so fixed
+    vector<SyncDecision> decisions;
+
+    static void learn(double& rate, double observed) { rate = 0.75 * rate + 0.25 * observed; }
+
+    static string encode_digest(const vector<uint64_t>& digest) {
+        ByteWriter out;
+        out.put_varint(digest.size());
+        for (uint64_t sum : digest) out.put_bytes(&sum, sizeof(sum));
+        return move(out.buffer);
+    }
+
+    static size_t bucket_list_bytes(const vector<uint32_t>& differing) {
+        ByteWriter out;
+        out.put_varint(differing.size());
+        for (uint32_t b : differing) out.put_varint(b);
+        return out.buffer.size();
+    }
+
+    SyncDecision estimate(const ORSet& from, const ORSet& to) const {
+        SyncDecision decision;
+        decision.divergence = from.divergence_from(to.summary());
+        decision.state_pairs = from.internal_size();
+        const ORSet::Divergence& gap = decision.divergence;
+
+        double n = double(decision.state_pairs);
+        double d = double(max<size_t>(gap.elements, 1));
+        decision.buckets = size_t(clamp(sqrt(n * d * pair_bytes / 8), 1.0, max(n, 1.0)));
+        double B = double(decision.buckets);
+        double differing = B * (1 - exp(-d / B));
+
+        double full = n * pair_bytes + from.logged_remove_count() * remove_bytes + 32;
+        decision.estimate[int(SyncStrategy::Full)] = full;
+        decision.estimate[int(SyncStrategy::Delta)] =
+            gap.behind_floor ? full
+                             : gap.pairs * pair_bytes + gap.removes * remove_bytes + gap.dots * dot_bytes + 32;
+        decision.estimate[int(SyncStrategy::Digest)] =
+            8 * B + differing * (2 + n / B * pair_bytes) + gap.removes * remove_bytes + 64;
+
+        decision.strategy = SyncStrategy::Full;
+        for (SyncStrategy s : {SyncStrategy::Digest, SyncStrategy::Delta}) {
+            if (decision.estimate[int(s)] < decision.estimate[int(decision.strategy)]) decision.strategy = s;
+        }
+        return decision;
+    }
+
+    SyncDecision execute(SyncDecision decision, const ORSet& from, ORSet& to) {
+        const ORSet::Divergence& gap = decision.divergence;
+        if (decision.strategy == SyncStrategy::Skip) {
+            // what the peers compared: state fingerprint and summary
+            ByteWriter out;
+            uint64_t fingerprint = to.state_fingerprint();
+            out.put_bytes(&fingerprint, sizeof(fingerprint));
+            for (const auto &entry : to.summary()) {
+                out.put_string(entry.first);
+                out.put_varint(entry.second);
+            }
+            decision.bytes = out.buffer.size();
+        } else if (decision.strategy == SyncStrategy::Digest) {
+            vector<uint64_t> digest = to.bucket_digest(decision.buckets);
+            string request = encode_digest(digest);
+            vector<uint32_t> differing;
+            ORSet answer = from.digest_delta(to.summary(), digest, differing);
+            string payload = ORSetCodec::encode(answer);
+            to.merge_buckets(ORSetCodec::decode(payload), decision.buckets, differing);
+            decision.bytes = request.size() + bucket_list_bytes(differing) + payload.size();
+            decision.differing = differing.size();
+            if (answer.internal_size() > 0) {
+                learn(pair_bytes, double(payload.size() - answer.logged_remove_count() * remove_bytes) /
+                                      answer.internal_size());
+            }
+        } else {
+            bool full = decision.strategy == SyncStrategy::Full || gap.behind_floor;
+            if (full) decision.strategy = SyncStrategy::Full; // missing_for() would send it anyway
+            string payload = ORSetCodec::encode(full ? from : from.missing_for(to.summary()));
+            to.merge(ORSetCodec::decode(payload));
+            decision.bytes = payload.size();
+            if (full && decision.state_pairs > 0) {
+                learn(pair_bytes, double(payload.size() - from.logged_remove_count() * remove_bytes) /
+                                      decision.state_pairs);
+            } else if (!full && gap.removes > 0 && gap.pairs == 0) {
+                learn(remove_bytes, double(payload.size() - gap.dots * dot_bytes) / gap.removes);
+            } else if (!full && gap.pairs > 0) {
+                learn(pair_bytes, double(payload.size() - gap.removes * remove_bytes - gap.dots * dot_bytes) /
+                                      gap.pairs);
+            }
+        }
+        pair_bytes = max(pair_bytes, 1.0);
+        remove_bytes = max(remove_bytes, 1.0);
+        decisions.push_back(decision);
+        return decision;
+    }
+
+  public:
+    SyncDecision plan(const ORSet& from, const ORSet& to) const {
+        if (from.state_fingerprint() == to.state_fingerprint() && from.summary() == to.summary()) {
+            SyncDecision decision;
+            decision.state_pairs = from.internal_size();
+            decision.strategy = SyncStrategy::Skip;
+            return decision;
+        }
+        return estimate(from, to);
+    }
+
+    // Plans, ships the encoded payload to `to` and merges it there. Returns
+    // the decision, which is also logged.
+    SyncDecision sync(const string& from_id, const ORSet& from, const string& to_id, ORSet& to) {
+        SyncDecision decision = plan(from, to);
+        decision.from = from_id;
+        decision.to = to_id;
+        return execute(move(decision), from, to);
+    }
+
+    SyncDecision sync(const string& from_id, const ORSet& from, const string& to_id, ORSet& to,
+                      SyncStrategy strategy) {
+        SyncDecision decision = estimate(from, to);
+        decision.from = from_id;
+        decision.to = to_id;
+        decision.strategy = strategy;
+        return execute(move(decision), from, to);
+    }
+
+    const vector<SyncDecision>& log() const { return decisions; }
+
+    // One row per decision, for tuning the cost model offline
+    void write_csv(ostream& out) const {
+        out << "From,To,GapDots,GapPairs,GapRemoves,GapElements,BehindFloor,StatePairs,Buckets,"
+               "EstDelta,EstDigest,EstFull,Strategy,Bytes,DifferingBuckets\n";
+        for (const auto &d : decisions) {
+            out << d.from << "," << d.to << "," << d.divergence.dots << "," << d.divergence.pairs << ","
+                << d.divergence.removes << "," << d.divergence.elements << "," << d.divergence.behind_floor
+                << "," << d.state_pairs << "," << d.buckets << "," << d.estimate[0] << "," << d.estimate[1]
+                << "," << d.estimate[2] << "," << strategy_name(d.strategy) << "," << d.bytes << ","
+                << d.differing << "\n";
+        }
+    }
+};
+
+#endif